@@ -4,14 +4,158 @@
 
 #include "utils.h"
 
-std::mutex & CAggregatedStats::GetMutex() {
-    return m_mutex;
+void COverloadCounters::Merge( const COverloadCounters & other ) {
+    shed_events += other.shed_events;
+    fast_parsed_events += other.fast_parsed_events;
+    dropped_requests += other.dropped_requests;
+    overflow_responses += other.overflow_responses;
+    input_stall_ms += other.input_stall_ms;
+}
+
+bool COverloadCounters::IsEmpty() const {
+    return !shed_events && !fast_parsed_events && !dropped_requests && !overflow_responses && !input_stall_ms;
+}
+
+CAggregatedStats::CAggregatedStats( const size_t sketch_size ) {
+    if ( sketch_size > 0 ) {
+        m_sketch = std::make_unique < CStatsSketch >( sketch_size );
+    }
+}
+
+void CAggregatedStats::Count( const t_key key, const unsigned int sample_shift, const int64_t latency_us ) {
+    // Horvitz-Thompson estimate: a response kept with the probability p stands for 1/p responses,
+    // the variance of its contribution is (1 - p) / p^2
+    const long long unsigned int weight = 1ULL << sample_shift;
+    if ( m_sketch ) {
+        m_sketch->Count( GetRequestID( key ), GetResultCodeID( key ), weight, weight * ( weight - 1 ) );
+    } else {
+        auto & cell = m_stats[ key ];
+        cell.count += weight;
+        cell.variance += weight * ( weight - 1 );
+        if ( latency_us >= 0 ) {
+            if ( !cell.latencies ) {
+                cell.latencies = std::make_unique < CLatencyHistogram >();
+            }
+            cell.latencies->Add( static_cast < uint32_t >( std::min < int64_t >( latency_us, std::numeric_limits < uint32_t >::max() ) ), weight );
+        }
+    }
+    m_total_count += weight;
+    m_total_variance += weight * ( weight - 1 );
+    m_sample_count++;
+}
+
+const CStatsSketch * CAggregatedStats::GetSketch() const {
+    return m_sketch.get();
 }
 
 CAggregatedStats::t_aggregated_stats & CAggregatedStats::GetStats() {
     return m_stats;
 }
 
-time_t CAggregatedStatsCollection::GetQuantizedTime( const time_t ts, const time_t delta ) {
-    return ( ts / SECONDS_PER_OUTPUT + delta ) * SECONDS_PER_OUTPUT;
+long long unsigned int CAggregatedStats::GetSampleCount() const {
+    return m_sample_count;
+}
+
+long long unsigned int CAggregatedStats::GetTotalCount() const {
+    return m_total_count;
+}
+
+long long unsigned int CAggregatedStats::GetTotalVariance() const {
+    return m_total_variance;
+}
+
+COverloadCounters & CAggregatedStats::GetOverloadCounters() {
+    return m_overload_counters;
+}
+
+const COverloadCounters & CAggregatedStats::GetOverloadCounters() const {
+    return m_overload_counters;
+}
+
+void CAggregatedStats::Merge( const CAggregatedStats & other ) {
+    for ( const auto & [ key, cell ] : other.m_stats ) {
+        auto & own_cell = m_stats[ key ];
+        own_cell.count += cell.count;
+        own_cell.variance += cell.variance;
+        if ( cell.latencies ) {
+            if ( own_cell.latencies ) {
+                own_cell.latencies->Merge( *cell.latencies );
+            } else {
+                own_cell.latencies = std::make_unique < CLatencyHistogram >( *cell.latencies );
+            }
+        }
+    }
+    if ( other.m_sketch ) {
+        if ( m_sketch ) {
+            m_sketch->Merge( *other.m_sketch );
+        } else {
+            m_sketch = std::make_unique < CStatsSketch >( *other.m_sketch );
+        }
+    }
+    m_sample_count += other.m_sample_count;
+    m_total_count += other.m_total_count;
+    m_total_variance += other.m_total_variance;
+    m_overload_counters.Merge( other.m_overload_counters );
+}
+
+void CAggregatedStats::AddCell( const t_key key, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies ) {
+    if ( m_sketch ) {
+        m_sketch->Count( GetRequestID( key ), GetResultCodeID( key ), count, variance );
+        return;
+    }
+    auto & cell = m_stats[ key ];
+    cell.count += count;
+    cell.variance += variance;
+    if ( latencies ) {
+        if ( cell.latencies ) {
+            cell.latencies->Merge( *latencies );
+        } else {
+            cell.latencies = std::make_unique < CLatencyHistogram >( *latencies );
+        }
+    }
+}
+
+void CAggregatedStats::AddTotals( const long long unsigned int sample_count, const long long unsigned int total_count, const long long unsigned int total_variance ) {
+    m_sample_count += sample_count;
+    m_total_count += total_count;
+    m_total_variance += total_variance;
+}
+
+CAggregatedStats::t_key CAggregatedStats::MakeKey( const CDictionary::t_id request, const CDictionary::t_id result_code ) {
+    return ( static_cast < t_key >( request ) << 32 ) | result_code;
+}
+
+CDictionary::t_id CAggregatedStats::GetRequestID( const t_key key ) {
+    return static_cast < CDictionary::t_id >( key >> 32 );
+}
+
+CDictionary::t_id CAggregatedStats::GetResultCodeID( const t_key key ) {
+    return static_cast < CDictionary::t_id >( key );
+}
+
+void CIntervalStats::AddShard( PAggregatedStats shard, const unsigned int owner ) {
+    std::lock_guard < std::mutex > lock( m_mutex );
+    m_shards.push_back( std::move( shard ) );
+    m_shard_owners.push_back( owner );
+}
+
+PConstAggregatedStats CIntervalStats::Merge() {
+    // only the shard pointers are taken under the lock, merging is done on the private copy
+    std::vector < PAggregatedStats > shards;
+    {
+        std::lock_guard < std::mutex > lock( m_mutex );
+        shards.swap( m_shards );
+        m_shard_owners.clear();
+    }
+    if ( shards.empty() ) {
+        return std::make_shared < CAggregatedStats >();
+    }
+    // the largest shard becomes the result to move the least data
+    std::ranges::sort( shards, std::greater(), []( const PAggregatedStats & shard ) {
+        return std::make_pair( !!shard->GetSketch(), shard->GetStats().size() );
+    } );
+    for ( size_t i = 1; i < shards.size(); i++ ) {
+        shards.front()->Merge( *shards[ i ] );
+    }
+    return shards.front();
 }
@@ -2,41 +2,174 @@
 
 #include "common.h"
 #include "TimeKeyedCollection.h"
+#include "Dictionary.h"
+#include "StatsSketch.h"
+#include "LatencyHistogram.h"
 
 //
-// One set of aggregated stats
+// Counts of events affected by overload protection, reported with the stats of their interval
+//
+class COverloadCounters {
+
+    public:
+
+        // events of line buckets dropped without parsing
+        long long unsigned int shed_events = 0;
+        // events parsed in the fast mode
+        long long unsigned int fast_parsed_events = 0;
+        // requests dropped because the join state is full (their responses are counted as "undefined")
+        long long unsigned int dropped_requests = 0;
+        // responses counted as "undefined" without waiting for their requests because the join state is full
+        long long unsigned int overflow_responses = 0;
+        // time the reader was blocked waiting for the pipeline to catch up
+        long long unsigned int input_stall_ms = 0;
+
+        void Merge( const COverloadCounters & other );
+        bool IsEmpty() const;
+};
+
+//
+// One set of aggregated stats: response counts keyed by (request path ID, result code ID) pairs.
+// Sampled responses are counted with weights, so counts are unbiased estimates and their variances are kept too.
+// Counts are kept exactly or, with a sketch size set, in a fixed-memory sketch of top request paths.
+// A set is owned by one thread at a time and is not locked.
 //
 class CAggregatedStats {
 
     public:
 
-        typedef std::map < std::string, std::string > t_string_to_string_map;
-        typedef std::map < std::string, long long unsigned int > t_string_to_uint64_map;
-        typedef std::map < std::string, t_string_to_uint64_map > t_aggregated_stats;
+        class CCell {
+            public:
+                // estimated count of responses
+                long long unsigned int count = 0;
+                // variance of the estimate (zero without sampling)
+                long long unsigned int variance = 0;
+                // request to response latencies (created with the first latency, never in the sketch)
+                PLatencyHistogram latencies;
+        };
+
+        typedef uint64_t t_key;
+        typedef std::unordered_map < t_key, CCell > t_aggregated_stats;
 
     protected:
 
-        std::mutex m_mutex;
         t_aggregated_stats m_stats;
+        std::unique_ptr < CStatsSketch > m_sketch;
+        // count of responses counted (sampled)
+        long long unsigned int m_sample_count = 0;
+        // exact total of all cells
+        long long unsigned int m_total_count = 0;
+        long long unsigned int m_total_variance = 0;
+        COverloadCounters m_overload_counters;
 
     public:
 
-        // mutex to lock this object
-        std::mutex & GetMutex();
+        // creates a set with exact counts or with a sketch of the size specified
+        explicit CAggregatedStats( const size_t sketch_size = 0 );
+
+        // counts a response sampled with the rate 1 / 2^sample_shift, records its latency if it is not negative
+        void Count( const t_key key, const unsigned int sample_shift, const int64_t latency_us = -1 );
+
+        // calls handler( key, cell ) for every cell, sketched counts of paths out of the top are reported as other_path ones
+        template < typename F > void ForEachCell( const CDictionary::t_id other_path, F handler ) const {
+            for ( const auto & [ key, cell ] : m_stats ) {
+                handler( key, cell );
+            }
+            if ( m_sketch ) {
+                m_sketch->ForEachCell( other_path, [ & ]( const CDictionary::t_id path, const CDictionary::t_id code, const CStatsSketch::CEstimate & estimate ) {
+                    handler( MakeKey( path, code ), CCell { estimate.count, estimate.variance, nullptr } );
+                } );
+            }
+        }
+
+        // returns the sketch or nullptr if counts are exact
+        const CStatsSketch * GetSketch() const;
 
         // immediate stats data r/w access
         CAggregatedStats::t_aggregated_stats & GetStats();
+        long long unsigned int GetSampleCount() const;
+        long long unsigned int GetTotalCount() const;
+        long long unsigned int GetTotalVariance() const;
+        COverloadCounters & GetOverloadCounters();
+        const COverloadCounters & GetOverloadCounters() const;
+
+        // adds counts of another set
+        void Merge( const CAggregatedStats & other );
+
+        // adds counts of a cell and its latencies if any (restores a set saved cell by cell), totals are not changed
+        void AddCell( const t_key key, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies );
+
+        // adds totals of a set saved cell by cell
+        void AddTotals( const long long unsigned int sample_count, const long long unsigned int total_count, const long long unsigned int total_variance );
+
+        // returns a stats key for the dimension IDs specified
+        static t_key MakeKey( const CDictionary::t_id request, const CDictionary::t_id result_code );
+
+        // returns dimension IDs of the stats key specified
+        static CDictionary::t_id GetRequestID( const t_key key );
+        static CDictionary::t_id GetResultCodeID( const t_key key );
 };
 typedef std::shared_ptr < CAggregatedStats > PAggregatedStats;
+typedef std::shared_ptr < const CAggregatedStats > PConstAggregatedStats;
 
 //
-// Collection of aggregated stats keyed by interval start time
+// Stats of one output interval: private stats shards handed over by aggregation threads.
+// Shards are never modified after the hand-over, so once the interval is closed (all partitions joined past its end)
+// the output takes them by a pointer swap and merges them into an immutable snapshot without blocking anyone.
+// Every shard is tagged with its owner (the aggregation partition or NO_OWNER), so checkpoints can take the shards
+// of one partition consistently with its join state.
 //
-class CAggregatedStatsCollection : public CTimeKeyedCollection < CAggregatedStats > {
+class CIntervalStats {
+
+    protected:
+
+        mutable std::mutex m_mutex;
+        std::vector < PAggregatedStats > m_shards;
+        std::vector < unsigned int > m_shard_owners;
 
     public:
 
+        static constexpr unsigned int NO_OWNER = std::numeric_limits < unsigned int >::max();
+
+        // adds a shard of stats
+        void AddShard( PAggregatedStats shard, const unsigned int owner = NO_OWNER );
+
+        // calls handler( owner, shard ) for every shard not taken for output yet (adding shards waits meanwhile)
+        template < typename F > void ForEachShard( F handler ) const {
+            std::lock_guard < std::mutex > lock( m_mutex );
+            for ( size_t i = 0; i < m_shards.size(); i++ ) {
+                handler( m_shard_owners[ i ], static_cast < const CAggregatedStats & >( *m_shards[ i ] ) );
+            }
+        }
+
+        // takes all shards added so far and merges them into one read-only set
+        PConstAggregatedStats Merge();
+};
+typedef std::shared_ptr < CIntervalStats > PIntervalStats;
+
+//
+// Collection of interval stats keyed by interval start time
+//
+class CAggregatedStatsCollection : public CTimeKeyedCollection < CIntervalStats > {
+
+    protected:
+
+        // width of an interval (set once settings are known)
+        time_t m_interval_seconds = 0;
+
+    public:
+
+        void SetIntervalSeconds( const time_t interval_seconds ) {
+            m_interval_seconds = interval_seconds;
+        }
+
+        time_t GetIntervalSeconds() const {
+            return m_interval_seconds;
+        }
+
         // returns timestamp rounded down to the nearest interval start time or to the nearest plus delta interval start time
-        static time_t GetQuantizedTime( const time_t ts, const time_t delta = 0 );
+        time_t GetQuantizedTime( const time_t ts, const time_t delta = 0 ) const {
+            return ( ts / m_interval_seconds + delta ) * m_interval_seconds;
+        }
 
 };
@@ -0,0 +1,13 @@
+#include "common.h"
+
+#include "AggregationPartition.h"
+
+CAggregationPartition::CAggregationPartition( const size_t channel_capacity )
+    : event_channel( channel_capacity )
+{
+}
+
+unsigned int CAggregationPartition::GetIndex( const CTraceKey & id, const unsigned int partition_count ) {
+    // middle hash bits: the top bits select event index shards and the low bits select table slots
+    return static_cast < unsigned int >( ( id.GetHash() >> 32 ) % partition_count );
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "TraceKey.h"
+#include "EventBatch.h"
+#include "Channel.h"
+#include "EventIndex.h"
+
+//
+// A partition of the trace ID space joined and aggregated by one aggregation thread.
+// Parsers split events of every segment by partition, so both events of a pair always meet in the same partition
+// and partitions never share join state or stats.
+//
+class CAggregationPartition {
+
+    public:
+
+        // parsed events of the partition to join and aggregate
+        CChannel < PEventBatch > event_channel;
+        // join state: requests waiting for responses and responses waiting for requests
+        CEventIndex pending_requests;
+        CEventIndex early_responses;
+        // time before which all events of the partition are joined and their stats are handed over
+        std::atomic < time_t > joined_time_limit = 0;
+
+        explicit CAggregationPartition( const size_t channel_capacity );
+
+        // returns the index of the partition a trace key belongs to
+        static unsigned int GetIndex( const CTraceKey & id, const unsigned int partition_count );
+};
+typedef std::unique_ptr < CAggregationPartition > PAggregationPartition;
@@ -2,78 +2,291 @@
 
 #include "Aggregator.h"
 
-CAggregator::CAggregator( PContext context )
+CAggregator::CAggregator( PContext context, const unsigned int partition_index )
     : m_context( std::move( context ) )
+    , m_metrics( m_context->metrics.Register( CThreadMetrics::STAGE_AGGREGATOR ) )
+    , m_partition( *m_context->partitions[ partition_index ] )
+    , m_partition_index( partition_index )
 {
 }
 
-// removes a lock from the previously used stats item and locks new stats item as needed
-void CAggregator::UseStatsItem( const time_t ts ) {
-    if ( ts != m_stats_item_ts || !m_stats_item ) {
+// returns the time before which all events are joined (no line buckets of that time are being filled, parsed or joined)
+time_t CAggregator::GetJoinedTimeLimit() const {
+    if ( time_t line_bucket_ts = 0; m_context->line_buckets.GetOldestTimestamp( line_bucket_ts ) ) {
+        return line_bucket_ts;
+    }
+    // events being received now will get the current time or later
+    return time( nullptr ) / SECONDS_PER_LINE_BUCKET;
+}
+
+// selects the private stats shard of the interval specified, creates it as needed
+void CAggregator::UseStatsShard( const time_t ts ) {
+    if ( ts != m_stats_shard_ts || !m_stats_shard ) {
         m_context->DEBUG_OUTPUT && std::cout << to_stream( ts ) << " time of events being aggregated" << std::endl;
-        m_stats_item_lock.reset();
-        m_stats_item_ts = ts;
-        m_context->stats.GetItemByKey( m_stats_item_ts, m_stats_item );
-        m_stats_item_lock = std::make_unique < std::lock_guard < std::mutex > >( m_stats_item->GetMutex() );
+        auto & shard = m_stats_shards[ ts ];
+        if ( !shard ) {
+            shard = std::make_shared < CAggregatedStats >( m_context->SKETCH_SIZE / m_context->partitions.size() );
+        }
+        m_stats_shard_ts = ts;
+        m_stats_shard = shard.get();
     }
 }
 
-// processes a single response bucket
-void CAggregator::ProcessResponseBucket() {
+// counts a response in the interval of its time
+void CAggregator::CountResponse( const CDictionary::t_id request_path, const CEventTable::CEvent & response ) {
+    UseStatsShard( m_context->stats.GetQuantizedTime( response.m_timestamp ) );
+    m_stats_shard->Count( CAggregatedStats::MakeKey( request_path, response.m_dimension ), m_context->sampler.GetResponseShift( response.m_timestamp ) );
+}
 
-    m_context->DEBUG_OUTPUT && std::cout << to_stream( m_bucket_ts ) << " start aggregating events" << std::endl;
+// counts a response matched with its request recording the latency as needed
+void CAggregator::CountResponse( const CEventTable::CEvent & request, const CEventTable::CEvent & response ) {
+    m_metrics.matched_responses.Add( 1 );
+    if ( !m_context->LATENCY_COLUMNS ) {
+        CountResponse( request.m_dimension, response );
+        return;
+    }
+    UseStatsShard( m_context->stats.GetQuantizedTime( response.m_timestamp ) );
+    // receive times wrap, the difference is signed (a response received before its request is counted without a latency)
+    const int32_t latency_us = static_cast < int32_t >( response.m_received_us - request.m_received_us );
+    if ( latency_us < 0 ) {
+        m_metrics.early_received_responses.Add( 1 );
+    }
+    m_stats_shard->Count(
+        CAggregatedStats::MakeKey( request.m_dimension, response.m_dimension ),
+        m_context->sampler.GetResponseShift( response.m_timestamp ),
+        latency_us
+    );
+}
+
+// matches requests of a batch with early responses (storing unmatched requests as pending),
+// then matches responses of a batch with pending requests (keeping unmatched responses waiting for their requests)
+void CAggregator::ProcessBatch( const CEventBatch & batch ) {
+
+    m_metrics.requests.Add( batch.m_requests.size() );
+    m_metrics.responses.Add( batch.m_responses.size() );
 
-    std::string id;
-    time_t result_ts = 0;
-    std::string result_code;
+    if ( batch.m_bucket->IsFastParse() ) {
+        UseStatsShard( m_context->stats.GetQuantizedTime( batch.m_bucket->GetTimestamp() ) );
+        m_stats_shard->GetOverloadCounters().fast_parsed_events += batch.m_requests.size() + batch.m_responses.size();
+    }
 
-    m_stats_item_ts = 0;
-    m_stats_item.reset();
+    for ( const auto & [ id, request ] : batch.m_requests ) {
+        if ( CEventTable::CEvent response; m_partition.early_responses.Extract( id, response ) ) {
+            OnEventRemoved( id, CCheckpoint::EVENT_RESPONSE );
+            CountResponse( request, response );
+        } else if ( m_partition.pending_requests.GetCount() >= m_context->JOIN_STATE_LIMIT ) {
+            // no room to wait, the response will be counted as "undefined"
+            UseStatsShard( m_context->stats.GetQuantizedTime( request.m_timestamp ) );
+            m_stats_shard->GetOverloadCounters().dropped_requests++;
+        } else if ( m_partition.pending_requests.Push( id, request, ( request.m_timestamp + m_context->REQUEST_LIFETIME_SECONDS ) / SECONDS_PER_EVENT_BUCKET ) ) {
+            OnEventAdded( id, request, CCheckpoint::EVENT_REQUEST );
+        }
+    }
 
-    // remove and process every event from the response bucket
-    // request buckets are immutable here, old request buckets are removed fully by a cleanup thread
-    while ( m_bucket->Pop( id, result_code, result_ts ) ) {
-        time_t ts = 0;
-        std::string request;
-        UseStatsItem( CAggregatedStatsCollection::GetQuantizedTime( result_ts ) );
-        auto & result_map = m_stats_item->GetStats();
-        if ( m_context->request_map.GetByID( id, request, ts ) ) {
-            result_map[ request ][ result_code ]++;
+    for ( const auto & [ id, response ] : batch.m_responses ) {
+        if ( CEventTable::CEvent request; m_partition.pending_requests.Extract( id, request ) ) {
+            OnEventRemoved( id, CCheckpoint::EVENT_REQUEST );
+            CountResponse( request, response );
+        } else if ( m_partition.early_responses.GetCount() >= m_context->JOIN_STATE_LIMIT ) {
+            // no room to wait
+            CountResponse( UNDEFINED_REQUEST_ID, response );
+            m_stats_shard->GetOverloadCounters().overflow_responses++;
+            m_metrics.undefined_responses.Add( 1 );
+        } else if ( m_partition.early_responses.Push( id, response, ( response.m_timestamp + m_context->RESPONSE_GRACE_SECONDS ) / SECONDS_PER_EVENT_BUCKET ) ) {
+            OnEventAdded( id, response, CCheckpoint::EVENT_RESPONSE );
         } else {
-            result_map[ "undefined" ][ result_code ]++;
+            // a duplicate response is already waiting
+            CountResponse( UNDEFINED_REQUEST_ID, response );
+            m_metrics.undefined_responses.Add( 1 );
         }
     }
 
-    m_stats_item_lock.reset();
-    m_stats_item.reset();
+}
+
+// expires up to max_count timers: counts responses which have not got their requests in the grace period as "undefined",
+// drops requests which have not got their responses in their lifetime
+void CAggregator::ExpireEvents( const time_t joined_time_limit, const size_t max_count ) {
+    // all events before the limit are joined already, so deadlines before it are reached
+    const time_t now = ( joined_time_limit - 1 ) / SECONDS_PER_EVENT_BUCKET;
+    m_partition.early_responses.Expire( now, max_count, [ this ]( const CTraceKey & id, const CEventTable::CEvent & response ) {
+        OnEventRemoved( id, CCheckpoint::EVENT_RESPONSE );
+        CountResponse( UNDEFINED_REQUEST_ID, response );
+        m_metrics.undefined_responses.Add( 1 );
+    } );
+    if ( m_checkpoint_part ) {
+        m_partition.pending_requests.Expire( now, max_count, [ this ]( const CTraceKey & id, const CEventTable::CEvent & ) {
+            OnEventRemoved( id, CCheckpoint::EVENT_REQUEST );
+        } );
+    } else {
+        m_partition.pending_requests.Expire( now, max_count );
+    }
+}
+
+// hands over stats shards of the intervals ending before the time specified
+void CAggregator::HandOverStatsShards( const time_t joined_time_limit ) {
+    while (
+        !m_stats_shards.empty()
+        &&
+        m_context->stats.GetQuantizedTime( m_stats_shards.begin()->first, +1 ) <= joined_time_limit
+    ) {
+        auto it = m_stats_shards.begin();
+        PIntervalStats interval_stats;
+        m_context->stats.GetItemByKey( it->first, interval_stats );
+        interval_stats->AddShard( std::move( it->second ), m_partition_index );
+        m_stats_shards.erase( it );
+    }
+    m_stats_shard = nullptr;
+}
+
+// hands over stats shards of the intervals which are counted completely, then publishes the time before which all responses are counted
+void CAggregator::PublishJoinedTimeLimit( const time_t joined_time_limit ) {
+    time_t result = joined_time_limit;
+    if ( time_t ts = 0; m_partition.early_responses.GetOldestTimestamp( ts ) ) {
+        result = std::min( result, ts );
+    }
+    HandOverStatsShards( result );
+    m_partition.joined_time_limit = result;
+}
+
+// returns true if the event index shard of an ID is copied for the checkpoint in progress already
+bool CAggregator::IsCopiedForCheckpoint( const CTraceKey & id, const CCheckpoint::EEventKind kind ) const {
+    const size_t shard_index = ( kind == CCheckpoint::EVENT_REQUEST ? 0 : CEventIndex::GetShardCount() ) + CEventIndex::GetShardIndex( id );
+    return shard_index < m_checkpoint_shard_count;
+}
+
+// adds an event stored in a shard copied for the checkpoint in progress
+void CAggregator::OnEventAdded( const CTraceKey & id, const CEventTable::CEvent & event, const CCheckpoint::EEventKind kind ) {
+    if ( m_checkpoint_part && IsCopiedForCheckpoint( id, kind ) ) {
+        m_checkpoint_part->AddEvent( id, event, kind, GetSteadyMicroseconds() );
+    }
+}
+
+// lists an event removed from a shard copied for the checkpoint in progress
+void CAggregator::OnEventRemoved( const CTraceKey & id, const CCheckpoint::EEventKind kind ) {
+    if ( m_checkpoint_part && IsCopiedForCheckpoint( id, kind ) ) {
+        m_checkpoint_part->RemoveEvent( id, kind );
+    }
+}
 
-    m_context->DEBUG_OUTPUT && std::cout << to_stream( m_bucket_ts ) << " end aggregating events" << std::endl;
+// copies the join state for the checkpoint requested last up to the count of event index shards specified, once all
+// shards are copied adds the stats shards of the partition not output yet and submits the part, so the part is the state
+// at that moment while no step stalls the partition for longer than copying a shard
+void CAggregator::CheckpointIfRequested( const size_t max_shard_count ) {
+    if ( const uint64_t epoch = m_context->checkpoint_parts.GetRequestedEpoch(); epoch != m_checkpoint_epoch ) {
+        // a checkpoint still being copied is dropped for a newer one
+        m_checkpoint_part = std::make_unique < CCheckpoint::CPart >();
+        m_checkpoint_shard_count = 0;
+        m_checkpoint_epoch = epoch;
+    }
+    if ( !m_checkpoint_part ) {
+        return;
+    }
+    constexpr size_t shard_count = CEventIndex::GetShardCount();
+    const uint32_t now_us = GetSteadyMicroseconds();
+    for ( size_t i = 0; i < max_shard_count && m_checkpoint_shard_count < 2 * shard_count; i++, m_checkpoint_shard_count++ ) {
+        if ( m_checkpoint_shard_count < shard_count ) {
+            m_checkpoint_part->AddEvents( m_partition.pending_requests, m_checkpoint_shard_count, CCheckpoint::EVENT_REQUEST, now_us );
+        } else {
+            m_checkpoint_part->AddEvents( m_partition.early_responses, m_checkpoint_shard_count - shard_count, CCheckpoint::EVENT_RESPONSE, now_us );
+        }
+    }
+    if ( m_checkpoint_shard_count < 2 * shard_count ) {
+        return;
+    }
+    auto part = std::move( m_checkpoint_part );
+    for ( const auto & [ ts, shard ] : m_stats_shards ) {
+        part->AddInterval( ts, *shard, OTHER_REQUEST_ID );
+    }
+    m_context->stats.ForEachItem( [ & ]( const time_t ts, const PIntervalStats & interval_stats ) {
+        interval_stats->ForEachShard( [ & ]( const unsigned int owner, const CAggregatedStats & shard ) {
+            if ( owner == m_partition_index ) {
+                part->AddInterval( ts, shard, OTHER_REQUEST_ID );
+            }
+        } );
+    } );
+    m_context->checkpoint_parts.Submit( m_partition_index, m_checkpoint_epoch, std::move( part ) );
+}
 
+// publishes the join state size
+void CAggregator::UpdateMetrics() {
+    size_t count = 0;
+    size_t memory_usage = 0;
+    m_partition.pending_requests.GetUsage( count, memory_usage );
+    m_metrics.pending_requests.Set( count );
+    m_metrics.pending_request_bytes.Set( memory_usage );
+    m_metrics.waiting_responses.Set( m_partition.early_responses.GetCount() );
+    m_metrics.expired_requests.Set( m_partition.pending_requests.GetExpiredCount() );
 }
 
-// processes and drops all available response buckets starting from the oldest
-// (request buckets are removed by a cleanup thread)
-void CAggregator::ProcessResponseBuckets() {
-    while ( m_context->response_map.GetOldest( m_bucket, m_bucket_ts ) ) {
-        ProcessResponseBucket();
-        m_context->response_map.RemoveItem( m_bucket );
+void CAggregator::PrintUsage() const {
+    size_t count = 0;
+    size_t memory_usage = 0;
+    m_partition.pending_requests.GetUsage( count, memory_usage );
+    if ( m_context->partitions.size() > 1 ) {
+        std::cout << "Partition " << m_partition_index << ": ";
+    }
+    std::cout << "Pending requests: " << count << ", bytes: " << memory_usage;
+    if ( count > 0 ) {
+        std::cout << ", bytes per request: " << memory_usage / count;
     }
+    std::cout << ", expired requests: " << m_partition.pending_requests.GetExpiredCount();
+    std::cout << ", waiting responses: " << m_partition.early_responses.GetCount();
+    std::cout << ", expired responses: " << m_partition.early_responses.GetExpiredCount() << std::endl;
 }
 
-void CAggregator::Run( const std::stop_token & stoken, const PContext & context ) {
+void CAggregator::Run( const std::stop_token &, const PContext & context, const unsigned int partition_index ) {
+
+    CAggregator aggregator( context, partition_index );
+    auto & event_channel = aggregator.m_partition.event_channel;
+    time_t usage_ts = 0;
+    PEventBatch batch;
+
     while ( true ) {
 
-        // wake up every 100 ms or when new data is signaled
-        context->response_map.WaitForData( 100 );
+        // wake up every 100 ms (to expire events) or when new data is available
+        bool bHasBatch = event_channel.Pop( batch, 100 );
+        const bool bWaited = !bHasBatch;
 
-        if ( stoken.stop_requested() && context->response_map.IsEmpty() ) {
-            // terminate if requested and there are no data left to process
-            break;
+        // parsing threads are stopped before the channel is closed, so no more events can arrive if it is drained
+        const bool bFinal = !bHasBatch && event_channel.IsDrained();
+
+        CBusyTimer busy_timer( aggregator.m_metrics.busy_ns );
+
+        while ( bHasBatch ) {
+            const size_t event_count = batch->m_requests.size() + batch->m_responses.size();
+            aggregator.ProcessBatch( *batch );
+            batch->m_bucket->MarkBatchJoined();
+            batch.reset();
+            context->line_buckets.RemoveJoined();
+            // expiration work is spread between batches, keeping pace with the count of events added
+            aggregator.ExpireEvents( aggregator.GetJoinedTimeLimit(), EXPIRATION_BATCH_SIZE + event_count );
+            // a busy partition may not leave this loop for long, a checkpoint is copied a shard per batch
+            aggregator.CheckpointIfRequested( 1 );
+            bHasBatch = event_channel.TryPop( batch );
+        }
+
+        // line buckets may be joined without batches (dropped by the reader)
+        context->line_buckets.RemoveJoined();
+        // on exit all events are expired and counted unless they are checkpointed for the next run
+        const bool bExpireAll = bFinal && !context->IsKeepingStateOnExit();
+        const time_t joined_time_limit = bExpireAll ? std::numeric_limits < time_t >::max() / 2 : aggregator.GetJoinedTimeLimit();
+        aggregator.ExpireEvents( joined_time_limit, bExpireAll ? std::numeric_limits < size_t >::max() : EXPIRATION_BATCH_SIZE );
+        aggregator.PublishJoinedTimeLimit( joined_time_limit );
+        if ( bFinal && !bExpireAll ) {
+            // incomplete intervals are left in the collection for the final checkpoint
+            aggregator.HandOverStatsShards( std::numeric_limits < time_t >::max() );
         }
+        aggregator.UpdateMetrics();
+        // an idle partition copies the rest at once
+        aggregator.CheckpointIfRequested( bWaited ? std::numeric_limits < size_t >::max() : CHECKPOINT_SHARDS_PER_LOOP );
 
-        //std::this_thread::sleep_for( std::chrono::seconds( 2 ) );
+        if ( context->DEBUG_OUTPUT && ( usage_ts != time( nullptr ) || bFinal ) ) {
+            usage_ts = time( nullptr );
+            aggregator.PrintUsage();
+        }
 
-        CAggregator aggregator( context );
-        aggregator.ProcessResponseBuckets();
+        if ( bFinal ) {
+            break;
+        }
     }
 }
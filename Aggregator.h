@@ -5,26 +5,54 @@
 #include "utils.h"
 
 //
-// Implements aggregation of request/response events received with a set time granularity, drops processed response buckets
+// Implements joining of request/response events and aggregation of responses with a set time granularity.
+// Event batches are taken from the event channel in any order. The join is symmetric: requests are matched against
+// responses waiting for them and responses against pending requests, a matched pair is removed immediately.
+// Responses without a request wait for a grace period before being counted as "undefined".
+// Unmatched events are expired incrementally by timer wheels in small batches between event batches.
+// Several aggregators may run in parallel, each one owns a partition of the trace ID space and counts responses
+// into private per-interval stats shards without locking. A shard is handed over to the stats collection once its
+// interval is joined completely in the partition, shards of all partitions are merged on output.
+// When a checkpoint is requested, the partition state is copied between event batches one event index shard at a time
+// (changes of the shards copied already are recorded as they happen), the checkpoint thread writes it.
 //
 class CAggregator {
 
     protected:
 
-        PEventBucket m_bucket;
-        time_t m_bucket_ts = 0;
-        std::unique_ptr < std::lock_guard < std::mutex > > m_stats_item_lock;
-        PAggregatedStats m_stats_item;
-        time_t m_stats_item_ts = 0;
+        // stats shards of intervals not handed over yet, keyed by interval start time
+        std::map < time_t, PAggregatedStats > m_stats_shards;
+        CAggregatedStats * m_stats_shard = nullptr;
+        time_t m_stats_shard_ts = 0;
         PContext m_context;
-
-        void UseStatsItem( const time_t ts );
-        void ProcessResponseBucket();
-        void ProcessResponseBuckets();
-
-        explicit CAggregator( PContext context );
+        CThreadMetrics & m_metrics;
+        CAggregationPartition & m_partition;
+        unsigned int m_partition_index = 0;
+        // epoch of the last checkpoint the partition state was copied for
+        uint64_t m_checkpoint_epoch = 0;
+        // part of the checkpoint being copied and the count of event index shards copied (pending requests first)
+        CCheckpoint::PPart m_checkpoint_part;
+        size_t m_checkpoint_shard_count = 0;
+
+        time_t GetJoinedTimeLimit() const;
+        void UseStatsShard( const time_t ts );
+        void CountResponse( const CDictionary::t_id request_path, const CEventTable::CEvent & response );
+        void CountResponse( const CEventTable::CEvent & request, const CEventTable::CEvent & response );
+        void ProcessBatch( const CEventBatch & batch );
+        void ExpireEvents( const time_t joined_time_limit, const size_t max_count );
+        void HandOverStatsShards( const time_t joined_time_limit );
+        void PublishJoinedTimeLimit( const time_t joined_time_limit );
+        bool IsCopiedForCheckpoint( const CTraceKey & id, const CCheckpoint::EEventKind kind ) const;
+        void OnEventAdded( const CTraceKey & id, const CEventTable::CEvent & event, const CCheckpoint::EEventKind kind );
+        void OnEventRemoved( const CTraceKey & id, const CCheckpoint::EEventKind kind );
+        void CheckpointIfRequested( const size_t max_shard_count );
+        void UpdateMetrics();
+        void PrintUsage() const;
+
+        CAggregator( PContext context, const unsigned int partition_index );
 
     public:
 
-        static void Run( const std::stop_token & stoken, const PContext & context ) ;
+        // runs until the event channel of the partition is closed and drained
+        static void Run( const std::stop_token & stoken, const PContext & context, const unsigned int partition_index );
 };
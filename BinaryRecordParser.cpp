@@ -0,0 +1,69 @@
+#include "common.h"
+
+#include "BinaryRecordParser.h"
+
+const char * CBinaryRecordParser::GetFormatName() {
+    return "binary";
+}
+
+// returns the size of the record which size prefix is at the pointer specified (the prefix excluded)
+size_t CBinaryRecordParser::GetRecordSize( const char * p ) {
+    const auto * bytes = reinterpret_cast < const uint8_t * >( p );
+    return bytes[ 0 ] | ( size_t( bytes[ 1 ] ) << 8 );
+}
+
+size_t CBinaryRecordParser::FindEventsEnd( const char * data, const size_t event_start, size_t & frame_pos, const size_t size ) {
+    // records framed previously end at frame_pos, the ones submitted end at event_start
+    size_t pos = std::max( event_start, frame_pos );
+    while ( pos + SIZE_PREFIX_SIZE <= size && pos + SIZE_PREFIX_SIZE + GetRecordSize( data + pos ) <= size ) {
+        pos += SIZE_PREFIX_SIZE + GetRecordSize( data + pos );
+    }
+    frame_pos = pos;
+    return pos;
+}
+
+void CBinaryRecordParser::Write( std::string & out, const EKind kind, const std::string_view trace_id, const std::string_view value ) {
+    const size_t trace_id_size = std::min < size_t >( trace_id.size(), std::numeric_limits < uint8_t >::max() );
+    const size_t value_size = std::min < size_t >( value.size(), std::numeric_limits < uint16_t >::max() - RECORD_HEADER_SIZE - trace_id_size );
+    const size_t record_size = RECORD_HEADER_SIZE + trace_id_size + value_size;
+    out += static_cast < char >( record_size & 0xff );
+    out += static_cast < char >( record_size >> 8 );
+    out += static_cast < char >( kind );
+    out += static_cast < char >( trace_id_size );
+    out.append( trace_id.data(), trace_id_size );
+    out.append( value.data(), value_size );
+}
+
+const CBinaryRecordParser::t_events & CBinaryRecordParser::Parse( const std::string_view data, const bool /* bFastParse */ ) {
+
+    m_events.clear();
+    const char * p = data.data();
+    const char * const end = p + data.size();
+
+    while ( end - p >= static_cast < ptrdiff_t >( SIZE_PREFIX_SIZE ) ) {
+        const char * record = p + SIZE_PREFIX_SIZE;
+        // a record truncated by the end of input is cut short
+        const char * record_end = std::min( record + GetRecordSize( p ), end );
+        p = record_end;
+
+        // a malformed record is an event without a trace ID or a value
+        CEvent & event = m_events.emplace_back();
+#ifdef _DEBUG
+        event.message = std::string_view( record, record_end );
+#endif // _DEBUG
+        if ( record_end - record < static_cast < ptrdiff_t >( RECORD_HEADER_SIZE ) ) {
+            continue;
+        }
+        const auto kind = static_cast < uint8_t >( record[ 0 ] );
+        const auto trace_id_size = static_cast < uint8_t >( record[ 1 ] );
+        const char * trace_id = record + RECORD_HEADER_SIZE;
+        if ( kind > KIND_RESPONSE || record_end - trace_id < trace_id_size ) {
+            continue;
+        }
+        event.bIsResponse = kind == KIND_RESPONSE;
+        event.trace_id = std::string_view( trace_id, trace_id_size );
+        event.value = std::string_view( trace_id + trace_id_size, record_end );
+    }
+
+    return m_events;
+}
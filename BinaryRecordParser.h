@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+#include "MessageParser.h"
+
+//
+// Implements parsing of events received as length-prefixed binary records:
+//   uint16 record size (little endian, the size prefix excluded), uint8 kind (0 for a request, 1 for a response),
+//   uint8 trace ID size, trace ID bytes, request path or result code bytes (the rest of the record).
+// Records need no scanning: framing and parsing jump from one size prefix to the next, a record is never
+// larger than 64 KiB, so corrupted sizes cannot hold back input for long. Parsed events refer to the buffer parsed.
+//
+class CBinaryRecordParser {
+
+    public:
+
+        typedef CMessageParser::CEvent CEvent;
+        typedef CMessageParser::t_events t_events;
+
+        static constexpr size_t SIZE_PREFIX_SIZE = 2;
+        // kind and trace ID size
+        static constexpr size_t RECORD_HEADER_SIZE = 2;
+
+        enum EKind : uint8_t {
+            KIND_REQUEST = 0,
+            KIND_RESPONSE = 1
+        };
+
+    protected:
+
+        // events parsed from the last buffer (storage is reused between calls)
+        t_events m_events;
+
+        static size_t GetRecordSize( const char * p );
+
+    public:
+
+        // parses all records in the buffer, returned events are valid until the next call (there is no fast mode)
+        const t_events & Parse( const std::string_view data, const bool bFastParse = false );
+
+        // returns the offset past the last complete record in data[ event_start, size ),
+        // frame_pos is the offset of the first record not framed yet (updated)
+        static size_t FindEventsEnd( const char * data, const size_t event_start, size_t & frame_pos, const size_t size );
+
+        // appends a record to the string specified
+        static void Write( std::string & out, const EKind kind, const std::string_view trace_id, const std::string_view value );
+
+        static const char * GetFormatName();
+};
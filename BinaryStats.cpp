@@ -0,0 +1,457 @@
+#include "common.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "BinaryStats.h"
+
+// headers and footers are copied as they are
+static_assert( std::endian::native == std::endian::little );
+static_assert( sizeof( CBinaryStats::CRecordHeader ) == 64 );
+static_assert( sizeof( CBinaryStats::CRecordFooter ) == 40 );
+
+namespace {
+
+    void AppendVarint( std::string & s, uint64_t value ) {
+        while ( value >= 0x80 ) {
+            s += static_cast < char >( value | 0x80 );
+            value >>= 7;
+        }
+        s += static_cast < char >( value );
+    }
+
+    // reads a varint at the position specified moving it, returns false if the data ends before the varint does
+    bool ReadVarint( const std::string_view data, size_t & pos, uint64_t & value ) {
+        value = 0;
+        for ( unsigned int shift = 0; pos < data.size() && shift < 64; shift += 7 ) {
+            const auto byte = static_cast < uint8_t >( data[ pos++ ] );
+            value |= static_cast < uint64_t >( byte & 0x7f ) << shift;
+            if ( !( byte & 0x80 ) ) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool ReadString( const std::string_view data, size_t & pos, const size_t size, std::string_view & value ) {
+        if ( size > data.size() - pos ) {
+            return false;
+        }
+        value = data.substr( pos, size );
+        pos += size;
+        return true;
+    }
+
+    void WriteMilliseconds( std::ostream & out, const int64_t value_us ) {
+        out << value_us / 1000 << '.' << std::setw( 3 ) << std::setfill( '0' ) << value_us % 1000;
+    }
+
+}
+
+void CBinaryStats::Encode( const CInterval & interval, std::string & record ) {
+    CRecordHeader header {};
+    memcpy( header.magic, RECORD_MAGIC, sizeof( header.magic ) );
+    header.start_ts = interval.start_ts;
+    header.end_ts = interval.end_ts;
+    header.path_count = static_cast < uint32_t >( interval.paths.size() );
+    header.code_count = static_cast < uint32_t >( interval.codes.size() );
+    header.row_count = static_cast < uint32_t >( interval.rows.size() );
+    header.flags = interval.flags;
+    header.total_count = interval.total_count;
+    header.sample_count = interval.sample_count;
+    header.total_variance = interval.total_variance;
+
+    CRecordFooter footer {};
+    memcpy( footer.magic, FOOTER_MAGIC, sizeof( footer.magic ) );
+
+    record.clear();
+    record.append( reinterpret_cast < const char * >( &header ), sizeof( header ) );
+
+    for ( unsigned int section = 0; section < SECTION_COUNT; section++ ) {
+        footer.section_offsets[ section ] = static_cast < uint32_t >( record.size() );
+        switch ( section ) {
+            case SECTION_PATHS: {
+                std::string_view previous;
+                for ( const auto & path : interval.paths ) {
+                    const size_t shared = std::ranges::mismatch( previous, path ).in2 - path.begin();
+                    AppendVarint( record, shared );
+                    AppendVarint( record, path.size() - shared );
+                    record += path.substr( shared );
+                    previous = path;
+                }
+                break;
+            }
+            case SECTION_CODES:
+                for ( const auto & code : interval.codes ) {
+                    AppendVarint( record, code.size() );
+                    record += code;
+                }
+                break;
+            case SECTION_ROW_PATHS: {
+                uint32_t previous = 0;
+                for ( const auto & row : interval.rows ) {
+                    AppendVarint( record, row.path - previous );
+                    previous = row.path;
+                }
+                break;
+            }
+            case SECTION_ROW_CODES:
+                for ( const auto & row : interval.rows ) {
+                    AppendVarint( record, row.code );
+                }
+                break;
+            case SECTION_COUNTS:
+                for ( const auto & row : interval.rows ) {
+                    AppendVarint( record, row.count );
+                }
+                break;
+            case SECTION_VARIANCES:
+                if ( interval.flags & FLAG_SAMPLED ) {
+                    for ( const auto & row : interval.rows ) {
+                        AppendVarint( record, row.variance );
+                    }
+                }
+                break;
+            case SECTION_LATENCIES:
+                if ( interval.flags & FLAG_LATENCIES ) {
+                    for ( unsigned int column = 0; column < LATENCY_COLUMN_COUNT; column++ ) {
+                        for ( const auto & row : interval.rows ) {
+                            AppendVarint( record, static_cast < uint64_t >( row.latencies[ column ] + 1 ) );
+                        }
+                    }
+                }
+                break;
+        }
+    }
+    footer.section_offsets[ SECTION_COUNT ] = static_cast < uint32_t >( record.size() );
+    footer.record_size = static_cast < uint32_t >( record.size() + sizeof( footer ) );
+    record.append( reinterpret_cast < const char * >( &footer ), sizeof( footer ) );
+    // the size is known once all sections are encoded
+    memcpy( record.data() + offsetof( CRecordHeader, record_size ), &footer.record_size, sizeof( footer.record_size ) );
+}
+
+size_t CBinaryStats::Decode( const std::string_view file, const size_t offset, CInterval & interval ) {
+    CRecordHeader header;
+    CRecordFooter footer;
+    if ( file.size() - offset < sizeof( header ) + sizeof( footer ) ) {
+        return 0;
+    }
+    memcpy( &header, file.data() + offset, sizeof( header ) );
+    if (
+        memcmp( header.magic, RECORD_MAGIC, sizeof( header.magic ) ) != 0
+        ||
+        header.record_size < sizeof( header ) + sizeof( footer )
+        ||
+        header.record_size > file.size() - offset
+    ) {
+        return 0;
+    }
+    const std::string_view record = file.substr( offset, header.record_size );
+    memcpy( &footer, record.data() + record.size() - sizeof( footer ), sizeof( footer ) );
+    if ( memcmp( footer.magic, FOOTER_MAGIC, sizeof( footer.magic ) ) != 0 || footer.record_size != header.record_size ) {
+        return 0;
+    }
+    if ( footer.section_offsets[ SECTION_COUNT ] > record.size() - sizeof( footer ) ) {
+        return 0;
+    }
+    for ( unsigned int section = 0; section < SECTION_COUNT; section++ ) {
+        if ( footer.section_offsets[ section ] < sizeof( header ) || footer.section_offsets[ section ] > footer.section_offsets[ section + 1 ] ) {
+            return 0;
+        }
+    }
+    const auto get_section = [ & ]( const ESection section ) {
+        return record.substr( footer.section_offsets[ section ], footer.section_offsets[ section + 1 ] - footer.section_offsets[ section ] );
+    };
+    // every path, code and row takes a byte of its section at least, so damaged counts are rejected before allocating
+    if (
+        header.path_count > get_section( SECTION_PATHS ).size()
+        ||
+        header.code_count > get_section( SECTION_CODES ).size()
+        ||
+        header.row_count > get_section( SECTION_ROW_PATHS ).size()
+    ) {
+        return 0;
+    }
+
+    interval.start_ts = header.start_ts;
+    interval.end_ts = header.end_ts;
+    interval.flags = header.flags;
+    interval.total_count = header.total_count;
+    interval.sample_count = header.sample_count;
+    interval.total_variance = header.total_variance;
+    interval.paths.clear();
+    interval.codes.clear();
+    interval.path_storage.clear();
+    interval.rows.assign( header.row_count, CRow() );
+
+    uint64_t value = 0;
+    uint64_t size = 0;
+    size_t pos = 0;
+
+    // paths are front coded, each one is restored from the previous one
+    const auto paths = get_section( SECTION_PATHS );
+    for ( uint32_t i = 0; i < header.path_count; i++ ) {
+        std::string_view suffix;
+        if ( !ReadVarint( paths, pos, value ) || !ReadVarint( paths, pos, size ) || !ReadString( paths, pos, size, suffix ) ) {
+            return 0;
+        }
+        const std::string_view previous = interval.paths.empty() ? std::string_view() : interval.paths.back();
+        if ( value > previous.size() ) {
+            return 0;
+        }
+        if ( value == 0 ) {
+            // no need to copy
+            interval.paths.push_back( suffix );
+        } else {
+            auto & path = interval.path_storage.emplace_back( previous.substr( 0, value ) );
+            path += suffix;
+            interval.paths.push_back( path );
+        }
+    }
+
+    const auto codes = get_section( SECTION_CODES );
+    pos = 0;
+    for ( uint32_t i = 0; i < header.code_count; i++ ) {
+        std::string_view code;
+        if ( !ReadVarint( codes, pos, size ) || !ReadString( codes, pos, size, code ) ) {
+            return 0;
+        }
+        interval.codes.push_back( code );
+    }
+
+    // reads a varint column into the row field specified, returns false if the column is short or refers to no string
+    const auto read_column = [ & ]( const std::string_view column, size_t & column_pos, const auto & store ) {
+        for ( auto & row : interval.rows ) {
+            if ( !ReadVarint( column, column_pos, value ) || !store( row, value ) ) {
+                return false;
+            }
+        }
+        return true;
+    };
+    uint64_t path = 0;
+    size_t row_paths_pos = 0, row_codes_pos = 0, counts_pos = 0, variances_pos = 0, latencies_pos = 0;
+    if (
+        !read_column( get_section( SECTION_ROW_PATHS ), row_paths_pos, [ & ]( CRow & row, const uint64_t delta ) {
+            path += delta;
+            row.path = static_cast < uint32_t >( path );
+            return path < header.path_count;
+        } )
+        ||
+        !read_column( get_section( SECTION_ROW_CODES ), row_codes_pos, [ & ]( CRow & row, const uint64_t code ) {
+            row.code = static_cast < uint32_t >( code );
+            return code < header.code_count;
+        } )
+        ||
+        !read_column( get_section( SECTION_COUNTS ), counts_pos, []( CRow & row, const uint64_t count ) {
+            row.count = count;
+            return true;
+        } )
+    ) {
+        return 0;
+    }
+    if ( header.flags & FLAG_SAMPLED ) {
+        if ( !read_column( get_section( SECTION_VARIANCES ), variances_pos, []( CRow & row, const uint64_t variance ) {
+            row.variance = variance;
+            return true;
+        } ) ) {
+            return 0;
+        }
+    }
+    if ( header.flags & FLAG_LATENCIES ) {
+        const auto latencies = get_section( SECTION_LATENCIES );
+        for ( unsigned int column = 0; column < LATENCY_COLUMN_COUNT; column++ ) {
+            if ( !read_column( latencies, latencies_pos, [ & ]( CRow & row, const uint64_t latency ) {
+                row.latencies[ column ] = static_cast < int64_t >( latency ) - 1;
+                return true;
+            } ) ) {
+                return 0;
+            }
+        }
+    }
+    return header.record_size;
+}
+
+void CBinaryStats::WriteCsv( std::ostream & out, const CInterval & interval ) {
+    const char * csv_separator = ";";
+    const auto start_ts = static_cast < time_t >( interval.start_ts );
+    const auto end_ts = static_cast < time_t >( interval.end_ts );
+    out << "[ " << std::put_time( std::localtime( &start_ts ), "%F %T %Z" ) << " .. ";
+    out << std::put_time( std::localtime( &end_ts ), "%F %T %Z" ) << " )" << std::endl;
+
+    out << "request";
+    for ( const auto & code : interval.codes ) {
+        out << csv_separator << code;
+    }
+    constexpr const char * latency_suffixes[] = { " p50", " p90", " p99", " max" };
+    const bool bLatencies = interval.flags & FLAG_LATENCIES;
+    if ( bLatencies ) {
+        for ( const auto & code : interval.codes ) {
+            for ( const auto suffix : latency_suffixes ) {
+                out << csv_separator << code << suffix;
+            }
+        }
+    }
+
+    // calls handler( row or nullptr ) for every code column of the rows of the path starting at begin, returns the end of the rows
+    const auto for_each_column = [ & ]( size_t begin, const auto & handler ) {
+        const uint32_t path = interval.rows[ begin ].path;
+        for ( uint32_t code = 0; code < interval.codes.size(); code++ ) {
+            const bool bHasRow = begin < interval.rows.size() && interval.rows[ begin ].path == path && interval.rows[ begin ].code == code;
+            handler( bHasRow ? &interval.rows[ begin ] : nullptr );
+            begin += bHasRow;
+        }
+        return begin;
+    };
+
+    for ( size_t i = 0; i < interval.rows.size(); ) {
+        out << '\n' << interval.paths[ interval.rows[ i ].path ];
+        const size_t next = for_each_column( i, [ & ]( const CRow * row ) {
+            out << csv_separator << ( row ? row->count : 0 );
+        } );
+        if ( bLatencies ) {
+            for_each_column( i, [ & ]( const CRow * row ) {
+                for ( unsigned int column = 0; column < LATENCY_COLUMN_COUNT; column++ ) {
+                    out << csv_separator;
+                    if ( row && row->latencies[ column ] >= 0 ) {
+                        WriteMilliseconds( out, row->latencies[ column ] );
+                    }
+                }
+            } );
+        }
+        i = next;
+    }
+
+    // the same confidence intervals as the processor reports
+    if ( interval.flags & FLAG_SAMPLED ) {
+        const auto half_width = []( const uint64_t variance ) {
+            return std::llround( 1.96 * std::sqrt( static_cast < double >( variance ) ) );
+        };
+        const double rate = interval.total_count ? static_cast < double >( interval.sample_count ) / interval.total_count : 1.0;
+        out << "\n# sample rate: " << std::to_string( rate );
+        out << "; 95% confidence interval of the total: " << interval.total_count << " +- " << half_width( interval.total_variance );
+        out << "\n# 95% confidence interval half-widths:";
+        out << "\n# request";
+        for ( const auto & code : interval.codes ) {
+            out << csv_separator << code;
+        }
+        for ( size_t i = 0; i < interval.rows.size(); ) {
+            out << "\n# " << interval.paths[ interval.rows[ i ].path ];
+            i = for_each_column( i, [ & ]( const CRow * row ) {
+                out << csv_separator << ( row ? half_width( row->variance ) : 0 );
+            } );
+        }
+    }
+}
+
+CBinaryStatsWriter::CBinaryStatsWriter( std::string filename, const size_t roll_size, const std::string_view file_magic )
+    : m_filename( std::move( filename ) )
+    , m_roll_size( roll_size )
+    , m_file_magic( file_magic )
+{
+}
+
+CBinaryStatsWriter::~CBinaryStatsWriter() {
+    if ( m_fd >= 0 ) {
+        close( m_fd );
+    }
+}
+
+// opens the file for appending, starts it with the file header if it is new, refuses to append to a file of another format
+bool CBinaryStatsWriter::Open() {
+    m_fd = open( m_filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+    if ( m_fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    bool bResult = fstat( m_fd, &st ) == 0;
+    if ( bResult ) {
+        m_file_size = st.st_size;
+        if ( m_file_size == 0 ) {
+            bResult = WriteAll( m_file_magic );
+        } else {
+            std::string magic( m_file_magic.size(), '\0' );
+            bResult = pread( m_fd, magic.data(), magic.size(), 0 ) == static_cast < ssize_t >( magic.size() ) && magic == m_file_magic;
+        }
+    }
+    if ( !bResult ) {
+        close( m_fd );
+        m_fd = -1;
+    }
+    return bResult;
+}
+
+bool CBinaryStatsWriter::WriteAll( const std::string_view data ) {
+    for ( size_t written = 0; written < data.size(); ) {
+        const ssize_t result = write( m_fd, data.data() + written, data.size() - written );
+        if ( result < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+        m_file_size += result;
+    }
+    return true;
+}
+
+bool CBinaryStatsWriter::Append( const CBinaryStats::CInterval & interval ) {
+    CBinaryStats::Encode( interval, m_record );
+    return AppendRecord( m_record, interval.end_ts );
+}
+
+bool CBinaryStatsWriter::AppendRecord( const std::string_view record, const int64_t end_ts ) {
+    if ( m_fd < 0 && !Open() ) {
+        return false;
+    }
+    const size_t record_start = m_file_size;
+    if ( !WriteAll( record ) ) {
+        // a partly written record would hide the records appended after it from readers
+        if ( ftruncate( m_fd, record_start ) == 0 ) {
+            m_file_size = record_start;
+        }
+        return false;
+    }
+    if ( m_file_size >= m_roll_size ) {
+        // readers of the old file keep their mappings, new readers see the rolled name
+        close( m_fd );
+        m_fd = -1;
+        // a file rolled at the same end time is not replaced
+        std::string rolled_filename = m_filename + "." + std::to_string( end_ts );
+        for ( unsigned int sequence = 1; access( rolled_filename.c_str(), F_OK ) == 0; sequence++ ) {
+            rolled_filename = m_filename + "." + std::to_string( end_ts ) + "." + std::to_string( sequence );
+        }
+        return rename( m_filename.c_str(), rolled_filename.c_str() ) == 0;
+    }
+    return true;
+}
+
+CBinaryStatsFile::~CBinaryStatsFile() {
+    if ( m_data ) {
+        munmap( const_cast < char * >( m_data ), m_size );
+    }
+}
+
+bool CBinaryStatsFile::Open( const std::string & filename ) {
+    const int fd = open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return false;
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || static_cast < size_t >( st.st_size ) < sizeof( CBinaryStats::FILE_MAGIC ) ) {
+        close( fd );
+        return false;
+    }
+    void * data = mmap( nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+    if ( data == MAP_FAILED ) {
+        return false;
+    }
+    m_data = static_cast < const char * >( data );
+    m_size = st.st_size;
+    return memcmp( m_data, CBinaryStats::FILE_MAGIC, sizeof( CBinaryStats::FILE_MAGIC ) ) == 0;
+}
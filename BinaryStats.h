@@ -0,0 +1,187 @@
+#pragma once
+
+#include "common.h"
+
+//
+// Columnar binary format of interval stats appended to a rolling file, one record per output interval.
+// A file starts with the file header and continues with records laid out as follows:
+//
+//   record header (fixed size): magic, record size, interval start and end (unix time), counts of paths, codes and rows, flags
+//   sections (columns) in the order of ESection:
+//     SECTION_PATHS      sorted request paths front coded: varint shared prefix length, varint suffix length, suffix bytes
+//     SECTION_CODES      sorted result codes: varint length, bytes
+//     SECTION_ROW_PATHS  path index of every row as a varint delta from the previous row (rows are sorted by path)
+//     SECTION_ROW_CODES  code index of every row as a varint
+//     SECTION_COUNTS     count of every row as a varint
+//     SECTION_VARIANCES  variance of every row count as a varint (sampled counts only)
+//     SECTION_LATENCIES  p50, p90, p99 and max latency columns one after another, microseconds + 1 as varints (0 if none)
+//   footer index: offsets of the sections from the record start and the end offset, record size, footer magic
+//
+// Integers of headers and footers are little-endian. A record is appended by one write, readers map the file and skip
+// an incomplete record at its end, the footer lets them scan from the end of the file back (the newest intervals first).
+//
+class CBinaryStats {
+
+    public:
+
+        static constexpr char FILE_MAGIC[ 8 ] = { 'P', 'S', 'T', 'A', 'T', 'S', '0', '1' };
+        static constexpr char RECORD_MAGIC[ 4 ] = { 'I', 'V', 'A', 'L' };
+        static constexpr char FOOTER_MAGIC[ 4 ] = { 'L', 'A', 'V', 'I' };
+
+        enum ESection {
+            SECTION_PATHS,
+            SECTION_CODES,
+            SECTION_ROW_PATHS,
+            SECTION_ROW_CODES,
+            SECTION_COUNTS,
+            SECTION_VARIANCES,
+            SECTION_LATENCIES,
+            SECTION_COUNT
+        };
+
+        enum EFlags : uint32_t {
+            // counts are estimated from a sample, variances are stored
+            FLAG_SAMPLED = 1,
+            // latency columns are stored
+            FLAG_LATENCIES = 2,
+        };
+
+        // count of latency columns (p50, p90, p99, max) and their fractions of values (max is 1)
+        static constexpr unsigned int LATENCY_COLUMN_COUNT = 4;
+        static constexpr double LATENCY_FRACTIONS[ LATENCY_COLUMN_COUNT ] = { 0.5, 0.9, 0.99, 1 };
+
+        class CRecordHeader {
+            public:
+                char magic[ 4 ];
+                uint32_t record_size;
+                int64_t start_ts;
+                int64_t end_ts;
+                uint32_t path_count;
+                uint32_t code_count;
+                uint32_t row_count;
+                uint32_t flags;
+                // totals of the interval (the sample count equals the total count without sampling)
+                uint64_t total_count;
+                uint64_t sample_count;
+                uint64_t total_variance;
+        };
+
+        class CRecordFooter {
+            public:
+                uint32_t section_offsets[ SECTION_COUNT + 1 ];
+                uint32_t record_size;
+                char magic[ 4 ];
+        };
+
+        // one row of an interval: a cell of the path and the code specified by their indexes
+        class CRow {
+            public:
+                uint32_t path = 0;
+                uint32_t code = 0;
+                uint64_t count = 0;
+                uint64_t variance = 0;
+                // microseconds, -1 if there are none
+                std::array < int64_t, LATENCY_COLUMN_COUNT > latencies { -1, -1, -1, -1 };
+        };
+
+        // stats of one interval, strings are views into the caller's (writer) or the mapped file (reader) memory
+        class CInterval {
+            public:
+                int64_t start_ts = 0;
+                int64_t end_ts = 0;
+                uint32_t flags = 0;
+                uint64_t total_count = 0;
+                uint64_t sample_count = 0;
+                uint64_t total_variance = 0;
+                // sorted unique strings
+                std::vector < std::string_view > paths;
+                std::vector < std::string_view > codes;
+                // rows sorted by path and code indexes
+                std::vector < CRow > rows;
+                // front coded paths are decoded into this storage
+                std::deque < std::string > path_storage;
+        };
+
+        // encodes an interval as a record
+        static void Encode( const CInterval & interval, std::string & record );
+
+        // decodes the record at the offset specified, returns its size or 0 if the record is incomplete or damaged
+        static size_t Decode( const std::string_view file, const size_t offset, CInterval & interval );
+
+        // writes an interval in the CSV output format of the processor (without the final line break)
+        static void WriteCsv( std::ostream & out, const CInterval & interval );
+};
+
+//
+// Appends interval records to a binary stats file, rolls the file over to <file>.<last interval end time>
+// (followed by .<sequence number> if that file exists) once it grows over the size specified. A record failed to be
+// written is truncated away. Files of other record formats are written by appending encoded records
+// to a writer created with their file magic.
+//
+class CBinaryStatsWriter {
+
+    protected:
+
+        std::string m_filename;
+        size_t m_roll_size = 0;
+        std::string_view m_file_magic;
+        int m_fd = -1;
+        size_t m_file_size = 0;
+        std::string m_record;
+
+        bool Open();
+        bool WriteAll( const std::string_view data );
+
+    public:
+
+        CBinaryStatsWriter(
+            std::string filename,
+            const size_t roll_size,
+            const std::string_view file_magic = std::string_view( CBinaryStats::FILE_MAGIC, sizeof( CBinaryStats::FILE_MAGIC ) )
+        );
+        CBinaryStatsWriter( const CBinaryStatsWriter & ) = delete;
+        CBinaryStatsWriter & operator=( const CBinaryStatsWriter & ) = delete;
+        ~CBinaryStatsWriter();
+
+        // appends a record of the interval, returns false on write errors
+        bool Append( const CBinaryStats::CInterval & interval );
+
+        // appends an encoded record of the interval ending at the time specified, returns false on write errors
+        bool AppendRecord( const std::string_view record, const int64_t end_ts );
+};
+
+//
+// Read-only memory map of a binary stats file
+//
+class CBinaryStatsFile {
+
+    protected:
+
+        const char * m_data = nullptr;
+        size_t m_size = 0;
+
+    public:
+
+        CBinaryStatsFile() = default;
+        CBinaryStatsFile( const CBinaryStatsFile & ) = delete;
+        CBinaryStatsFile & operator=( const CBinaryStatsFile & ) = delete;
+        ~CBinaryStatsFile();
+
+        // maps the file, returns false if it cannot be read or is not a binary stats file
+        bool Open( const std::string & filename );
+
+        // calls handler( interval ) for every complete record in the file order
+        template < typename F > void ForEachInterval( F handler ) const {
+            const std::string_view file( m_data, m_size );
+            CBinaryStats::CInterval interval;
+            for ( size_t offset = sizeof( CBinaryStats::FILE_MAGIC ); offset < m_size; ) {
+                const size_t record_size = CBinaryStats::Decode( file, offset, interval );
+                if ( record_size == 0 ) {
+                    // a record being appended or a damaged tail
+                    break;
+                }
+                handler( static_cast < const CBinaryStats::CInterval & >( interval ) );
+                offset += record_size;
+            }
+        }
+};
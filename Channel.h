@@ -0,0 +1,166 @@
+#pragma once
+
+#include "common.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <ctime>
+
+//
+// Bounded lock-free ring buffer channel passing items between pipeline stages (D. Vyukov's bounded MPMC queue).
+// Used as single-producer/multi-consumer (reader -> parsers) and multi-producer/single-consumer (parsers -> aggregator).
+// Blocked producers and consumers sleep on futexes, wake-ups are issued only if somebody sleeps.
+//
+template < typename T > class CChannel {
+
+    protected:
+
+        // a cache line sized counter to sleep on
+        class alignas( 64 ) CWaitCounter {
+            public:
+                std::atomic < uint32_t > m_value = 0;
+                std::atomic < uint32_t > m_waiter_count = 0;
+
+                // sleeps until the counter is changed from the value specified or until the timeout (negative for none) is elapsed
+                void Wait( const uint32_t value, const int timeout_ms ) {
+                    m_waiter_count++;
+                    if ( m_value.load() == value ) {
+                        timespec timeout { timeout_ms / 1000, ( timeout_ms % 1000 ) * 1000000L };
+                        syscall( SYS_futex, &m_value, FUTEX_WAIT_PRIVATE, value, timeout_ms < 0 ? nullptr : &timeout, nullptr, 0 );
+                    }
+                    m_waiter_count--;
+                }
+
+                // changes the counter and wakes up all sleepers
+                void Notify() {
+                    m_value++;
+                    if ( m_waiter_count.load() > 0 ) {
+                        syscall( SYS_futex, &m_value, FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0 );
+                    }
+                }
+        };
+
+        class CCell {
+            public:
+                std::atomic < size_t > m_sequence = 0;
+                T m_item;
+        };
+
+        std::unique_ptr < CCell[] > m_cells;
+        const size_t m_mask;
+        alignas( 64 ) std::atomic < size_t > m_push_pos = 0;
+        alignas( 64 ) std::atomic < size_t > m_pop_pos = 0;
+        CWaitCounter m_pushed;
+        CWaitCounter m_popped;
+        std::atomic < bool > m_bClosed = false;
+
+    public:
+
+        // creates a channel with the capacity rounded up to a power of 2
+        explicit CChannel( const size_t capacity )
+            : m_cells( std::make_unique < CCell[] >( std::bit_ceil( std::max < size_t >( capacity, 2 ) ) ) )
+            , m_mask( std::bit_ceil( std::max < size_t >( capacity, 2 ) ) - 1 )
+        {
+            for ( size_t i = 0; i <= m_mask; i++ ) {
+                m_cells[ i ].m_sequence.store( i, std::memory_order_relaxed );
+            }
+        }
+
+        // adds an item if there is free space, returns false otherwise
+        bool TryPush( T & item ) {
+            size_t pos = m_push_pos.load( std::memory_order_relaxed );
+            while ( true ) {
+                CCell & cell = m_cells[ pos & m_mask ];
+                const size_t sequence = cell.m_sequence.load( std::memory_order_acquire );
+                const intptr_t diff = static_cast < intptr_t >( sequence ) - static_cast < intptr_t >( pos );
+                if ( diff == 0 ) {
+                    if ( m_push_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                        cell.m_item = std::move( item );
+                        cell.m_sequence.store( pos + 1, std::memory_order_release );
+                        m_pushed.Notify();
+                        return true;
+                    }
+                } else if ( diff < 0 ) {
+                    // full
+                    return false;
+                } else {
+                    pos = m_push_pos.load( std::memory_order_relaxed );
+                }
+            }
+        }
+
+        // removes an item if there is one, returns false otherwise
+        bool TryPop( T & item ) {
+            size_t pos = m_pop_pos.load( std::memory_order_relaxed );
+            while ( true ) {
+                CCell & cell = m_cells[ pos & m_mask ];
+                const size_t sequence = cell.m_sequence.load( std::memory_order_acquire );
+                const intptr_t diff = static_cast < intptr_t >( sequence ) - static_cast < intptr_t >( pos + 1 );
+                if ( diff == 0 ) {
+                    if ( m_pop_pos.compare_exchange_weak( pos, pos + 1, std::memory_order_relaxed ) ) {
+                        item = std::move( cell.m_item );
+                        cell.m_item = T();
+                        cell.m_sequence.store( pos + m_mask + 1, std::memory_order_release );
+                        m_popped.Notify();
+                        return true;
+                    }
+                } else if ( diff < 0 ) {
+                    // empty
+                    return false;
+                } else {
+                    pos = m_pop_pos.load( std::memory_order_relaxed );
+                }
+            }
+        }
+
+        // adds an item waiting for free space as needed, returns false if the channel is closed
+        bool Push( T & item ) {
+            while ( !m_bClosed ) {
+                const uint32_t popped = m_popped.m_value.load();
+                if ( TryPush( item ) ) {
+                    return true;
+                }
+                m_popped.Wait( popped, -1 );
+            }
+            return false;
+        }
+
+        // removes an item waiting for the timeout (negative for none) as needed,
+        // returns false if the timeout is elapsed or if the channel is closed and empty
+        bool Pop( T & item, const int timeout_ms = -1 ) {
+            while ( true ) {
+                const uint32_t pushed = m_pushed.m_value.load();
+                if ( TryPop( item ) ) {
+                    return true;
+                }
+                if ( m_bClosed ) {
+                    // an item may be pushed just before closing
+                    return TryPop( item );
+                }
+                m_pushed.Wait( pushed, timeout_ms );
+                if ( timeout_ms >= 0 ) {
+                    return TryPop( item );
+                }
+            }
+        }
+
+        // marks the channel as closed (no more items will be pushed), wakes up all waiting threads
+        void Close() {
+            m_bClosed = true;
+            m_pushed.Notify();
+            m_popped.Notify();
+        }
+
+        // returns true if the channel is closed and empty
+        bool IsDrained() const {
+            return m_bClosed && GetSize() == 0;
+        }
+
+        // returns an approximate count of items in the channel
+        size_t GetSize() const {
+            const size_t push_pos = m_push_pos.load( std::memory_order_relaxed );
+            const size_t pop_pos = m_pop_pos.load( std::memory_order_relaxed );
+            return push_pos > pop_pos ? push_pos - pop_pos : 0;
+        }
+};
@@ -0,0 +1,157 @@
+#include "common.h"
+
+#include "Checkpoint.h"
+
+void CCheckpoint::CPart::AddEvents( const CEventIndex & index, const EEventKind kind, const uint32_t now_us ) {
+    index.ForEach( [ & ]( const CTraceKey & id, const CEventTable::CEvent & event ) {
+        AddEvent( id, event, kind, now_us );
+    } );
+}
+
+void CCheckpoint::CPart::AddEvents( const CEventIndex & index, const size_t shard_index, const EEventKind kind, const uint32_t now_us ) {
+    index.ForEachInShard( shard_index, [ & ]( const CTraceKey & id, const CEventTable::CEvent & event ) {
+        AddEvent( id, event, kind, now_us );
+    } );
+}
+
+void CCheckpoint::CPart::AddEvent( const CTraceKey & id, const CEventTable::CEvent & event, const EEventKind kind, const uint32_t now_us ) {
+    events.push_back( CEventRecord {
+        id.m_high,
+        id.m_low,
+        event.m_timestamp,
+        event.m_dimension,
+        now_us - event.m_received_us,
+        id.m_format,
+        kind,
+        {}
+    } );
+}
+
+void CCheckpoint::CPart::RemoveEvent( const CTraceKey & id, const EEventKind kind ) {
+    removed_events.push_back( { id, kind, events.size() } );
+}
+
+void CCheckpoint::CPart::DropRemovedEvents() {
+    if ( removed_events.empty() ) {
+        return;
+    }
+    // an event record is dropped if the event was removed after the record was added
+    const auto get_key = []( const CTraceKey & id, const uint8_t kind ) {
+        return std::make_tuple( id.m_high, id.m_low, id.m_format, kind );
+    };
+    std::ranges::sort( removed_events, std::less(), [ & ]( const CRemovedEvent & removed ) {
+        return std::make_pair( get_key( removed.id, removed.kind ), removed.event_count );
+    } );
+    size_t count = 0;
+    for ( size_t i = 0; i < events.size(); i++ ) {
+        const auto & event = events[ i ];
+        CTraceKey id;
+        id.m_high = event.high;
+        id.m_low = event.low;
+        id.m_format = event.format;
+        // the last removal of the event decides
+        const auto it = std::ranges::upper_bound( removed_events, get_key( id, event.kind ), std::less(), [ & ]( const CRemovedEvent & removed ) {
+            return get_key( removed.id, removed.kind );
+        } );
+        const bool bRemoved = it != removed_events.begin() && get_key( std::prev( it )->id, std::prev( it )->kind ) == get_key( id, event.kind ) && std::prev( it )->event_count > i;
+        if ( !bRemoved ) {
+            events[ count++ ] = event;
+        }
+    }
+    events.resize( count );
+    removed_events.clear();
+}
+
+void CCheckpoint::CPart::AddInterval( const time_t ts, const CAggregatedStats & stats, const CDictionary::t_id other_path ) {
+    const auto & overload_counters = stats.GetOverloadCounters();
+    CIntervalRecord & interval = intervals.emplace_back( CIntervalRecord {
+        ts,
+        cells.size(),
+        0,
+        stats.GetSampleCount(),
+        stats.GetTotalCount(),
+        stats.GetTotalVariance(),
+        overload_counters.shed_events,
+        overload_counters.fast_parsed_events,
+        overload_counters.dropped_requests,
+        overload_counters.overflow_responses,
+        overload_counters.input_stall_ms,
+        0
+    } );
+    stats.ForEachCell( other_path, [ & ]( const CAggregatedStats::t_key key, const CAggregatedStats::CCell & cell ) {
+        CCellRecord & record = cells.emplace_back( CCellRecord {
+            CAggregatedStats::GetRequestID( key ),
+            CAggregatedStats::GetResultCodeID( key ),
+            cell.count,
+            cell.variance,
+            latencies.size(),
+            0,
+            0
+        } );
+        if ( cell.latencies ) {
+            cell.latencies->ForEachBucket( [ & ]( const unsigned int bucket, const uint64_t count ) {
+                latencies.push_back( CLatencyRecord { bucket, 0, count } );
+            } );
+            record.latency_count = latencies.size() - record.first_latency;
+            record.latency_max = cell.latencies->GetMax();
+        }
+    } );
+    interval.cell_count = cells.size() - interval.first_cell;
+}
+
+void CCheckpoint::CPart::AddRollup( const time_t seconds, const time_t start_ts, const CAggregatedStats & stats, const CDictionary::t_id other_path ) {
+    AddInterval( start_ts, stats, other_path );
+    intervals.back().rollup_seconds = seconds;
+}
+
+uint64_t CCheckpointParts::Request() {
+    return m_requested_epoch.fetch_add( 1, std::memory_order_relaxed ) + 1;
+}
+
+void CCheckpointParts::Submit( const unsigned int partition_index, const uint64_t epoch, CCheckpoint::PPart part ) {
+    {
+        std::lock_guard < std::mutex > lock( m_mutex );
+        if ( m_parts.size() <= partition_index ) {
+            m_parts.resize( partition_index + 1 );
+        }
+        m_parts[ partition_index ] = { epoch, std::move( part ) };
+    }
+    m_submitted.notify_all();
+}
+
+bool CCheckpointParts::Collect( const uint64_t epoch, const unsigned int partition_count, const int timeout_ms, std::vector < CCheckpoint::PPart > & parts ) {
+    std::unique_lock < std::mutex > lock( m_mutex );
+    const bool bComplete = m_submitted.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [ & ]() {
+        return m_parts.size() >= partition_count && std::all_of( m_parts.begin(), m_parts.begin() + partition_count, [ epoch ]( const auto & part ) {
+            return part.first == epoch && part.second;
+        } );
+    } );
+    if ( bComplete ) {
+        for ( unsigned int i = 0; i < partition_count; i++ ) {
+            parts.push_back( std::move( m_parts[ i ].second ) );
+        }
+    }
+    return bComplete;
+}
+
+void CCheckpointParts::SubmitRollups( const time_t watermark, CCheckpoint::PPart part ) {
+    {
+        std::lock_guard < std::mutex > lock( m_mutex );
+        m_rollups = std::move( part );
+        m_rollups_watermark = watermark;
+    }
+    m_submitted.notify_all();
+}
+
+bool CCheckpointParts::CollectRollups( const time_t min_watermark, const int timeout_ms, std::vector < CCheckpoint::PPart > & parts, time_t & watermark ) {
+    std::unique_lock < std::mutex > lock( m_mutex );
+    const bool bComplete = m_submitted.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [ & ]() {
+        return m_rollups && m_rollups_watermark >= min_watermark;
+    } );
+    if ( bComplete ) {
+        // the rollups are kept for the next checkpoints until they change
+        parts.push_back( std::make_unique < CCheckpoint::CPart >( *m_rollups ) );
+        watermark = m_rollups_watermark;
+    }
+    return bComplete;
+}
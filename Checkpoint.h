@@ -0,0 +1,203 @@
+#pragma once
+
+#include "common.h"
+#include "EventIndex.h"
+#include "AggregatedStats.h"
+
+//
+// Checkpoint of the in-flight state: pending requests, responses waiting for their requests, stats of intervals
+// not output yet and rollups of coarser resolutions in progress. The file is flat and position-independent: a header with section offsets from the file start,
+// then arrays of fixed-size little-endian records, so a checkpoint is restored from a read-only memory map
+// without parsing anything. Dimensions are stored as indexes into the string tables of the file and are interned
+// again on restore. Sections in the order of ESection:
+//
+//   SECTION_PATHS      CStringRecord per request path ID of the process that wrote the checkpoint
+//   SECTION_CODES      CStringRecord per result code ID
+//   SECTION_STRINGS    bytes of the strings
+//   SECTION_EVENTS     CEventRecord per pending request or waiting response
+//   SECTION_INTERVALS  CIntervalRecord per stats shard (an interval may have several) or rollup
+//   SECTION_CELLS      CCellRecord per cell, the cells of a shard are consecutive
+//   SECTION_LATENCIES  CLatencyRecord per non-empty latency histogram bucket, the buckets of a cell are consecutive
+//
+class CCheckpoint {
+
+    public:
+
+        static constexpr char FILE_MAGIC[ 8 ] = { 'P', 'C', 'H', 'K', 'P', 'T', '0', '1' };
+
+        enum ESection {
+            SECTION_PATHS,
+            SECTION_CODES,
+            SECTION_STRINGS,
+            SECTION_EVENTS,
+            SECTION_INTERVALS,
+            SECTION_CELLS,
+            SECTION_LATENCIES,
+            SECTION_COUNT
+        };
+
+        enum EEventKind : uint8_t {
+            EVENT_REQUEST = 0,
+            EVENT_RESPONSE = 1,
+        };
+
+        class CHeader {
+            public:
+                char magic[ 8 ];
+                int64_t created_ts;
+                // start of the first interval not taken for output once all parts were copied: intervals before it
+                // are output, their shards copied by some partitions before that are not restored
+                int64_t output_watermark;
+                // offsets of the sections from the file start, the last one is the file size
+                uint64_t section_offsets[ SECTION_COUNT + 1 ];
+        };
+
+        class CStringRecord {
+            public:
+                // offset in SECTION_STRINGS
+                uint32_t offset;
+                uint32_t size;
+        };
+
+        class CEventRecord {
+            public:
+                uint64_t high;
+                uint64_t low;
+                int64_t timestamp;
+                // request path ID for a request, result code ID for a response (of the writing process)
+                uint32_t dimension;
+                // time from receiving the event to copying it for the checkpoint in microseconds (receive times are
+                // steady clock times of the writing process, so they are restored relative to the restore time)
+                uint32_t age_us;
+                uint8_t format;
+                uint8_t kind;
+                uint8_t reserved[ 6 ];
+        };
+
+        class CIntervalRecord {
+            public:
+                int64_t ts;
+                uint64_t first_cell;
+                uint64_t cell_count;
+                uint64_t sample_count;
+                uint64_t total_count;
+                uint64_t total_variance;
+                uint64_t shed_events;
+                uint64_t fast_parsed_events;
+                uint64_t dropped_requests;
+                uint64_t overflow_responses;
+                uint64_t input_stall_ms;
+                // width of the resolution of a rollup starting at ts, 0 for a stats shard
+                int64_t rollup_seconds;
+        };
+
+        class CCellRecord {
+            public:
+                uint32_t path;
+                uint32_t code;
+                uint64_t count;
+                uint64_t variance;
+                uint64_t first_latency;
+                // count of latency buckets (0 if the cell has no latencies)
+                uint32_t latency_count;
+                uint32_t latency_max;
+        };
+
+        class CLatencyRecord {
+            public:
+                uint32_t bucket;
+                uint32_t reserved;
+                uint64_t count;
+        };
+
+        // an event removed after it was copied (from a part copied in steps)
+        class CRemovedEvent {
+            public:
+                CTraceKey id;
+                EEventKind kind;
+                // count of event records when the event was removed (records after it are added again later)
+                size_t event_count;
+        };
+
+        //
+        // Records of a part of the state (one aggregation partition or the whole pipeline) referring to dictionary IDs
+        // of the running process. Parts are built by the threads owning the state and written by the checkpoint thread.
+        // A part may be copied shard by shard while the state changes: events added to the shards copied already are
+        // added as they come, events removed from them are listed and dropped by DropRemovedEvents().
+        //
+        class CPart {
+            public:
+                std::vector < CEventRecord > events;
+                std::vector < CIntervalRecord > intervals;
+                std::vector < CCellRecord > cells;
+                std::vector < CLatencyRecord > latencies;
+                std::vector < CRemovedEvent > removed_events;
+
+                // copies events of an index, now_us is the current steady clock time in microseconds
+                void AddEvents( const CEventIndex & index, const EEventKind kind, const uint32_t now_us );
+                // copies events of an index shard
+                void AddEvents( const CEventIndex & index, const size_t shard_index, const EEventKind kind, const uint32_t now_us );
+                // copies an event
+                void AddEvent( const CTraceKey & id, const CEventTable::CEvent & event, const EEventKind kind, const uint32_t now_us );
+                // lists an event copied before as removed
+                void RemoveEvent( const CTraceKey & id, const EEventKind kind );
+                // drops the records of the events listed as removed (on the checkpoint thread)
+                void DropRemovedEvents();
+                // copies a stats shard of the interval specified, sketched counts out of the top go to other_path
+                void AddInterval( const time_t ts, const CAggregatedStats & stats, const CDictionary::t_id other_path );
+                // copies the stats of a rollup in progress
+                void AddRollup( const time_t seconds, const time_t start_ts, const CAggregatedStats & stats, const CDictionary::t_id other_path );
+        };
+        typedef std::unique_ptr < CPart > PPart;
+
+        // a rollup in progress restored for the output processor
+        class CRestoredRollup {
+            public:
+                time_t seconds = 0;
+                time_t start_ts = 0;
+                PAggregatedStats stats;
+        };
+};
+
+//
+// Hand-over of checkpoint parts from aggregation threads to the checkpoint thread. A checkpoint is requested by
+// raising the epoch (aggregators check it with one relaxed load per loop), every aggregator builds its part in steps
+// between event batches and submits it, writing the file is left to the checkpoint thread. The output thread submits
+// its rollups whenever they change with the output watermark they include (the intervals before it are rolled up).
+//
+class CCheckpointParts {
+
+    protected:
+
+        std::atomic < uint64_t > m_requested_epoch = 0;
+        std::mutex m_mutex;
+        std::condition_variable m_submitted;
+        // the last part submitted by every partition and its epoch
+        std::vector < std::pair < uint64_t, CCheckpoint::PPart > > m_parts;
+        // the last rollups submitted and their output watermark
+        CCheckpoint::PPart m_rollups;
+        time_t m_rollups_watermark = 0;
+
+    public:
+
+        // requests parts for a new checkpoint, returns its epoch
+        uint64_t Request();
+
+        // returns the epoch requested last (lock-free)
+        uint64_t GetRequestedEpoch() const {
+            return m_requested_epoch.load( std::memory_order_relaxed );
+        }
+
+        // stores the part of a partition built for the epoch specified
+        void Submit( const unsigned int partition_index, const uint64_t epoch, CCheckpoint::PPart part );
+
+        // waits up to the timeout for parts of all partitions built for the epoch specified, returns false if any is missing
+        bool Collect( const uint64_t epoch, const unsigned int partition_count, const int timeout_ms, std::vector < CCheckpoint::PPart > & parts );
+
+        // stores rollups including the intervals before the output watermark specified
+        void SubmitRollups( const time_t watermark, CCheckpoint::PPart part );
+
+        // waits up to the timeout for rollups including the intervals before the output watermark specified at least,
+        // adds a copy of them to the parts and returns their watermark, returns false if there are none
+        bool CollectRollups( const time_t min_watermark, const int timeout_ms, std::vector < CCheckpoint::PPart > & parts, time_t & watermark );
+};
@@ -0,0 +1,398 @@
+#include "common.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "Checkpointer.h"
+
+// records are copied as they are
+static_assert( std::endian::native == std::endian::little );
+static_assert( sizeof( CCheckpoint::CHeader ) == 88 );
+static_assert( sizeof( CCheckpoint::CStringRecord ) == 8 );
+static_assert( sizeof( CCheckpoint::CEventRecord ) == 40 );
+static_assert( sizeof( CCheckpoint::CIntervalRecord ) == 96 );
+static_assert( sizeof( CCheckpoint::CCellRecord ) == 40 );
+static_assert( sizeof( CCheckpoint::CLatencyRecord ) == 16 );
+
+namespace {
+
+    bool WriteAll( const int fd, const void * data, const size_t size ) {
+        const auto * p = static_cast < const char * >( data );
+        for ( size_t written = 0; written < size; ) {
+            const ssize_t result = write( fd, p + written, size - written );
+            if ( result < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return false;
+            }
+            written += result;
+        }
+        return true;
+    }
+
+    // appends string records of all dictionary strings to the records and their bytes to the blob
+    void AddStrings( const CDictionary & dictionary, std::vector < CCheckpoint::CStringRecord > & records, std::string & blob ) {
+        const size_t count = dictionary.GetCount();
+        for ( size_t id = 0; id < count; id++ ) {
+            const std::string_view value = dictionary.GetString( static_cast < CDictionary::t_id >( id ) );
+            records.push_back( CCheckpoint::CStringRecord { static_cast < uint32_t >( blob.size() ), static_cast < uint32_t >( value.size() ) } );
+            blob += value;
+        }
+    }
+
+    // a read-only section of a mapped checkpoint
+    template < typename T > class CSection {
+        public:
+            const T * records = nullptr;
+            size_t count = 0;
+
+            const T * begin() const { return records; }
+            const T * end() const { return records + count; }
+    };
+
+    template < typename T > bool GetSection( const char * data, const CCheckpoint::CHeader & header, const unsigned int section, CSection < T > & result ) {
+        const uint64_t size = header.section_offsets[ section + 1 ] - header.section_offsets[ section ];
+        if ( size % sizeof( T ) != 0 || header.section_offsets[ section ] % alignof( T ) != 0 ) {
+            return false;
+        }
+        result.records = reinterpret_cast < const T * >( data + header.section_offsets[ section ] );
+        result.count = size / sizeof( T );
+        return true;
+    }
+
+    // interns strings of a mapped checkpoint, returns the IDs of this process by the IDs of the writing process
+    // (reserved IDs are the same in every process)
+    bool InternStrings( const CSection < CCheckpoint::CStringRecord > & records, const std::string_view blob, CDictionary & dictionary, std::vector < CDictionary::t_id > & ids ) {
+        for ( const auto & record : records ) {
+            if ( record.offset > blob.size() || record.size > blob.size() - record.offset ) {
+                return false;
+            }
+            const auto id = static_cast < CDictionary::t_id >( ids.size() );
+            ids.push_back( id < dictionary.GetReservedCount() ? id : dictionary.GetID( blob.substr( record.offset, record.size ) ) );
+        }
+        return true;
+    }
+
+}
+
+CCheckpointer::CCheckpointer( PContext context )
+    : m_context( std::move( context ) )
+{
+}
+
+CCheckpoint::PPart CCheckpointer::CreateReaderPart() const {
+    auto part = std::make_unique < CCheckpoint::CPart >();
+    m_context->stats.ForEachItem( [ & ]( const time_t ts, const PIntervalStats & interval_stats ) {
+        interval_stats->ForEachShard( [ & ]( const unsigned int owner, const CAggregatedStats & shard ) {
+            if ( owner == CIntervalStats::NO_OWNER ) {
+                part->AddInterval( ts, shard, OTHER_REQUEST_ID );
+            }
+        } );
+    } );
+    return part;
+}
+
+CCheckpoint::PPart CCheckpointer::CreateFinalPart() const {
+    auto part = std::make_unique < CCheckpoint::CPart >();
+    const uint32_t now_us = GetSteadyMicroseconds();
+    for ( const auto & partition : m_context->partitions ) {
+        part->AddEvents( partition->pending_requests, CCheckpoint::EVENT_REQUEST, now_us );
+        part->AddEvents( partition->early_responses, CCheckpoint::EVENT_RESPONSE, now_us );
+    }
+    m_context->stats.ForEachItem( [ & ]( const time_t ts, const PIntervalStats & interval_stats ) {
+        interval_stats->ForEachShard( [ & ]( const unsigned int, const CAggregatedStats & shard ) {
+            part->AddInterval( ts, shard, OTHER_REQUEST_ID );
+        } );
+    } );
+    return part;
+}
+
+// writes the dictionaries and the parts specified (their record indexes are moved) to a temporary file,
+// then replaces the checkpoint file with it
+bool CCheckpointer::Write( const std::vector < CCheckpoint::PPart > & parts, const time_t output_watermark ) const {
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    std::vector < CCheckpoint::CStringRecord > paths;
+    std::vector < CCheckpoint::CStringRecord > codes;
+    std::string strings;
+    AddStrings( m_context->request_paths, paths, strings );
+    AddStrings( m_context->result_codes, codes, strings );
+    // records following the strings stay aligned
+    strings.resize( ( strings.size() + 7 ) & ~size_t( 7 ) );
+
+    // cell and latency indexes of every part are moved past the records of the parts before it
+    size_t first_cell = 0;
+    size_t first_latency = 0;
+    for ( const auto & part : parts ) {
+        for ( auto & interval : part->intervals ) {
+            interval.first_cell += first_cell;
+        }
+        for ( auto & cell : part->cells ) {
+            cell.first_latency += first_latency;
+        }
+        first_cell += part->cells.size();
+        first_latency += part->latencies.size();
+    }
+
+    CCheckpoint::CHeader header {};
+    memcpy( header.magic, CCheckpoint::FILE_MAGIC, sizeof( header.magic ) );
+    header.created_ts = time( nullptr );
+    // read after all parts are copied, so every interval not taken for output by then is copied completely
+    header.output_watermark = output_watermark;
+    uint64_t offset = sizeof( header );
+    for ( unsigned int section = 0; section < CCheckpoint::SECTION_COUNT; section++ ) {
+        header.section_offsets[ section ] = offset;
+        switch ( section ) {
+            case CCheckpoint::SECTION_PATHS:
+                offset += paths.size() * sizeof( CCheckpoint::CStringRecord );
+                break;
+            case CCheckpoint::SECTION_CODES:
+                offset += codes.size() * sizeof( CCheckpoint::CStringRecord );
+                break;
+            case CCheckpoint::SECTION_STRINGS:
+                offset += strings.size();
+                break;
+            default:
+                for ( const auto & part : parts ) {
+                    offset +=
+                        section == CCheckpoint::SECTION_EVENTS ? part->events.size() * sizeof( CCheckpoint::CEventRecord ) :
+                        section == CCheckpoint::SECTION_INTERVALS ? part->intervals.size() * sizeof( CCheckpoint::CIntervalRecord ) :
+                        section == CCheckpoint::SECTION_CELLS ? part->cells.size() * sizeof( CCheckpoint::CCellRecord ) :
+                        part->latencies.size() * sizeof( CCheckpoint::CLatencyRecord );
+                }
+        }
+    }
+    header.section_offsets[ CCheckpoint::SECTION_COUNT ] = offset;
+
+    const std::string temp_filename = m_context->checkpoint_filename + ".tmp";
+    const int fd = open( temp_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if ( fd < 0 ) {
+        std::cout << "Cannot write checkpoint " << temp_filename << ": " << strerror( errno ) << std::endl;
+        return false;
+    }
+
+    bool bResult =
+        WriteAll( fd, &header, sizeof( header ) )
+        &&
+        WriteAll( fd, paths.data(), paths.size() * sizeof( CCheckpoint::CStringRecord ) )
+        &&
+        WriteAll( fd, codes.data(), codes.size() * sizeof( CCheckpoint::CStringRecord ) )
+        &&
+        WriteAll( fd, strings.data(), strings.size() );
+    for ( const auto & part : parts ) {
+        bResult = bResult && WriteAll( fd, part->events.data(), part->events.size() * sizeof( CCheckpoint::CEventRecord ) );
+    }
+    for ( const auto & part : parts ) {
+        bResult = bResult && WriteAll( fd, part->intervals.data(), part->intervals.size() * sizeof( CCheckpoint::CIntervalRecord ) );
+    }
+    for ( const auto & part : parts ) {
+        bResult = bResult && WriteAll( fd, part->cells.data(), part->cells.size() * sizeof( CCheckpoint::CCellRecord ) );
+    }
+    for ( const auto & part : parts ) {
+        bResult = bResult && WriteAll( fd, part->latencies.data(), part->latencies.size() * sizeof( CCheckpoint::CLatencyRecord ) );
+    }
+    bResult = bResult && fsync( fd ) == 0;
+    close( fd );
+    bResult = bResult && rename( temp_filename.c_str(), m_context->checkpoint_filename.c_str() ) == 0;
+    if ( !bResult ) {
+        std::cout << "Cannot write checkpoint " << m_context->checkpoint_filename << ": " << strerror( errno ) << std::endl;
+        return false;
+    }
+
+    m_context->DEBUG_OUTPUT && std::cout << "Checkpoint written: " << offset << " bytes in "
+        << std::chrono::duration_cast < std::chrono::milliseconds >( std::chrono::steady_clock::now() - start_time ).count() << " ms" << std::endl;
+    return true;
+}
+
+bool CCheckpointer::Restore( const PContext & context ) {
+
+    const auto start_time = std::chrono::steady_clock::now();
+
+    const int fd = open( context->checkpoint_filename.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 ) {
+        return errno == ENOENT;
+    }
+    struct stat st;
+    if ( fstat( fd, &st ) != 0 || static_cast < size_t >( st.st_size ) < sizeof( CCheckpoint::CHeader ) ) {
+        close( fd );
+        std::cout << "Cannot read checkpoint " << context->checkpoint_filename << std::endl;
+        return false;
+    }
+    void * mapping = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0 );
+    close( fd );
+    if ( mapping == MAP_FAILED ) {
+        std::cout << "Cannot map checkpoint " << context->checkpoint_filename << ": " << strerror( errno ) << std::endl;
+        return false;
+    }
+    const auto * data = static_cast < const char * >( mapping );
+    const size_t size = st.st_size;
+
+    // the whole file is validated before any state is changed
+    const auto & header = *reinterpret_cast < const CCheckpoint::CHeader * >( data );
+    bool bValid = memcmp( header.magic, CCheckpoint::FILE_MAGIC, sizeof( header.magic ) ) == 0 && header.section_offsets[ CCheckpoint::SECTION_COUNT ] == size;
+    for ( unsigned int section = 0; bValid && section < CCheckpoint::SECTION_COUNT; section++ ) {
+        bValid = header.section_offsets[ section ] >= sizeof( header ) && header.section_offsets[ section ] <= header.section_offsets[ section + 1 ];
+    }
+    CSection < CCheckpoint::CStringRecord > paths;
+    CSection < CCheckpoint::CStringRecord > codes;
+    CSection < CCheckpoint::CEventRecord > events;
+    CSection < CCheckpoint::CIntervalRecord > intervals;
+    CSection < CCheckpoint::CCellRecord > cells;
+    CSection < CCheckpoint::CLatencyRecord > latencies;
+    bValid = bValid
+        && GetSection( data, header, CCheckpoint::SECTION_PATHS, paths )
+        && GetSection( data, header, CCheckpoint::SECTION_CODES, codes )
+        && GetSection( data, header, CCheckpoint::SECTION_EVENTS, events )
+        && GetSection( data, header, CCheckpoint::SECTION_INTERVALS, intervals )
+        && GetSection( data, header, CCheckpoint::SECTION_CELLS, cells )
+        && GetSection( data, header, CCheckpoint::SECTION_LATENCIES, latencies );
+    if ( bValid ) {
+        for ( const auto & event : events ) {
+            bValid = bValid && event.kind <= CCheckpoint::EVENT_RESPONSE && event.format != CTraceKey::FORMAT_NONE
+                && event.dimension < ( event.kind == CCheckpoint::EVENT_REQUEST ? paths.count : codes.count );
+        }
+        for ( const auto & interval : intervals ) {
+            bValid = bValid && interval.first_cell <= cells.count && interval.cell_count <= cells.count - interval.first_cell;
+        }
+        for ( const auto & cell : cells ) {
+            bValid = bValid && cell.path < paths.count && cell.code < codes.count
+                && cell.first_latency <= latencies.count && cell.latency_count <= latencies.count - cell.first_latency;
+        }
+    }
+
+    std::vector < CDictionary::t_id > path_ids;
+    std::vector < CDictionary::t_id > code_ids;
+    const std::string_view strings = bValid ? std::string_view(
+        data + header.section_offsets[ CCheckpoint::SECTION_STRINGS ],
+        header.section_offsets[ CCheckpoint::SECTION_STRINGS + 1 ] - header.section_offsets[ CCheckpoint::SECTION_STRINGS ]
+    ) : std::string_view();
+    bValid = bValid
+        && InternStrings( paths, strings, context->request_paths, path_ids )
+        && InternStrings( codes, strings, context->result_codes, code_ids );
+
+    if ( !bValid ) {
+        munmap( mapping, size );
+        std::cout << "Invalid checkpoint " << context->checkpoint_filename << std::endl;
+        return false;
+    }
+
+    // events go to the partitions of their trace keys, receive times are moved to the steady clock of this process
+    const uint32_t now_us = GetSteadyMicroseconds();
+    const auto partition_count = static_cast < unsigned int >( context->partitions.size() );
+    for ( const auto & event : events ) {
+        CTraceKey id;
+        id.m_high = event.high;
+        id.m_low = event.low;
+        id.m_format = event.format;
+        CEventTable::CEvent restored;
+        restored.m_timestamp = event.timestamp;
+        restored.m_received_us = now_us - event.age_us;
+        auto & partition = *context->partitions[ CAggregationPartition::GetIndex( id, partition_count ) ];
+        if ( event.kind == CCheckpoint::EVENT_REQUEST ) {
+            restored.m_dimension = path_ids[ event.dimension ];
+            partition.pending_requests.Push( id, restored, ( restored.m_timestamp + context->REQUEST_LIFETIME_SECONDS ) / SECONDS_PER_EVENT_BUCKET );
+        } else {
+            restored.m_dimension = code_ids[ event.dimension ];
+            partition.early_responses.Push( id, restored, ( restored.m_timestamp + context->RESPONSE_GRACE_SECONDS ) / SECONDS_PER_EVENT_BUCKET );
+        }
+    }
+
+    // a shard per saved shard owned by the first partition, so the next periodic checkpoints take it
+    for ( const auto & interval : intervals ) {
+        if ( interval.rollup_seconds == 0 && interval.ts < header.output_watermark ) {
+            // output while the parts were copied, the shards are partial
+            continue;
+        }
+        // rollups are merged from whole intervals, their stats are not sketched again
+        auto shard = interval.rollup_seconds > 0 ? std::make_shared < CAggregatedStats >() : std::make_shared < CAggregatedStats >( context->SKETCH_SIZE / partition_count );
+        for ( uint64_t i = interval.first_cell; i < interval.first_cell + interval.cell_count; i++ ) {
+            const auto & cell = cells.records[ i ];
+            std::unique_ptr < CLatencyHistogram > histogram;
+            if ( cell.latency_count > 0 ) {
+                histogram = std::make_unique < CLatencyHistogram >();
+                for ( uint64_t j = cell.first_latency; j < cell.first_latency + cell.latency_count; j++ ) {
+                    histogram->AddBucket( latencies.records[ j ].bucket, latencies.records[ j ].count, cell.latency_max );
+                }
+            }
+            shard->AddCell( CAggregatedStats::MakeKey( path_ids[ cell.path ], code_ids[ cell.code ] ), cell.count, cell.variance, histogram.get() );
+        }
+        shard->AddTotals( interval.sample_count, interval.total_count, interval.total_variance );
+        auto & overload_counters = shard->GetOverloadCounters();
+        overload_counters.shed_events = interval.shed_events;
+        overload_counters.fast_parsed_events = interval.fast_parsed_events;
+        overload_counters.dropped_requests = interval.dropped_requests;
+        overload_counters.overflow_responses = interval.overflow_responses;
+        overload_counters.input_stall_ms = interval.input_stall_ms;
+        if ( interval.rollup_seconds > 0 ) {
+            // the output processor continues the rollup
+            context->restored_rollups.push_back( { interval.rollup_seconds, interval.ts, std::move( shard ) } );
+            continue;
+        }
+        // intervals of a run with another interval width are counted in the interval their start falls into
+        PIntervalStats interval_stats;
+        context->stats.GetItemByKey( context->stats.GetQuantizedTime( interval.ts ), interval_stats );
+        interval_stats->AddShard( std::move( shard ), 0 );
+    }
+
+    context->DEBUG_OUTPUT && std::cout << "Checkpoint of " << to_stream( header.created_ts ) << " restored: "
+        << events.count << " events, " << intervals.count << " stats shards in "
+        << std::chrono::duration_cast < std::chrono::microseconds >( std::chrono::steady_clock::now() - start_time ).count() << " us" << std::endl;
+
+    munmap( mapping, size );
+    return true;
+}
+
+void CCheckpointer::Run( const std::stop_token & stoken, const PContext & context ) {
+
+    CCheckpointer checkpointer( context );
+    const auto partition_count = static_cast < unsigned int >( context->partitions.size() );
+
+    auto checkpoint_time = std::chrono::steady_clock::now() + std::chrono::seconds( CHECKPOINT_SECONDS );
+    while ( !stoken.stop_requested() ) {
+        // wake up every 100 ms to check for the stop request
+        std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+        if ( std::chrono::steady_clock::now() < checkpoint_time ) {
+            continue;
+        }
+        checkpoint_time += std::chrono::seconds( CHECKPOINT_SECONDS );
+        // aggregators copy their parts between event batches, an aggregator that has ended cannot, then the final checkpoint follows
+        const uint64_t epoch = context->checkpoint_parts.Request();
+        std::vector < CCheckpoint::PPart > parts;
+        if ( !context->checkpoint_parts.Collect( epoch, partition_count, CHECKPOINT_COLLECT_TIMEOUT_MS, parts ) ) {
+            context->DEBUG_OUTPUT && std::cout << "Checkpoint skipped: aggregators did not respond" << std::endl;
+            continue;
+        }
+        // events removed while the parts were copied in steps are dropped here rather than on the aggregation threads
+        for ( auto & part : parts ) {
+            part->DropRemovedEvents();
+        }
+        // the watermark is taken once all parts are copied, then rollups including at least the intervals before it
+        // are taken and the watermark is moved to theirs (the intervals in between are output and rolled up)
+        time_t output_watermark = context->output_watermark;
+        if (
+            !context->output_resolutions.empty()
+            &&
+            !context->checkpoint_parts.CollectRollups( output_watermark, CHECKPOINT_COLLECT_TIMEOUT_MS, parts, output_watermark )
+        ) {
+            context->DEBUG_OUTPUT && std::cout << "Checkpoint skipped: rollups were not submitted" << std::endl;
+            continue;
+        }
+        parts.push_back( checkpointer.CreateReaderPart() );
+        checkpointer.Write( parts, output_watermark );
+    }
+
+    // all stages are stopped, the state is not changing anymore (the output thread has submitted its rollups on exit)
+    std::vector < CCheckpoint::PPart > parts;
+    parts.push_back( checkpointer.CreateFinalPart() );
+    time_t output_watermark = context->output_watermark;
+    if ( !context->output_resolutions.empty() ) {
+        context->checkpoint_parts.CollectRollups( output_watermark, 0, parts, output_watermark );
+    }
+    checkpointer.Write( parts, output_watermark );
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+
+//
+// Writes checkpoints of the in-flight state (see Checkpoint.h) and restores the state from the last one on startup.
+// Periodic checkpoints are assembled from parts copied by the aggregation threads between event batches (an event index
+// shard at a time), the file is written by the checkpoint thread alone, so aggregation never waits for I/O. The final checkpoint is written
+// from the drained pipeline on exit: after SIGINT or SIGTERM it holds everything not output yet and the next run
+// continues from it, after the end of input it is empty. A file is written under a temporary name and renamed,
+// so a crash leaves the previous checkpoint intact. Partitions copy their parts at different moments, so shards of
+// intervals taken for output meanwhile are dropped on restore by the output watermark of the checkpoint, intervals
+// output after a periodic checkpoint is written are output again when a run is restored from it. Events still being
+// read or parsed are not part of a periodic checkpoint. Rollups in progress are taken as last submitted by the output
+// thread and the output watermark of the checkpoint is theirs, so the intervals they include are not restored again.
+//
+class CCheckpointer {
+
+    protected:
+
+        PContext m_context;
+
+        // copies stats shards handed over by the reader (overload counters)
+        CCheckpoint::PPart CreateReaderPart() const;
+        // copies all the state (the pipeline must be drained)
+        CCheckpoint::PPart CreateFinalPart() const;
+        bool Write( const std::vector < CCheckpoint::PPart > & parts, const time_t output_watermark ) const;
+
+        explicit CCheckpointer( PContext context );
+
+    public:
+
+        // restores the state from the checkpoint file specified in the context, returns false if it cannot be read
+        // (a missing file is not an error)
+        static bool Restore( const PContext & context );
+
+        // writes checkpoints every CHECKPOINT_SECONDS, the final one once stopped
+        static void Run( const std::stop_token & stoken, const PContext & context );
+};
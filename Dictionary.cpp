@@ -0,0 +1,53 @@
+#include "common.h"
+
+#include "Dictionary.h"
+
+CDictionary::CDictionary( std::initializer_list < std::string_view > values ) {
+    for ( const auto & value : values ) {
+        m_values.push_back( m_strings.emplace_back( value ) );
+    }
+    m_reserved_count = static_cast < t_id >( m_values.size() );
+}
+
+void CDictionary::SetCapacity( const size_t max_count, const t_id overflow_id ) {
+    std::unique_lock < std::shared_mutex > lock( m_mutex );
+    m_max_count = max_count;
+    m_overflow_id = overflow_id;
+}
+
+CDictionary::t_id CDictionary::GetID( const std::string_view value ) {
+    {
+        // search only in read mode
+        std::shared_lock < std::shared_mutex > lock( m_mutex );
+        if ( auto it = m_ids.find( value ); it != m_ids.end() ) {
+            return it->second;
+        }
+    }
+    // relocking in write mode, the string may be already added by a concurrent thread
+    std::unique_lock < std::shared_mutex > lock( m_mutex );
+    if ( auto it = m_ids.find( value ); it != m_ids.end() ) {
+        return it->second;
+    }
+    if ( m_values.size() >= m_max_count ) {
+        return m_overflow_id;
+    }
+    const std::string_view stored_value = m_strings.emplace_back( value );
+    const auto id = static_cast < t_id >( m_values.size() );
+    m_values.push_back( stored_value );
+    m_ids.emplace( stored_value, id );
+    return id;
+}
+
+std::string_view CDictionary::GetString( const t_id id ) const {
+    std::shared_lock < std::shared_mutex > lock( m_mutex );
+    return id < m_values.size() ? m_values[ id ] : std::string_view();
+}
+
+size_t CDictionary::GetCount() const {
+    std::shared_lock < std::shared_mutex > lock( m_mutex );
+    return m_values.size();
+}
+
+CDictionary::t_id CDictionary::GetReservedCount() const {
+    return m_reserved_count;
+}
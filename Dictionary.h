@@ -0,0 +1,54 @@
+#pragma once
+
+#include "common.h"
+
+//
+// Thread-safe string interning dictionary. Every distinct string gets a compact integer ID which stays valid
+// for the lifetime of the dictionary, so hot paths can store and compare IDs instead of strings.
+//
+class CDictionary {
+
+    public:
+
+        typedef uint32_t t_id;
+
+    protected:
+
+        // string storage with stable element addresses
+        std::deque < std::string > m_strings;
+        // ID to string
+        std::vector < std::string_view > m_values;
+        // string to ID, keys are views into m_strings
+        std::unordered_map < std::string_view, t_id > m_ids;
+
+        mutable std::shared_mutex m_mutex;
+
+        // maximum count of strings and the ID returned for new strings once it is reached
+        size_t m_max_count = std::numeric_limits < size_t >::max();
+        t_id m_overflow_id = 0;
+
+        // count of reserved strings (IDs 0, 1, ...)
+        t_id m_reserved_count = 0;
+
+    public:
+
+        CDictionary() = default;
+        // creates a dictionary with reserved strings getting IDs 0, 1, ... (names of special IDs: they are not looked up,
+        // so an equal string gets an ID of its own)
+        CDictionary( std::initializer_list < std::string_view > values );
+
+        // limits the count of strings, new strings get the overflow ID once the limit is reached
+        void SetCapacity( const size_t max_count, const t_id overflow_id );
+
+        // returns an ID of the string, adds the string if it is not known yet
+        t_id GetID( const std::string_view value );
+
+        // returns a string by ID
+        std::string_view GetString( const t_id id ) const;
+
+        // returns a count of strings stored
+        size_t GetCount() const;
+
+        // returns a count of reserved strings
+        t_id GetReservedCount() const;
+};
@@ -0,0 +1,15 @@
+#include "common.h"
+
+#include "EventBatch.h"
+
+CEventBatch::CEventBatch() {
+#ifdef DEBUG_MEMORY_CONSUMPTION
+    std::cout << "CEventBatch()" << std::endl;
+#endif // DEBUG_MEMORY_CONSUMPTION
+}
+
+CEventBatch::~CEventBatch() {
+#ifdef DEBUG_MEMORY_CONSUMPTION
+    std::cout << "~CEventBatch()" << std::endl;
+#endif // DEBUG_MEMORY_CONSUMPTION
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "EventTable.h"
+#include "LineBucket.h"
+
+//
+// Events parsed from one line bucket segment, passed from a parser to the aggregator as a whole.
+// Event is represented by a trace key, a timestamp and one dimension (request path or result code) ID.
+//
+class CEventBatch {
+
+    public:
+
+        class CItem {
+            public:
+                CTraceKey m_id;
+                CEventTable::CEvent m_event;
+        };
+        typedef std::vector < CItem > t_items;
+
+        // the line bucket the events are parsed from
+        PLineBucket m_bucket;
+        t_items m_requests;
+        t_items m_responses;
+
+        CEventBatch();
+        ~CEventBatch();
+
+};
+typedef std::unique_ptr < CEventBatch > PEventBatch;
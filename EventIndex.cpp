@@ -0,0 +1,216 @@
+#include "common.h"
+
+#include "EventIndex.h"
+
+#include "utils.h"
+
+// 64-bit finalizer (MurmurHash3 fmix64)
+static uint64_t Mix( uint64_t h ) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// the first filter position is taken from the low bits of the key hash, the second one from the remixed hash: the middle
+// and top bits select the partition and the shard, so they are nearly constant for the keys of a filter
+static size_t GetFilterPosition( const uint64_t hash, const unsigned int n, const size_t filter_size ) {
+    return ( n == 0 ? hash : Mix( hash ) ) & ( filter_size - 1 );
+}
+
+bool CEventIndex::CShard::MayContain( const uint64_t hash ) const {
+    return (
+        !m_filter.empty()
+        && m_filter[ GetFilterPosition( hash, 0, m_filter.size() ) ] != 0
+        && m_filter[ GetFilterPosition( hash, 1, m_filter.size() ) ] != 0
+    );
+}
+
+void CEventIndex::CShard::AddToFilter( const uint64_t hash ) {
+    for ( unsigned int n = 0; n < 2; n++ ) {
+        auto & counter = m_filter[ GetFilterPosition( hash, n, m_filter.size() ) ];
+        if ( counter != UINT8_MAX ) {
+            counter++;
+        }
+    }
+}
+
+void CEventIndex::CShard::RemoveFromFilter( const uint64_t hash ) {
+    for ( unsigned int n = 0; n < 2; n++ ) {
+        auto & counter = m_filter[ GetFilterPosition( hash, n, m_filter.size() ) ];
+        if ( counter != UINT8_MAX ) {
+            counter--;
+        }
+    }
+}
+
+// resizes the filter and refills it from the events stored
+void CEventIndex::CShard::RebuildFilter( const size_t size ) {
+    m_filter.assign( size, 0 );
+    m_events.ForEach( [ this ]( const CTraceKey & id, const CEventTable::CEvent & ) {
+        AddToFilter( id.GetHash() );
+    } );
+}
+
+void CEventIndex::CTimeCounts::Add( const time_t time_key ) {
+    if ( m_counts.empty() ) {
+        m_first_time_key = time_key;
+    } else if ( time_key < m_first_time_key ) {
+        m_counts.insert( m_counts.begin(), m_first_time_key - time_key, 0 );
+        m_first_time_key = time_key;
+    }
+    if ( const size_t n = time_key - m_first_time_key; n >= m_counts.size() ) {
+        m_counts.resize( n + 1, 0 );
+    }
+    m_counts[ time_key - m_first_time_key ]++;
+}
+
+void CEventIndex::CTimeCounts::Remove( const time_t time_key ) {
+    m_counts[ time_key - m_first_time_key ]--;
+    while ( !m_counts.empty() && m_counts.front() == 0 ) {
+        m_counts.pop_front();
+        m_first_time_key++;
+    }
+}
+
+bool CEventIndex::CTimeCounts::GetOldest( time_t & time_key ) const {
+    time_key = m_first_time_key;
+    return !m_counts.empty();
+}
+
+// removes a stored event
+void CEventIndex::CShard::Remove( const CTraceKey & id, const uint64_t hash, const time_t time_key ) {
+    m_events.Remove( id );
+    RemoveFromFilter( hash );
+    m_time_counts.Remove( time_key );
+}
+
+// fires due timers, removes events they were set for
+size_t CEventIndex::CShard::Expire( const time_t now, const size_t max_count, const t_event_handler & on_expired ) {
+    size_t expired_count = 0;
+    m_timers.Advance( now, max_count, [ & ]( const CTimerWheel::CTimer & timer ) {
+        // skip timers of events removed already (or removed and added again later)
+        const CTraceKey id = timer.GetID();
+        if (
+            CEventTable::CEvent event;
+            m_events.Find( id, event ) && event.m_timestamp / SECONDS_PER_EVENT_BUCKET == timer.GetTimeKey()
+        ) {
+            Remove( id, id.GetHash(), timer.GetTimeKey() );
+            expired_count++;
+            if ( on_expired ) {
+                on_expired( id, event );
+            }
+        }
+    } );
+    return expired_count;
+}
+
+size_t CEventIndex::GetShardIndex( const uint64_t hash ) {
+    return hash >> 60;
+}
+
+size_t CEventIndex::GetShardIndex( const CTraceKey & id ) {
+    return GetShardIndex( id.GetHash() );
+}
+
+bool CEventIndex::Push( const CTraceKey & id, const CEventTable::CEvent & event, const time_t deadline ) {
+    const uint64_t hash = id.GetHash();
+    CShard & shard = m_shards[ GetShardIndex( hash ) ];
+    std::unique_lock < std::shared_mutex > lock( shard.m_mutex );
+    if ( !shard.m_events.Insert( id, event ) ) {
+        return false;
+    }
+    if ( const size_t count = shard.m_events.GetCount(); count * FILTER_COUNTERS_PER_EVENT > shard.m_filter.size() ) {
+        shard.RebuildFilter( std::bit_ceil( std::max( count * FILTER_COUNTERS_PER_EVENT * 2, MIN_FILTER_SIZE ) ) );
+    } else {
+        shard.AddToFilter( hash );
+    }
+    const time_t time_key = event.m_timestamp / SECONDS_PER_EVENT_BUCKET;
+    shard.m_timers.Add( CTimerWheel::CTimer( id, time_key, deadline ) );
+    shard.m_time_counts.Add( time_key );
+    m_count++;
+    return true;
+}
+
+bool CEventIndex::GetByID( const CTraceKey & id, CEventTable::CEvent & event ) const {
+    const uint64_t hash = id.GetHash();
+    const CShard & shard = m_shards[ GetShardIndex( hash ) ];
+    std::shared_lock < std::shared_mutex > lock( shard.m_mutex );
+    // most of unknown IDs are rejected without probing the table
+    return shard.MayContain( hash ) && shard.m_events.Find( id, event );
+}
+
+bool CEventIndex::Extract( const CTraceKey & id, CEventTable::CEvent & event ) {
+    const uint64_t hash = id.GetHash();
+    CShard & shard = m_shards[ GetShardIndex( hash ) ];
+    std::unique_lock < std::shared_mutex > lock( shard.m_mutex );
+    if ( !shard.MayContain( hash ) || !shard.m_events.Find( id, event ) ) {
+        return false;
+    }
+    shard.Remove( id, hash, event.m_timestamp / SECONDS_PER_EVENT_BUCKET );
+    m_count--;
+    return true;
+}
+
+size_t CEventIndex::Expire( const time_t now, const size_t max_count, const t_event_handler & on_expired ) {
+    // the budget is shared evenly by the shards
+    const size_t shard_max_count = max_count / SHARD_COUNT + 1;
+    size_t processed_count = 0;
+    for ( auto & shard : m_shards ) {
+        std::unique_lock < std::shared_mutex > lock( shard.m_mutex );
+        const size_t timer_count = shard.m_timers.GetCount();
+        const size_t expired_count = shard.Expire( now, shard_max_count, on_expired );
+        processed_count += timer_count - shard.m_timers.GetCount();
+        m_count -= expired_count;
+        m_expired_count += expired_count;
+    }
+    return processed_count;
+}
+
+void CEventIndex::ForEach( const t_event_handler & handler ) const {
+    for ( size_t i = 0; i < SHARD_COUNT; i++ ) {
+        ForEachInShard( i, handler );
+    }
+}
+
+void CEventIndex::ForEachInShard( const size_t shard_index, const t_event_handler & handler ) const {
+    const auto & shard = m_shards[ shard_index ];
+    std::shared_lock < std::shared_mutex > lock( shard.m_mutex );
+    shard.m_events.ForEach( handler );
+}
+
+bool CEventIndex::GetOldestTimestamp( time_t & ts ) const {
+    bool bResult = false;
+    ts = 0;
+    for ( const auto & shard : m_shards ) {
+        std::shared_lock < std::shared_mutex > lock( shard.m_mutex );
+        if ( time_t time_key = 0; shard.m_time_counts.GetOldest( time_key ) ) {
+            const time_t shard_ts = time_key * SECONDS_PER_EVENT_BUCKET;
+            if ( !bResult || shard_ts < ts ) {
+                ts = shard_ts;
+            }
+            bResult = true;
+        }
+    }
+    return bResult;
+}
+
+size_t CEventIndex::GetCount() const {
+    return m_count;
+}
+
+size_t CEventIndex::GetExpiredCount() const {
+    return m_expired_count;
+}
+
+void CEventIndex::GetUsage( size_t & count, size_t & memory_usage ) const {
+    count = 0;
+    memory_usage = 0;
+    for ( const auto & shard : m_shards ) {
+        std::shared_lock < std::shared_mutex > lock( shard.m_mutex );
+        count += shard.m_events.GetCount();
+        memory_usage += shard.m_events.GetMemoryUsage() + shard.m_filter.capacity() + shard.m_timers.GetMemoryUsage();
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "common.h"
+#include "EventTable.h"
+#include "TimerWheel.h"
+
+//
+// Index of pending events (requests or early responses) keyed by X-Trace-ID.
+// Lookup cost does not depend on how many seconds of events are retained.
+// Events are sharded by trace key hash, every shard has its own lock, a hash table of events,
+// a counting Bloom filter to reject unknown IDs cheaply and a timer wheel for incremental expiration.
+//
+class CEventIndex {
+
+    public:
+
+        typedef std::function < void ( const CTraceKey & id, const CEventTable::CEvent & event ) > t_event_handler;
+
+    protected:
+
+        static constexpr size_t SHARD_COUNT = 16;
+        // filter counters per event
+        static constexpr size_t FILTER_COUNTERS_PER_EVENT = 8;
+        static constexpr size_t MIN_FILTER_SIZE = 1024;
+
+        // counts of stored events by event bucket time (a window starting from the oldest time)
+        class CTimeCounts {
+            protected:
+                std::deque < size_t > m_counts;
+                time_t m_first_time_key = 0;
+            public:
+                void Add( const time_t time_key );
+                void Remove( const time_t time_key );
+                bool GetOldest( time_t & time_key ) const;
+        };
+
+        class CShard {
+            public:
+                mutable std::shared_mutex m_mutex;
+                CEventTable m_events;
+                // saturating counters (a saturated counter is never decremented), size is a power of 2
+                std::vector < uint8_t > m_filter;
+                // expiration timers (timers of events removed before expiration are skipped when they fire)
+                CTimerWheel m_timers;
+                CTimeCounts m_time_counts;
+
+                bool MayContain( const uint64_t hash ) const;
+                void AddToFilter( const uint64_t hash );
+                void RemoveFromFilter( const uint64_t hash );
+                void RebuildFilter( const size_t size );
+                void Remove( const CTraceKey & id, const uint64_t hash, const time_t time_key );
+                size_t Expire( const time_t now, const size_t max_count, const t_event_handler & on_expired );
+        };
+
+        std::array < CShard, SHARD_COUNT > m_shards;
+        std::atomic < size_t > m_count = 0;
+        std::atomic < size_t > m_expired_count = 0;
+
+        static size_t GetShardIndex( const uint64_t hash );
+
+    public:
+
+        // adds an event expiring at the deadline specified, returns false (keeping the existing event) if the ID is already present
+        bool Push( const CTraceKey & id, const CEventTable::CEvent & event, const time_t deadline );
+
+        // finds an event by X-Trace-ID, returns false if not found
+        bool GetByID( const CTraceKey & id, CEventTable::CEvent & event ) const;
+
+        // finds and removes an event by X-Trace-ID, returns false if not found
+        bool Extract( const CTraceKey & id, CEventTable::CEvent & event );
+
+        // removes events with deadlines up to the time specified (inclusive) processing no more than max_count timers,
+        // calls the handler for every event removed, returns a count of timers processed
+        size_t Expire( const time_t now, const size_t max_count, const t_event_handler & on_expired = nullptr );
+
+        // calls the handler for every event stored (shard by shard, a shard is locked while its events are visited)
+        void ForEach( const t_event_handler & handler ) const;
+
+        // calls the handler for every event stored in a shard (so events may be visited in steps)
+        void ForEachInShard( const size_t shard_index, const t_event_handler & handler ) const;
+
+        // returns the index of the shard an ID is stored in
+        static size_t GetShardIndex( const CTraceKey & id );
+
+        // returns a count of shards
+        static constexpr size_t GetShardCount() {
+            return SHARD_COUNT;
+        }
+
+        // returns the oldest event bucket time or false if the index is empty
+        bool GetOldestTimestamp( time_t & ts ) const;
+
+        // returns a count of events stored
+        size_t GetCount() const;
+
+        // returns a count of events removed by expiration
+        size_t GetExpiredCount() const;
+
+        // returns a count of events stored and memory allocated for them in bytes
+        void GetUsage( size_t & count, size_t & memory_usage ) const;
+};
@@ -0,0 +1,116 @@
+#include "common.h"
+
+#include "EventTable.h"
+
+// initial count of slots (power of 2)
+constexpr size_t INITIAL_SLOT_COUNT = 64;
+
+static_assert( sizeof( CEventTable::CEvent ) <= 16 );
+
+bool CEventTable::CSlot::IsEmpty() const {
+    return m_format == CTraceKey::FORMAT_NONE;
+}
+
+bool CEventTable::CSlot::HasKey( const CTraceKey & key ) const {
+    return m_low == key.m_low && m_high == key.m_high && m_format == key.m_format;
+}
+
+CTraceKey CEventTable::CSlot::GetKey() const {
+    CTraceKey key;
+    key.m_high = m_high;
+    key.m_low = m_low;
+    key.m_format = m_format;
+    return key;
+}
+
+CEventTable::CEvent CEventTable::CSlot::GetEvent() const {
+    return { static_cast < time_t >( m_timestamp ), m_dimension, m_received_us };
+}
+
+size_t CEventTable::GetHomeIndex( const CTraceKey & key ) const {
+    return key.GetHash() & ( m_slots.size() - 1 );
+}
+
+// returns an index of the slot with the key or of the empty slot where the key should be placed
+size_t CEventTable::FindIndex( const CTraceKey & key ) const {
+    const size_t mask = m_slots.size() - 1;
+    size_t i = GetHomeIndex( key );
+    while ( !m_slots[ i ].IsEmpty() && !m_slots[ i ].HasKey( key ) ) {
+        i = ( i + 1 ) & mask;
+    }
+    return i;
+}
+
+// doubles the table size and rehashes all events
+void CEventTable::Grow() {
+    std::vector < CSlot > old_slots( std::max( m_slots.size() * 2, INITIAL_SLOT_COUNT ) );
+    old_slots.swap( m_slots );
+    for ( const auto & slot : old_slots ) {
+        if ( !slot.IsEmpty() ) {
+            m_slots[ FindIndex( slot.GetKey() ) ] = slot;
+        }
+    }
+}
+
+bool CEventTable::Insert( const CTraceKey & key, const CEvent & event ) {
+    // keep the load factor under 3/4
+    if ( ( m_count + 1 ) * 4 > m_slots.size() * 3 ) {
+        Grow();
+    }
+    CSlot & slot = m_slots[ FindIndex( key ) ];
+    if ( !slot.IsEmpty() ) {
+        return false;
+    }
+    slot.m_high = key.m_high;
+    slot.m_low = key.m_low;
+    slot.m_format = key.m_format;
+    slot.m_timestamp = static_cast < uint32_t >( event.m_timestamp );
+    slot.m_dimension = event.m_dimension;
+    slot.m_received_us = event.m_received_us;
+    m_count++;
+    return true;
+}
+
+bool CEventTable::Find( const CTraceKey & key, CEvent & event ) const {
+    if ( m_count == 0 ) {
+        return false;
+    }
+    const CSlot & slot = m_slots[ FindIndex( key ) ];
+    if ( slot.IsEmpty() ) {
+        return false;
+    }
+    event = slot.GetEvent();
+    return true;
+}
+
+bool CEventTable::Remove( const CTraceKey & key ) {
+    if ( m_count == 0 ) {
+        return false;
+    }
+    const size_t mask = m_slots.size() - 1;
+    size_t i = FindIndex( key );
+    if ( m_slots[ i ].IsEmpty() ) {
+        return false;
+    }
+    // shift following slots of the probe sequence back to keep it unbroken (no tombstones)
+    for ( size_t j = ( i + 1 ) & mask; !m_slots[ j ].IsEmpty(); j = ( j + 1 ) & mask ) {
+        const size_t home = GetHomeIndex( m_slots[ j ].GetKey() );
+        // the slot j can be moved to i if its home index is not in the cyclic range (i, j]
+        const bool bCanMove = ( i <= j ) ? ( home <= i || home > j ) : ( home <= i && home > j );
+        if ( bCanMove ) {
+            m_slots[ i ] = m_slots[ j ];
+            i = j;
+        }
+    }
+    m_slots[ i ] = CSlot();
+    m_count--;
+    return true;
+}
+
+size_t CEventTable::GetCount() const {
+    return m_count;
+}
+
+size_t CEventTable::GetMemoryUsage() const {
+    return m_slots.capacity() * sizeof( CSlot );
+}
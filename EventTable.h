@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include "TraceKey.h"
+#include "Dictionary.h"
+
+//
+// Flat open-addressing hash table of events keyed by trace keys (linear probing, backward shift deletion).
+// A slot is a 32-byte POD holding the packed trace key and the event data, there are no per-event heap allocations.
+// Not thread-safe.
+//
+class CEventTable {
+
+    public:
+
+        class CEvent {
+            public:
+                time_t m_timestamp = 0;
+                // request path or result code ID
+                CDictionary::t_id m_dimension = 0;
+                // steady clock time of receiving in microseconds (wrapping, only differences are meaningful)
+                uint32_t m_received_us = 0;
+        };
+
+    protected:
+
+        class CSlot {
+            public:
+                uint64_t m_high = 0;
+                uint64_t m_low = 0;
+                // seconds since the epoch fit 32 bits until 2106, keeping the slot in 32 bytes
+                uint32_t m_timestamp = 0;
+                CDictionary::t_id m_dimension = 0;
+                uint32_t m_received_us = 0;
+                // CTraceKey::FORMAT_NONE marks an empty slot
+                uint8_t m_format = CTraceKey::FORMAT_NONE;
+
+                bool IsEmpty() const;
+                bool HasKey( const CTraceKey & key ) const;
+                CTraceKey GetKey() const;
+                CEvent GetEvent() const;
+        };
+        static_assert( sizeof( CSlot ) == 32 );
+
+        std::vector < CSlot > m_slots;
+        size_t m_count = 0;
+
+        size_t GetHomeIndex( const CTraceKey & key ) const;
+        size_t FindIndex( const CTraceKey & key ) const;
+        void Grow();
+
+    public:
+
+        // adds an event, returns false (keeping the existing event) if the key is already present
+        bool Insert( const CTraceKey & key, const CEvent & event );
+
+        // finds an event by key, returns false if not found
+        bool Find( const CTraceKey & key, CEvent & event ) const;
+
+        // removes an event by key, returns false if not found
+        bool Remove( const CTraceKey & key );
+
+        // calls the function for every event stored
+        template < typename F > void ForEach( F && f ) const {
+            for ( const auto & slot : m_slots ) {
+                if ( !slot.IsEmpty() ) {
+                    f( slot.GetKey(), slot.GetEvent() );
+                }
+            }
+        }
+
+        // returns a count of events stored
+        size_t GetCount() const;
+
+        // returns memory allocated by the table in bytes
+        size_t GetMemoryUsage() const;
+};
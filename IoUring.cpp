@@ -0,0 +1,208 @@
+#include "common.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "IoUring.h"
+
+namespace {
+
+    int SetupRing( const unsigned entries, io_uring_params & params ) {
+        return static_cast < int >( syscall( __NR_io_uring_setup, entries, &params ) );
+    }
+
+    int EnterRing( const int fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags ) {
+        return static_cast < int >( syscall( __NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0 ) );
+    }
+
+    int RegisterRing( const int fd, const unsigned opcode, const void * arg, const unsigned arg_count ) {
+        return static_cast < int >( syscall( __NR_io_uring_register, fd, opcode, arg, arg_count ) );
+    }
+
+    // ring indexes are shared with the kernel
+    unsigned LoadAcquire( unsigned * p ) {
+        return std::atomic_ref < unsigned >( *p ).load( std::memory_order_acquire );
+    }
+
+    void StoreRelease( unsigned * p, const unsigned value ) {
+        std::atomic_ref < unsigned >( *p ).store( value, std::memory_order_release );
+    }
+
+    template < typename T > T * RingField( void * ring, const unsigned offset ) {
+        return reinterpret_cast < T * >( static_cast < char * >( ring ) + offset );
+    }
+
+}
+
+CIoUring::~CIoUring() {
+    Close();
+}
+
+void CIoUring::Close() {
+    if ( m_sqes ) {
+        munmap( m_sqes, m_sqes_size );
+    }
+    if ( m_cq_ring && m_cq_ring != m_sq_ring ) {
+        munmap( m_cq_ring, m_cq_ring_size );
+    }
+    if ( m_sq_ring ) {
+        munmap( m_sq_ring, m_sq_ring_size );
+    }
+    if ( m_fd >= 0 ) {
+        // requests still in flight are cancelled
+        close( m_fd );
+    }
+    m_sqes = nullptr;
+    m_cq_ring = m_sq_ring = nullptr;
+    m_fd = -1;
+}
+
+bool CIoUring::Init( const unsigned entries ) {
+    io_uring_params params {};
+    m_fd = SetupRing( entries, params );
+    if ( m_fd < 0 ) {
+        // not supported by the kernel or disabled (ENOSYS, EPERM)
+        return false;
+    }
+    // reads at the current file position are supported since 5.6 along with other features required
+    if ( !( params.features & IORING_FEAT_RW_CUR_POS ) ) {
+        Close();
+        return false;
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    const bool bSingleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if ( bSingleMap ) {
+        m_sq_ring_size = m_cq_ring_size = std::max( m_sq_ring_size, m_cq_ring_size );
+    }
+    m_sq_ring = mmap( nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING );
+    if ( m_sq_ring == MAP_FAILED ) {
+        m_sq_ring = nullptr;
+        Close();
+        return false;
+    }
+    if ( bSingleMap ) {
+        m_cq_ring = m_sq_ring;
+    } else {
+        m_cq_ring = mmap( nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING );
+        if ( m_cq_ring == MAP_FAILED ) {
+            m_cq_ring = nullptr;
+            Close();
+            return false;
+        }
+    }
+    m_sqes_size = params.sq_entries * sizeof( io_uring_sqe );
+    void * sqes = mmap( nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES );
+    if ( sqes == MAP_FAILED ) {
+        Close();
+        return false;
+    }
+    m_sqes = static_cast < io_uring_sqe * >( sqes );
+
+    m_sq_head = RingField < unsigned >( m_sq_ring, params.sq_off.head );
+    m_sq_tail = RingField < unsigned >( m_sq_ring, params.sq_off.tail );
+    m_sq_mask = *RingField < unsigned >( m_sq_ring, params.sq_off.ring_mask );
+    m_sq_entries = params.sq_entries;
+    m_sq_array = RingField < unsigned >( m_sq_ring, params.sq_off.array );
+
+    m_cq_head = RingField < unsigned >( m_cq_ring, params.cq_off.head );
+    m_cq_tail = RingField < unsigned >( m_cq_ring, params.cq_off.tail );
+    m_cq_mask = *RingField < unsigned >( m_cq_ring, params.cq_off.ring_mask );
+    m_cqes = RingField < io_uring_cqe >( m_cq_ring, params.cq_off.cqes );
+
+    return true;
+}
+
+bool CIoUring::RegisterBuffers( const std::vector < iovec > & buffers ) {
+    return RegisterRing( m_fd, IORING_REGISTER_BUFFERS, buffers.data(), static_cast < unsigned >( buffers.size() ) ) == 0;
+}
+
+// returns a zeroed submission entry at the ring tail, the caller must check for free entries first
+io_uring_sqe * CIoUring::PrepareRequest( const uint8_t opcode, const int fd, const uint64_t user_data ) {
+    const unsigned tail = *m_sq_tail;
+    const unsigned index = tail & m_sq_mask;
+    io_uring_sqe * sqe = &m_sqes[ index ];
+    memset( sqe, 0, sizeof( *sqe ) );
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    m_sq_array[ index ] = index;
+    StoreRelease( m_sq_tail, tail + 1 );
+    m_prepared++;
+    return sqe;
+}
+
+void CIoUring::PrepareRead( const int fd, void * data, const unsigned size, const int buf_index, const uint64_t user_data, const bool bLinked ) {
+    io_uring_sqe * sqe = PrepareRequest( buf_index >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ, fd, user_data );
+    sqe->addr = reinterpret_cast < uint64_t >( data );
+    sqe->len = size;
+    // the current file position, reads of pipes and files alike
+    sqe->off = static_cast < uint64_t >( -1 );
+    if ( buf_index >= 0 ) {
+        sqe->buf_index = static_cast < uint16_t >( buf_index );
+    }
+    // a hard link keeps the order even after a short read (a soft link would cancel the rest of the chain)
+    if ( bLinked ) {
+        sqe->flags |= IOSQE_IO_HARDLINK;
+    }
+}
+
+void CIoUring::PrepareWrite( const int fd, const void * data, const unsigned size, const uint64_t offset, const uint64_t user_data ) {
+    io_uring_sqe * sqe = PrepareRequest( IORING_OP_WRITE, fd, user_data );
+    sqe->addr = reinterpret_cast < uint64_t >( data );
+    sqe->len = size;
+    sqe->off = offset;
+}
+
+bool CIoUring::Submit( const unsigned wait_count ) {
+    while ( m_prepared > 0 || wait_count > 0 ) {
+        const int result = EnterRing( m_fd, m_prepared, wait_count, wait_count > 0 ? IORING_ENTER_GETEVENTS : 0 );
+        if ( result < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return false;
+        }
+        m_prepared -= result;
+        m_in_flight += result;
+        if ( m_prepared == 0 ) {
+            break;
+        }
+    }
+    return true;
+}
+
+bool CIoUring::PeekCompletion( CCompletion & completion ) {
+    const unsigned head = *m_cq_head;
+    if ( head == LoadAcquire( m_cq_tail ) ) {
+        return false;
+    }
+    const io_uring_cqe & cqe = m_cqes[ head & m_cq_mask ];
+    completion.user_data = cqe.user_data;
+    completion.result = cqe.res;
+    StoreRelease( m_cq_head, head + 1 );
+    m_in_flight--;
+    return true;
+}
+
+bool CIoUring::WaitCompletion( CCompletion & completion ) {
+    while ( !PeekCompletion( completion ) ) {
+        if ( m_in_flight + m_prepared == 0 || !Submit( 1 ) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned CIoUring::GetFreeCount() const {
+    return m_sq_entries - ( *m_sq_tail - LoadAcquire( m_sq_head ) );
+}
+
+unsigned CIoUring::GetInFlightCount() const {
+    return m_in_flight;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "common.h"
+
+#include <sys/uio.h>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+//
+// Minimal Linux io_uring instance set up with raw system calls (liburing is not required): the submission and
+// completion rings are mapped into memory, requests are prepared in the submission ring and submitted in batches,
+// completions are reaped from the completion ring without system calls. An instance is used by one thread.
+//
+class CIoUring {
+
+    public:
+
+        class CCompletion {
+            public:
+                uint64_t user_data = 0;
+                // count of bytes transferred or -errno
+                int32_t result = 0;
+        };
+
+    protected:
+
+        int m_fd = -1;
+
+        // mapped rings
+        void * m_sq_ring = nullptr;
+        size_t m_sq_ring_size = 0;
+        void * m_cq_ring = nullptr;
+        size_t m_cq_ring_size = 0;
+        io_uring_sqe * m_sqes = nullptr;
+        size_t m_sqes_size = 0;
+
+        // submission ring fields
+        unsigned * m_sq_head = nullptr;
+        unsigned * m_sq_tail = nullptr;
+        unsigned m_sq_mask = 0;
+        unsigned m_sq_entries = 0;
+        unsigned * m_sq_array = nullptr;
+
+        // completion ring fields
+        unsigned * m_cq_head = nullptr;
+        unsigned * m_cq_tail = nullptr;
+        unsigned m_cq_mask = 0;
+        io_uring_cqe * m_cqes = nullptr;
+
+        // count of requests prepared and not submitted yet
+        unsigned m_prepared = 0;
+        // count of requests submitted and not completed yet
+        unsigned m_in_flight = 0;
+
+        io_uring_sqe * PrepareRequest( const uint8_t opcode, const int fd, const uint64_t user_data );
+        void Close();
+
+    public:
+
+        CIoUring() = default;
+        CIoUring( const CIoUring & ) = delete;
+        CIoUring & operator=( const CIoUring & ) = delete;
+        ~CIoUring();
+
+        // sets up rings for the count of requests specified, returns false if io_uring is not available
+        bool Init( const unsigned entries );
+
+        // registers buffers for fixed reads, returns false if they cannot be pinned (plain reads are used then)
+        bool RegisterBuffers( const std::vector < iovec > & buffers );
+
+        // prepares a read at the current file position into the registered buffer specified (or into the memory if buf_index < 0);
+        // bLinked orders the read before the next request prepared (the order is kept whatever the result is)
+        void PrepareRead( const int fd, void * data, const unsigned size, const int buf_index, const uint64_t user_data, const bool bLinked );
+
+        // prepares a write at the file offset specified
+        void PrepareWrite( const int fd, const void * data, const unsigned size, const uint64_t offset, const uint64_t user_data );
+
+        // submits prepared requests and waits until at least wait_count completions are available, returns false on errors
+        bool Submit( const unsigned wait_count = 0 );
+
+        // returns the next completion if there is one
+        bool PeekCompletion( CCompletion & completion );
+
+        // submits prepared requests if any and waits for the next completion, returns false if nothing is in flight
+        bool WaitCompletion( CCompletion & completion );
+
+        // returns the count of free submission entries
+        unsigned GetFreeCount() const;
+
+        // returns the count of requests submitted and not completed yet
+        unsigned GetInFlightCount() const;
+};
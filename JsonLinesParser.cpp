@@ -0,0 +1,143 @@
+#include "common.h"
+
+#include <cstring>
+
+#include "JsonLinesParser.h"
+
+namespace {
+
+    bool IsSpace( const char c ) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    const char * SkipSpaces( const char * p, const char * end ) {
+        while ( p < end && IsSpace( *p ) ) {
+            p++;
+        }
+        return p;
+    }
+
+    // returns a pointer past the closing quote of the string starting at p (at the opening quote)
+    const char * SkipString( const char * p, const char * end ) {
+        for ( p++; p < end; p++ ) {
+            if ( *p == '\\' ) {
+                p++;
+            } else if ( *p == '"' ) {
+                return p + 1;
+            }
+        }
+        return end;
+    }
+
+    // returns a pointer past the value starting at p, stores a string value without quotes or a scalar value as it is
+    // (objects and arrays are skipped, their value is empty)
+    const char * ParseValue( const char * p, const char * end, std::string_view & value ) {
+        if ( *p == '"' ) {
+            const char * value_end = SkipString( p, end );
+            value = std::string_view( p + 1, value_end > p + 1 && value_end[ -1 ] == '"' ? value_end - 1 : value_end );
+            return value_end;
+        }
+        if ( *p == '{' || *p == '[' ) {
+            unsigned int depth = 0;
+            while ( p < end ) {
+                if ( *p == '"' ) {
+                    p = SkipString( p, end );
+                    continue;
+                }
+                if ( *p == '{' || *p == '[' ) {
+                    depth++;
+                } else if ( ( *p == '}' || *p == ']' ) && --depth == 0 ) {
+                    return p + 1;
+                }
+                p++;
+            }
+            return end;
+        }
+        const char * value_start = p;
+        while ( p < end && *p != ',' && *p != '}' && *p != ']' && !IsSpace( *p ) ) {
+            p++;
+        }
+        value = std::string_view( value_start, p );
+        return p;
+    }
+
+}
+
+const char * CJsonLinesParser::GetFormatName() {
+    return "json";
+}
+
+size_t CJsonLinesParser::FindEventsEnd( const char * data, const size_t event_start, size_t & frame_pos, const size_t size ) {
+    const size_t search_start = std::max( event_start, frame_pos );
+    frame_pos = size;
+    if ( search_start >= size ) {
+        return 0;
+    }
+    const void * found = memrchr( data + search_start, '\n', size - search_start );
+    return found ? static_cast < const char * >( found ) - data + 1 : 0;
+}
+
+// takes the trace ID and the path or the status from the top level members of the object on the line
+void CJsonLinesParser::ParseLine( const char * p, const char * end, CEvent & event ) {
+    p = SkipSpaces( p, end );
+    if ( p == end || *p != '{' ) {
+        return;
+    }
+    p++;
+    while ( true ) {
+        p = SkipSpaces( p, end );
+        if ( p < end && *p == ',' ) {
+            p++;
+            continue;
+        }
+        if ( p == end || *p != '"' ) {
+            // the object end or malformed input
+            return;
+        }
+        const char * key_start = p + 1;
+        p = SkipString( p, end );
+        const std::string_view key( key_start, p > key_start ? p - 1 : key_start );
+        p = SkipSpaces( p, end );
+        if ( p == end || *p != ':' ) {
+            return;
+        }
+        p = SkipSpaces( p + 1, end );
+        if ( p == end ) {
+            return;
+        }
+        std::string_view value;
+        p = ParseValue( p, end, value );
+        if ( key == "trace_id" ) {
+            event.trace_id = value;
+        } else if ( key == "path" ) {
+            event.value = value;
+            event.bIsResponse = false;
+        } else if ( key == "status" ) {
+            event.value = value;
+            event.bIsResponse = true;
+        }
+    }
+}
+
+const CJsonLinesParser::t_events & CJsonLinesParser::Parse( const std::string_view data, const bool /* bFastParse */ ) {
+
+    m_events.clear();
+    const char * p = data.data();
+    const char * const end = p + data.size();
+
+    while ( p < end ) {
+        const void * found = memchr( p, '\n', end - p );
+        const char * line_end = found ? static_cast < const char * >( found ) : end;
+        // blank lines are not events
+        if ( SkipSpaces( p, line_end ) < line_end ) {
+            CEvent & event = m_events.emplace_back();
+            ParseLine( p, line_end, event );
+#ifdef _DEBUG
+            event.message = std::string_view( p, line_end );
+#endif // _DEBUG
+        }
+        p = found ? line_end + 1 : end;
+    }
+
+    return m_events;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.h"
+#include "MessageParser.h"
+
+//
+// Implements parsing of events received as JSON lines, one object per line:
+//   {"trace_id":"...","path":"/users/1"} is a request, {"trace_id":"...","status":200} is a response.
+// Only top level members are looked at, others (nested objects and arrays included) are skipped without being decoded.
+// Strings are not unescaped: a trace ID or a path with escape sequences is used as it is written.
+// Parsed events refer to the buffer parsed.
+//
+class CJsonLinesParser {
+
+    public:
+
+        typedef CMessageParser::CEvent CEvent;
+        typedef CMessageParser::t_events t_events;
+
+    protected:
+
+        // events parsed from the last buffer (storage is reused between calls)
+        t_events m_events;
+
+        static void ParseLine( const char * p, const char * end, CEvent & event );
+
+    public:
+
+        // parses all events in the buffer, returned events are valid until the next call (there is no fast mode)
+        const t_events & Parse( const std::string_view data, const bool bFastParse = false );
+
+        // returns the offset past the last complete line in data[ event_start, size ),
+        // frame_pos is the offset the previous search stopped at (updated)
+        static size_t FindEventsEnd( const char * data, const size_t event_start, size_t & frame_pos, const size_t size );
+
+        static const char * GetFormatName();
+};
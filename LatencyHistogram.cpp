@@ -0,0 +1,60 @@
+#include "common.h"
+
+#include "LatencyHistogram.h"
+
+unsigned int CLatencyHistogram::GetBucketIndex( const uint32_t value ) {
+    if ( value < SUB_BUCKET_COUNT ) {
+        return value;
+    }
+    // the position of the leading one selects the range, the next SUB_BUCKET_BITS bits select the sub-bucket
+    const unsigned int exponent = std::bit_width( value ) - 1;
+    const unsigned int shift = exponent - SUB_BUCKET_BITS;
+    return SUB_BUCKET_COUNT + shift * SUB_BUCKET_COUNT + ( ( value >> shift ) & ( SUB_BUCKET_COUNT - 1 ) );
+}
+
+uint32_t CLatencyHistogram::GetBucketValue( const unsigned int index ) {
+    if ( index < SUB_BUCKET_COUNT ) {
+        return index;
+    }
+    const unsigned int shift = ( index - SUB_BUCKET_COUNT ) / SUB_BUCKET_COUNT;
+    const uint64_t low = static_cast < uint64_t >( SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT ) << shift;
+    return static_cast < uint32_t >( low + ( ( uint64_t( 1 ) << shift ) >> 1 ) );
+}
+
+void CLatencyHistogram::Add( const uint32_t value_us, const uint64_t weight ) {
+    m_counts[ GetBucketIndex( value_us ) ] += weight;
+    m_total += weight;
+    m_max = std::max( m_max, value_us );
+}
+
+void CLatencyHistogram::Merge( const CLatencyHistogram & other ) {
+    for ( unsigned int i = 0; i < BUCKET_COUNT; i++ ) {
+        m_counts[ i ] += other.m_counts[ i ];
+    }
+    m_total += other.m_total;
+    m_max = std::max( m_max, other.m_max );
+}
+
+void CLatencyHistogram::AddBucket( const unsigned int index, const uint64_t count, const uint32_t max_us ) {
+    if ( index < BUCKET_COUNT ) {
+        m_counts[ index ] += count;
+        m_total += count;
+    }
+    m_max = std::max( m_max, max_us );
+}
+
+uint32_t CLatencyHistogram::GetPercentile( const double fraction ) const {
+    const auto rank = static_cast < long long unsigned int >( std::ceil( fraction * m_total ) );
+    long long unsigned int count = 0;
+    for ( unsigned int i = 0; i < BUCKET_COUNT; i++ ) {
+        count += m_counts[ i ];
+        if ( count >= rank && count > 0 ) {
+            return std::min( GetBucketValue( i ), m_max );
+        }
+    }
+    return m_max;
+}
+
+uint32_t CLatencyHistogram::GetMax() const {
+    return m_max;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "common.h"
+
+//
+// Fixed-size log-linear histogram of latencies in microseconds (HdrHistogram-style): values below 2^SUB_BUCKET_BITS
+// are counted exactly, every further power of two range is split into 2^SUB_BUCKET_BITS linear sub-buckets,
+// so a value is recorded with a relative error below 1 / 2^SUB_BUCKET_BITS. Recording is a few bit operations.
+// Histograms are mergeable by adding counters.
+//
+class CLatencyHistogram {
+
+    public:
+
+        static constexpr unsigned int SUB_BUCKET_BITS = 4;
+        static constexpr unsigned int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+        // values up to 2^32 - 1 microseconds (over an hour)
+        static constexpr unsigned int BUCKET_COUNT = SUB_BUCKET_COUNT + ( 32 - SUB_BUCKET_BITS ) * SUB_BUCKET_COUNT;
+
+    protected:
+
+        std::array < uint64_t, BUCKET_COUNT > m_counts {};
+        long long unsigned int m_total = 0;
+        uint32_t m_max = 0;
+
+        static unsigned int GetBucketIndex( const uint32_t value );
+        static uint32_t GetBucketValue( const unsigned int index );
+
+    public:
+
+        // records a value with the weight specified
+        void Add( const uint32_t value_us, const uint64_t weight );
+
+        void Merge( const CLatencyHistogram & other );
+
+        // calls handler( bucket index, count ) for every non-empty bucket
+        template < typename F > void ForEachBucket( F handler ) const {
+            for ( unsigned int i = 0; i < BUCKET_COUNT; i++ ) {
+                if ( m_counts[ i ] != 0 ) {
+                    handler( i, m_counts[ i ] );
+                }
+            }
+        }
+
+        // adds a count to a bucket and raises the maximum (restores a histogram saved bucket by bucket)
+        void AddBucket( const unsigned int index, const uint64_t count, const uint32_t max_us );
+
+        // returns the value below which the fraction specified of recorded values are (the middle of the bucket)
+        uint32_t GetPercentile( const double fraction ) const;
+
+        uint32_t GetMax() const;
+};
+typedef std::unique_ptr < CLatencyHistogram > PLatencyHistogram;
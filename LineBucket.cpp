@@ -2,7 +2,7 @@
 
 #include "LineBucket.h"
 
-CLineBucket::CLineBucket( const time_t ts ) : m_timestamp( ts ) {
+CLineBucket::CLineBucket( const time_t ts, const unsigned int source ) : m_timestamp( ts ), m_source( source ) {
 #ifdef DEBUG_MEMORY_CONSUMPTION
     std::cout << m_timestamp << " CLineBucket()" << std::endl;
 #endif // DEBUG_MEMORY_CONSUMPTION
@@ -14,18 +14,92 @@ CLineBucket::~CLineBucket() {
 #endif // DEBUG_MEMORY_CONSUMPTION
 }
 
-void CLineBucket::Push( const std::string & line ) {
-    m_lines.push_back( line );
+void CLineBucket::Push( const PSlab & slab, const std::string_view events, const uint32_t received_us ) {
+    if (
+        m_segments.size() > m_submitted_segment_count
+        &&
+        m_segments.back().m_slab == slab
+        &&
+        m_segments.back().m_data.data() + m_segments.back().m_data.size() == events.data()
+    ) {
+        auto & last = m_segments.back();
+        // receive times wrap, the difference is unsigned
+        const uint32_t last_received_us = last.m_later_marks.empty() ? last.m_received_us : last.m_later_marks.back().m_received_us;
+        if ( received_us - last_received_us >= RECEIVE_MARK_US ) {
+            last.m_later_marks.push_back( { last.m_data.size(), received_us } );
+        }
+        last.m_data = std::string_view( last.m_data.data(), last.m_data.size() + events.size() );
+    } else {
+        m_segments.push_back( { slab, events, received_us, {} } );
+    }
 }
 
-unsigned int CLineBucket::GetCount() const {
-    return m_lines.size();
+bool CLineBucket::HasUnsubmittedSegments() const {
+    return m_submitted_segment_count < m_segments.size();
 }
 
-const std::string & CLineBucket::GetItem( const unsigned int n ) const {
-    return m_lines[ n ];
+CLineBucket::CSegment CLineBucket::SubmitSegment( const unsigned int batch_count ) {
+    // batches are registered before they can be joined, so the count cannot drop to zero prematurely
+    m_unjoined_batch_count += batch_count;
+    return std::move( m_segments[ m_submitted_segment_count++ ] );
+}
+
+void CLineBucket::ReleaseBatches( const unsigned int count ) {
+    if ( m_unjoined_batch_count.fetch_sub( count ) == count ) {
+        m_bJoined = true;
+    }
+}
+
+void CLineBucket::Seal() {
+    ReleaseBatches( 1 );
+}
+
+void CLineBucket::MarkBatchJoined() {
+    ReleaseBatches( 1 );
+}
+
+bool CLineBucket::IsJoined() const {
+    return m_bJoined;
 }
 
 time_t CLineBucket::GetTimestamp() const {
     return m_timestamp;
 }
+
+unsigned int CLineBucket::GetSource() const {
+    return m_source;
+}
+
+void CLineBucket::SetFastParse( const bool bFastParse ) {
+    m_bFastParse = bFastParse;
+}
+
+bool CLineBucket::IsFastParse() const {
+    return m_bFastParse;
+}
+
+void CLineBuckets::Add( const PLineBucket & bucket ) {
+    std::lock_guard < std::mutex > lock( m_mutex );
+    m_buckets.push_back( bucket );
+    if ( m_buckets.size() == 1 ) {
+        m_oldest_timestamp = bucket->GetTimestamp();
+    }
+}
+
+void CLineBuckets::RemoveJoined() {
+    std::lock_guard < std::mutex > lock( m_mutex );
+    while ( !m_buckets.empty() && m_buckets.front()->IsJoined() ) {
+        m_buckets.pop_front();
+    }
+    m_oldest_timestamp = m_buckets.empty() ? NO_TIMESTAMP : m_buckets.front()->GetTimestamp();
+}
+
+size_t CLineBuckets::GetCount() {
+    std::lock_guard < std::mutex > lock( m_mutex );
+    return m_buckets.size();
+}
+
+bool CLineBuckets::GetOldestTimestamp( time_t & ts ) const {
+    ts = m_oldest_timestamp;
+    return ts != NO_TIMESTAMP;
+}
@@ -1,42 +1,133 @@
 #pragma once
 
-#include "TimeKeyedCollection.h"
+#include "Slab.h"
 
 //
-// A bucket of unprocessed lines received from the input stream in a specified epoch second.
+// A bucket of unprocessed input received from one input source in a specified epoch second.
+// Input is stored as segments: views into input slabs, each holding one or more whole events (lines separated by LF,
+// events separated by an empty line). A segment keeps its slab alive until the segment is parsed.
+// Segments may be submitted for parsing while the bucket is still being filled, the bucket is joined when it is sealed
+// and all batches of its submitted segments are joined.
 // Interface is separated from the implementation (std::vector) to allow for easy replacement of the underlying storage/line supplier.
 //
 class CLineBucket {
 
+    public:
+
+        // receive time of the events from an offset in the segment data on
+        class CReceiveMark {
+            public:
+                size_t m_offset = 0;
+                uint32_t m_received_us = 0;
+        };
+
+        class CSegment {
+            public:
+                PSlab m_slab;
+                std::string_view m_data;
+                // steady clock time of receiving the events in microseconds (wrapping)
+                uint32_t m_received_us = 0;
+                // receive times of events appended to the segment later (empty while they are received within RECEIVE_MARK_US)
+                std::vector < CReceiveMark > m_later_marks;
+        };
+
+        // granularity of receive times of events appended to a segment
+        static constexpr uint32_t RECEIVE_MARK_US = 1000;
+
     private:
 
-        typedef std::vector < std::string > t_lines;
-        t_lines m_lines;
+        typedef std::vector < CSegment > t_segments;
+        t_segments m_segments;
         time_t m_timestamp = 0;
+        // index of the input source the input is received from
+        unsigned int m_source = 0;
+
+        // count of segments submitted for parsing
+        unsigned int m_submitted_segment_count = 0;
+        // count of submitted event batches not joined yet plus one until the bucket is sealed
+        // (every segment is split into one batch per aggregation partition)
+        std::atomic < unsigned int > m_unjoined_batch_count = 1;
+        // set when events of all segments are joined
+        std::atomic < bool > m_bJoined = false;
+        // events of the bucket are parsed in the fast mode (set before submitting segments)
+        bool m_bFastParse = false;
+
+        void ReleaseBatches( const unsigned int count );
 
     public:
 
         CLineBucket() = delete;
-        explicit CLineBucket( const time_t ts );
+        CLineBucket( const time_t ts, const unsigned int source );
         ~CLineBucket();
 
-        // stores a line
-        void Push( const std::string & line );
+        // stores whole events located in the slab specified, appends them to the last segment if they are adjacent
+        // and the last segment is not submitted yet (marking their receive time if it differs by RECEIVE_MARK_US or more)
+        void Push( const PSlab & slab, const std::string_view events, const uint32_t received_us );
 
-        // returns a count of lines
-        unsigned int GetCount() const;
+        // returns true if there are segments not submitted for parsing
+        bool HasUnsubmittedSegments() const;
 
-        // returns a line by index
-        const std::string & GetItem( const unsigned int n ) const;
+        // returns the next segment not submitted for parsing (the bucket drops its slab reference)
+        // and registers the count of batches it will be joined as
+        CSegment SubmitSegment( const unsigned int batch_count );
+
+        // marks that no more segments will be submitted (called by the reader only)
+        void Seal();
+
+        // marks one more event batch as joined
+        void MarkBatchJoined();
+
+        // returns true if events of all segments are joined
+        bool IsJoined() const;
 
         // returns the timestamp of the bucket
         time_t GetTimestamp() const;
+
+        // returns the index of the input source of the bucket
+        unsigned int GetSource() const;
+
+        // selects the fast parsing mode for the events of the bucket
+        void SetFastParse( const bool bFastParse );
+        bool IsFastParse() const;
 };
 
 typedef std::shared_ptr < CLineBucket > PLineBucket;
 
 //
-// Collection of line buckets keyed by time of receival (epoch second)
+// A reference to one segment of a line bucket (a unit of parsing work)
 //
-class CLineBuckets : public CTimeKeyedCollection < CLineBucket > {
+class CSegmentRef {
+    public:
+        PLineBucket m_bucket;
+        CLineBucket::CSegment m_segment;
+};
+
+//
+// Line buckets in flight (from the start of filling until their events are joined) in the order of creation.
+// The oldest unjoined time is published atomically and can be read without locking.
+//
+class CLineBuckets {
+
+    private:
+
+        std::deque < PLineBucket > m_buckets;
+        std::mutex m_mutex;
+        // timestamp of the oldest bucket in flight or NO_TIMESTAMP
+        std::atomic < time_t > m_oldest_timestamp = NO_TIMESTAMP;
+
+    public:
+
+        static constexpr time_t NO_TIMESTAMP = -1;
+
+        // registers a new bucket (buckets are added in the order of their timestamps, buckets of different sources may have the same one)
+        void Add( const PLineBucket & bucket );
+
+        // drops buckets joined completely from the head of the queue, updates the oldest timestamp
+        void RemoveJoined();
+
+        // returns the count of buckets in flight
+        size_t GetCount();
+
+        // returns the timestamp of the oldest bucket in flight or false if there are none (lock-free)
+        bool GetOldestTimestamp( time_t & ts ) const;
 };
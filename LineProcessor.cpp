@@ -2,55 +2,76 @@
 
 #include "LineProcessor.h"
 
-#include "MessageParser.h"
-
-CMessageParser mp;
-
-CLineProcessor::CLineProcessor( PContext context )
+template < MessageParser TParser >
+CLineProcessor < TParser >::CLineProcessor( PContext context )
     : m_context( std::move( context ) )
+    , m_metrics( m_context->metrics.Register( CThreadMetrics::STAGE_PARSER ) )
 {
 }
 
-// processes one line bucket
-void CLineProcessor::ParseLineBucket( const PLineBucket & bucket ) {
-
-    m_context->DEBUG_OUTPUT && std::cout << to_stream( bucket->GetTimestamp() ) << " start parsing lines" << std::endl;
-
-    unsigned int line_count = bucket->GetCount();
-    for ( unsigned int i = 0; i < line_count; i++ ) {
-        mp.ProcessLine( bucket->GetItem( i ) );
-        if ( mp.IsDone() ) {
-            if ( mp.IsResponse() ) {
-                m_context->response_map.Push( bucket->GetTimestamp(), mp.GetTraceID(), mp.GetResultCode() );
-            } else {
-                m_context->request_map.Push( bucket->GetTimestamp(), mp.GetTraceID(), mp.GetRequestPath() );
+// parses one segment of a line bucket into a batch per partition (every partition gets a batch, even an empty one)
+template < MessageParser TParser >
+void CLineProcessor < TParser >::ParseSegment( const CSegmentRef & segment ) {
+    CBusyTimer busy_timer( m_metrics.busy_ns );
+    const auto & bucket = segment.m_bucket;
+    m_batches.resize( m_context->partitions.size() );
+    for ( auto & batch : m_batches ) {
+        batch = std::make_unique < CEventBatch >();
+        batch->m_bucket = bucket;
+    }
+    // traces out of the sample are dropped before their values are looked up
+    const unsigned int request_shift = m_context->sampler.GetRequestShift( bucket->GetTimestamp() );
+    const unsigned int response_shift = m_context->sampler.GetResponseShift( bucket->GetTimestamp() );
+    const auto & data = segment.m_segment.m_data;
+    const auto & events = m_parser.Parse( data, bucket->IsFastParse() );
+    size_t response_count = 0;
+    size_t error_count = 0;
+    // events are parsed in order, so receive marks are passed once
+    const auto & marks = segment.m_segment.m_later_marks;
+    size_t mark_index = 0;
+    uint32_t received_us = segment.m_segment.m_received_us;
+    for ( const auto & event : events ) {
+        if ( mark_index < marks.size() ) {
+            // fields are views into the data, a field of the event locates it
+            const char * position = event.trace_id.empty() ? event.value.data() : event.trace_id.data();
+            while ( mark_index < marks.size() && position >= data.data() + marks[ mark_index ].m_offset && position < data.data() + data.size() ) {
+                received_us = marks[ mark_index++ ].m_received_us;
             }
         }
+        response_count += event.bIsResponse;
+        error_count += event.trace_id.empty() || event.value.empty();
+        const CTraceKey id( event.trace_id );
+        if ( !CSampler::IsSampled( id, event.bIsResponse ? response_shift : request_shift ) ) {
+            continue;
+        }
+        auto & batch = m_batches[ CAggregationPartition::GetIndex( id, m_batches.size() ) ];
+        if ( event.bIsResponse ) {
+            batch->m_responses.push_back( { id, { bucket->GetTimestamp(), m_context->result_codes.GetID( event.value ), received_us } } );
+        } else {
+            const auto path = m_context->path_normalizer.Normalize( event.value, m_path_buffer );
+            batch->m_requests.push_back( { id, { bucket->GetTimestamp(), m_context->request_paths.GetID( path ), received_us } } );
+        }
     }
-
-    m_context->DEBUG_OUTPUT && std::cout << to_stream( bucket->GetTimestamp() ) << " end parsing lines" << std::endl;
-
-}
-
-// processes all collected line buckets
-void CLineProcessor::ProcessLineBuckets() {
-    PLineBucket bucket;
-    while ( m_context->ready_line_buckets.GetOldestItem( bucket ) ) {
-        ParseLineBucket( bucket );
-        m_context->response_map.NotifyDataAvailable();
-        m_context->ready_line_buckets.RemoveItem( bucket );
-    }
+    m_metrics.segments.Add( 1 );
+    m_metrics.requests.Add( events.size() - response_count );
+    m_metrics.responses.Add( response_count );
+    m_metrics.parse_errors.Add( error_count );
 }
 
-void CLineProcessor::Run( const std::stop_token & stoken, const PContext & context ) {
-    while ( true ) {
-        context->ready_line_buckets.WaitForData( 100 );
-        //std::this_thread::sleep_for( std::chrono::seconds( 2 ) );
-        if ( stoken.stop_requested() && context->ready_line_buckets.IsEmpty() ) {
-            // terminate if requested and there are no data left to process
-            break;
+template < MessageParser TParser >
+void CLineProcessor < TParser >::Run( const std::stop_token &, const PContext & context ) {
+    CLineProcessor < TParser > lp( context );
+    CSegmentRef segment;
+    while ( context->segment_channel->Pop( segment ) ) {
+        context->DEBUG_OUTPUT && std::cout << to_stream( segment.m_bucket->GetTimestamp() ) << " parsing segment of " << segment.m_segment.m_data.size() << " bytes from source " << segment.m_bucket->GetSource() << std::endl;
+        lp.ParseSegment( segment );
+        segment = {};
+        for ( size_t i = 0; i < lp.m_batches.size(); i++ ) {
+            context->partitions[ i ]->event_channel.Push( lp.m_batches[ i ] );
         }
-        CLineProcessor lp( context );
-        lp.ProcessLineBuckets();
     }
 }
+
+template class CLineProcessor < CMessageParser >;
+template class CLineProcessor < CJsonLinesParser >;
+template class CLineProcessor < CBinaryRecordParser >;
@@ -3,23 +3,34 @@
 #include "common.h"
 
 #include "utils.h"
+#include "MessageFormat.h"
 
 //
-// Implements conversion of lines received to request/response events, drops processed line buckets
+// Implements conversion of lines received to request/response events.
+// Several processors may run in parallel: every one owns its parser and takes line bucket segments (whole events) one by one
+// from the segment channel, events of a segment are split by aggregation partition and passed to aggregators as one batch per partition.
+// The processor is instantiated for every input format parser (see LineProcessor.cpp), the format is selected at startup.
 //
+template < MessageParser TParser >
 class CLineProcessor {
 
     protected:
 
         PContext m_context;
+        CThreadMetrics & m_metrics;
+        TParser m_parser;
 
-        void ParseLineBucket( const PLineBucket & bucket );
-        void ProcessLineBuckets();
+        std::vector < PEventBatch > m_batches;
+        // storage for rebuilt request paths (reused between events)
+        std::string m_path_buffer;
+
+        void ParseSegment( const CSegmentRef & segment );
 
         explicit CLineProcessor( PContext context );
 
     public:
 
+        // runs until the segment channel is closed and drained
         static void Run( const std::stop_token & stoken, const PContext & context );
 
 };
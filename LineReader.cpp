@@ -1,70 +1,530 @@
 #include "common.h"
 
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
 #include "LineReader.h"
 
 #include "utils.h"
 
 CLineReader::CLineReader( PContext context )
     : m_context( std::move( context ) )
+    , m_metrics( m_context->metrics.Register( CThreadMetrics::STAGE_READER ) )
+    , m_find_events_end( DispatchInputFormat( m_context->INPUT_FORMAT, []( auto parser ) -> t_events_end_finder {
+        return &decltype( parser )::type::FindEventsEnd;
+    } ) )
 {
 }
 
-// moves all (a single existing) filling line buckets to a filled (ready) line buckets collection
-void CLineReader::FlushLineBuckets() const {
-    PLineBucket bucket;
-    time_t bucket_ts;
-    while ( m_context->filling_line_buckets.GetOldest( bucket, bucket_ts ) ) {
-        m_context->ready_line_buckets.AddItem( bucket_ts, bucket );
-        m_context->filling_line_buckets.RemoveItem( bucket );
+CLineReader::~CLineReader() {
+    for ( const auto & source : m_sources ) {
+        if ( source->bOwned && source->fd >= 0 ) {
+            close( source->fd );
+        }
+    }
+    for ( const int fd : { m_epoll_fd, m_listen_fd, m_signal_fd } ) {
+        if ( fd >= 0 ) {
+            close( fd );
+        }
+    }
+    if ( m_listen_fd >= 0 ) {
+        unlink( m_context->input_socket.c_str() );
     }
-    m_context->ready_line_buckets.NotifyDataAvailable();
 }
 
-// processes one line of input
-void CLineReader::ReadLine() {
+namespace {
+
+    // returns an approximate count of events (count of empty lines, the last event may have none)
+    long long unsigned int CountEvents( const std::string_view events ) {
+        long long unsigned int count = 0;
+        const char * p = events.data();
+        const char * const end = p + events.size();
+        while ( const void * found = memmem( p, end - p, "\n\n", 2 ) ) {
+            count++;
+            p = static_cast < const char * >( found ) + 2;
+        }
+        return count + ( p < end ? 1 : 0 );
+    }
+
+}
+
+// returns overload counters of the interval of the time specified
+COverloadCounters & CLineReader::GetOverloadCounters( const time_t ts ) {
+    const time_t interval_ts = m_context->stats.GetQuantizedTime( ts );
+    if ( !m_stats_shard || interval_ts != m_stats_shard_ts ) {
+        HandOverStats();
+        m_stats_shard = std::make_shared < CAggregatedStats >();
+        m_stats_shard_ts = interval_ts;
+    }
+    return m_stats_shard->GetOverloadCounters();
+}
+
+// hands over overload counters of the interval, must be done before the last bucket of the interval is sealed
+void CLineReader::HandOverStats() {
+    if ( m_stats_shard && !m_stats_shard->GetOverloadCounters().IsEmpty() ) {
+        PIntervalStats interval_stats;
+        m_context->stats.GetItemByKey( m_stats_shard_ts, interval_stats );
+        interval_stats->AddShard( std::move( m_stats_shard ) );
+    }
+    m_stats_shard.reset();
+}
+
+// submits segments of the current line bucket not submitted yet for parsing (waits while parsers are busy),
+// seals the bucket if it is filled
+void CLineReader::SubmitLineBucket( CSource & source, const bool bSeal ) {
+    if ( !source.line_bucket ) {
+        return;
+    }
+    const auto & bucket = source.line_bucket;
+    while ( bucket->HasUnsubmittedSegments() ) {
+        CSegmentRef segment { bucket, bucket->SubmitSegment( m_context->partitions.size() ) };
+        m_metrics.segments.Add( 1 );
+        if ( !m_context->segment_channel->TryPush( segment ) ) {
+            const auto stall_start = std::chrono::steady_clock::now();
+            m_context->segment_channel->Push( segment );
+            GetOverloadCounters( bucket->GetTimestamp() ).input_stall_ms += std::chrono::duration_cast < std::chrono::milliseconds >(
+                std::chrono::steady_clock::now() - stall_start
+            ).count();
+        }
+    }
+    if ( bSeal ) {
+        // the bucket may be the last one of the interval
+        HandOverStats();
+        bucket->Seal();
+        // a bucket without segments is joined right away
+        m_context->line_buckets.RemoveJoined();
+    }
+}
+
+// returns the total size of the slabs being filled by the sources
+size_t CLineReader::GetOwnMemory() const {
+    size_t own_size = 0;
+    for ( const auto & source : m_sources ) {
+        own_size += source->slab ? source->slab->GetCapacity() : 0;
+    }
+    return own_size;
+}
+
+// returns the total size of slabs in flight except the ones being filled
+size_t CLineReader::GetMemoryInFlight() const {
+    const size_t used_size = m_context->slab_pool.GetUsedSize();
+    const size_t own_size = GetOwnMemory();
+    return used_size > own_size ? used_size - own_size : 0;
+}
+
+// returns true if input arrives faster than it is processed (input in flight or the parsing queue is over a half of its limit)
+bool CLineReader::IsOverloaded() const {
+    return GetMemoryInFlight() >= m_context->INPUT_MEMORY_LIMIT / 2 || m_context->segment_channel->GetSize() >= m_context->CHANNEL_DEPTH / 2;
+}
+
+// blocks while slabs in flight exceed the memory limit, the input pipe fills up and blocks the writer
+void CLineReader::WaitForMemory( CSource & source ) {
+    if ( GetMemoryInFlight() < m_context->INPUT_MEMORY_LIMIT ) {
+        return;
+    }
+    auto & slab_pool = m_context->slab_pool;
+    const size_t limit = m_context->INPUT_MEMORY_LIMIT + GetOwnMemory();
+    // events collected in the current buckets are passed on to let the pipeline release memory
+    for ( const auto & other : m_sources ) {
+        SubmitLineBucket( *other, false );
+    }
+    const auto stall_start = std::chrono::steady_clock::now();
+    while ( !slab_pool.WaitForUsedSizeBelow( limit, INPUT_STALL_STEP_MS ) ) {
+        m_context->DEBUG_OUTPUT && std::cout << "Waiting for input memory, bytes in flight: " << slab_pool.GetUsedSize() << std::endl;
+    }
+    const time_t ts = source.line_bucket ? source.line_bucket->GetTimestamp() : time( nullptr ) / SECONDS_PER_LINE_BUCKET;
+    GetOverloadCounters( ts ).input_stall_ms += std::chrono::duration_cast < std::chrono::milliseconds >(
+        std::chrono::steady_clock::now() - stall_start
+    ).count();
+}
+
+// returns a pointer to at least the specified count of free bytes at the end of the current slab,
+// moves an unfinished event to a new slab if the current one is full
+char * CLineReader::ReserveInput( CSource & source, const size_t size ) {
+    if ( !source.slab || source.slab->GetCapacity() - source.slab_used < size ) {
+        const size_t carried_size = source.slab ? source.slab_used - source.event_start : 0;
+        PSlab slab = m_context->slab_pool.Acquire( std::max( LINE_SLAB_SIZE, carried_size + size ) );
+        if ( carried_size > 0 ) {
+            memcpy( slab->GetData(), source.slab->GetData() + source.event_start, carried_size );
+        }
+        source.frame_pos -= source.event_start;
+        source.event_start = 0;
+        source.slab_used = carried_size;
+        // the previous slab is kept alive by the buckets referencing it
+        source.slab = std::move( slab );
+    }
+    return source.slab->GetData() + source.slab_used;
+}
+
+// submits complete events preceding the offset specified to the current bucket
+void CLineReader::CommitEvents( CSource & source, const time_t ts, const uint32_t received_us, const size_t events_end ) {
 
-    std::string input;
-    std::getline( std::cin, input );
     if (
-        time_t ts = time( nullptr ) / SECONDS_PER_LINE_BUCKET;
         // switch buckets if there is no current bucket
-        !m_current_line_bucket
+        !source.line_bucket
         ||
         // or if the current timestamp is different from the current bucket's timestamp
-        // and the next event start is reached (non-empty line after empty line).
-        ( m_current_line_bucket->GetTimestamp() != ts && m_bPrevEmptyLine && !input.empty() )
+        // (events go to the bucket of the time their end is received).
+        source.line_bucket->GetTimestamp() != ts
     ) {
 
-        if ( m_current_line_bucket ) {
-            m_context->DEBUG_OUTPUT && std::cout << to_stream( m_current_line_bucket->GetTimestamp() ) << " end collecting lines" << std::endl;
+        if ( source.line_bucket ) {
+            m_context->DEBUG_OUTPUT && std::cout << to_stream( source.line_bucket->GetTimestamp() ) << " end collecting lines from " << source.name << std::endl;
         }
 
         // submit data collected for processing
-        FlushLineBuckets();
+        SubmitLineBucket( source, true );
 
         // Lines are marked by a current timestamp (time() value).
         // "Date:" header is ignored because its source is unknown (not trusted), so using its value can distort aggregation results.
-        m_current_line_bucket = std::make_shared < CLineBucket >( ts );
+        source.line_bucket = std::make_shared < CLineBucket >( ts, source.index );
+
+        // the lag is measured from the oldest line bucket still in flight
+        if ( ts > m_sampler_ts ) {
+            time_t oldest_ts = ts;
+            m_context->line_buckets.GetOldestTimestamp( oldest_ts );
+            m_context->sampler.StartSecond( ts, ts - std::min( oldest_ts, ts ) );
+            m_sampler_ts = ts;
+        }
+
+        // a bucket started while overloaded is dropped or parsed in the fast mode as the policy says
+        const bool bOverloaded = m_context->OVERLOAD_POLICY != CContext::OVERLOAD_BLOCK && IsOverloaded();
+        source.bShedding = bOverloaded && m_context->OVERLOAD_POLICY == CContext::OVERLOAD_SHED;
+        source.line_bucket->SetFastParse( bOverloaded && m_context->OVERLOAD_POLICY == CContext::OVERLOAD_FAST_PARSE );
+        if ( bOverloaded ) {
+            m_context->DEBUG_OUTPUT && std::cout << to_stream( ts ) << ( source.bShedding ? " dropping lines from " : " fast parsing lines from " ) << source.name << std::endl;
+        }
 
-        m_context->filling_line_buckets.AddItem( ts, m_current_line_bucket );
-        m_context->DEBUG_OUTPUT && std::cout << to_stream( ts ) << " start collecting lines" << std::endl;
+        m_context->line_buckets.Add( source.line_bucket );
+        m_context->DEBUG_OUTPUT && std::cout << to_stream( ts ) << " start collecting lines from " << source.name << std::endl;
 
     }
 
-    m_current_line_bucket->Push( input );
-    m_bPrevEmptyLine = input.empty();
-    //std::cout << input << std::endl;
+    const std::string_view events( source.slab->GetData() + source.event_start, events_end - source.event_start );
+    if ( source.bShedding ) {
+        GetOverloadCounters( ts ).shed_events += CountEvents( events );
+    } else {
+        source.line_bucket->Push( source.slab, events, received_us );
+    }
+    source.event_start = events_end;
+}
+
+// finds the end of the last complete event received and submits all events before it
+void CLineReader::FrameEvents( CSource & source, const time_t ts, const uint32_t received_us, const bool bEndOfInput ) {
+    if ( !source.slab ) {
+        return;
+    }
+    size_t events_end = m_find_events_end( source.slab->GetData(), source.event_start, source.frame_pos, source.slab_used );
+    if ( bEndOfInput ) {
+        // the last event of the input may have no trailing empty line
+        events_end = source.slab_used;
+    }
+    if ( events_end > source.event_start ) {
+        CommitEvents( source, ts, received_us, events_end );
+    }
+}
 
+// reads a large block of input of the source into its current slab, returns false at the end of input
+bool CLineReader::ReadBlock( CSource & source ) {
+    WaitForMemory( source );
+    char * buffer = ReserveInput( source, LINE_SLAB_MIN_READ );
+    const size_t buffer_size = source.slab->GetCapacity() - source.slab_used;
+    ssize_t bytes_read;
+    do {
+        bytes_read = read( source.fd, buffer, buffer_size );
+    } while ( bytes_read < 0 && errno == EINTR );
+    if ( bytes_read < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) {
+        // a polled source may have no data after all
+        return true;
+    }
+    // one time() call per block instead of per line
+    const time_t ts = time( nullptr ) / SECONDS_PER_LINE_BUCKET;
+    CBusyTimer busy_timer( m_metrics.busy_ns );
+    if ( bytes_read > 0 ) {
+        source.slab_used += bytes_read;
+        m_metrics.bytes.Add( bytes_read );
+    }
+    FrameEvents( source, ts, GetSteadyMicroseconds(), bytes_read <= 0 );
+    return bytes_read > 0;
+}
+
+// sets up io_uring input and submits the first chain of reads, returns false if io_uring is not available
+bool CLineReader::InitRing() {
+    m_ring = std::make_unique < CIoUring >();
+    if ( !m_ring->Init( 2 * RING_READS_PER_CHAIN ) ) {
+        m_context->DEBUG_OUTPUT && std::cout << "io_uring is not available, reading input with read()" << std::endl;
+        m_ring.reset();
+        return false;
+    }
+    m_ring_buffers = std::make_unique_for_overwrite < char[] >( 2 * RING_READS_PER_CHAIN * RING_READ_SIZE );
+    std::vector < iovec > buffers;
+    for ( unsigned i = 0; i < 2 * RING_READS_PER_CHAIN; i++ ) {
+        buffers.push_back( { m_ring_buffers.get() + i * RING_READ_SIZE, RING_READ_SIZE } );
+    }
+    // pinning may be limited by RLIMIT_MEMLOCK, the same buffers are read into unregistered then
+    m_bRingBuffersRegistered = m_ring->RegisterBuffers( buffers );
+    if ( !SubmitRingReads( 0 ) ) {
+        m_ring.reset();
+        return false;
+    }
+    return true;
+}
+
+// submits linked reads of the chain specified into its buffers (user data is the buffer index)
+bool CLineReader::SubmitRingReads( const unsigned chain ) {
+    for ( unsigned i = 0; i < RING_READS_PER_CHAIN; i++ ) {
+        const unsigned index = chain * RING_READS_PER_CHAIN + i;
+        m_ring->PrepareRead(
+            STDIN_FILENO, m_ring_buffers.get() + index * RING_READ_SIZE, RING_READ_SIZE,
+            m_bRingBuffersRegistered ? static_cast < int >( index ) : -1, index, i + 1 < RING_READS_PER_CHAIN
+        );
+    }
+    return m_ring->Submit();
+}
+
+// takes the next completed read of io_uring input and copies it into the current slab, returns false at the end of input
+bool CLineReader::ReadRingBlock( CSource & source ) {
+    WaitForMemory( source );
+    // linked reads complete in order, so completions come in the order of the input
+    CIoUring::CCompletion completion;
+    const bool bCompleted = m_ring->WaitCompletion( completion );
+    const unsigned index = static_cast < unsigned >( completion.user_data );
+    const int32_t bytes_read = bCompleted ? completion.result : -1;
+    const time_t ts = time( nullptr ) / SECONDS_PER_LINE_BUCKET;
+    CBusyTimer busy_timer( m_metrics.busy_ns );
+    if ( bytes_read > 0 ) {
+        m_metrics.bytes.Add( bytes_read );
+        // the other chain is read while this one is copied, its buffers are copied already
+        if ( index % RING_READS_PER_CHAIN == RING_READS_PER_CHAIN - 1 && !SubmitRingReads( 1 - index / RING_READS_PER_CHAIN ) ) {
+            return false;
+        }
+        memcpy( ReserveInput( source, bytes_read ), m_ring_buffers.get() + index * RING_READ_SIZE, bytes_read );
+        source.slab_used += bytes_read;
+    }
+    FrameEvents( source, ts, GetSteadyMicroseconds(), bytes_read <= 0 );
+    return bytes_read > 0;
+}
+
+// reads one line of input into the current slab, returns false at the end of input
+bool CLineReader::ReadLine( CSource & source ) {
+    std::string input;
+    std::getline( std::cin, input );
+    const bool bEndOfInput = !std::cin.good();
+    WaitForMemory( source );
+    CBusyTimer busy_timer( m_metrics.busy_ns );
+    m_metrics.bytes.Add( input.size() + ( bEndOfInput ? 0 : 1 ) );
+    char * buffer = ReserveInput( source, input.size() + 1 );
+    memcpy( buffer, input.data(), input.size() );
+    source.slab_used += input.size();
+    if ( !bEndOfInput ) {
+        buffer[ input.size() ] = '\n';
+        source.slab_used++;
+    }
+    FrameEvents( source, time( nullptr ) / SECONDS_PER_LINE_BUCKET, GetSteadyMicroseconds(), bEndOfInput );
+    return !bEndOfInput;
+}
+
+// registers an input source, polls it with epoll if it is set up and the descriptor can be polled
+CLineReader::CSource & CLineReader::AddSource( const int fd, std::string name, const bool bOwned ) {
+    auto & source = *m_sources.emplace_back( std::make_unique < CSource >() );
+    source.index = m_next_source_index++;
+    source.name = std::move( name );
+    source.fd = fd;
+    source.bOwned = bOwned;
+    if ( m_epoll_fd >= 0 ) {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        // regular files are always ready and cannot be polled (EPERM)
+        source.bPolled = epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, fd, &event ) == 0;
+    }
+    m_context->DEBUG_OUTPUT && std::cout << "Reading input source " << source.index << ": " << source.name << std::endl;
+    return source;
+}
+
+// opens the input sources specified in the context, the listening socket and the signal descriptor ending the input,
+// returns false if any of them cannot be opened
+bool CLineReader::OpenSources() {
+    m_epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+    if ( m_epoll_fd < 0 ) {
+        std::cout << "Cannot create epoll: " << strerror( errno ) << std::endl;
+        return false;
+    }
+    for ( const auto & path : m_context->input_paths ) {
+        if ( path == "-" ) {
+            AddSource( STDIN_FILENO, "STDIN", false );
+            continue;
+        }
+        // FIFOs are opened without waiting for a writer, the input ends when the last writer closes it
+        const int fd = open( path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC );
+        if ( fd < 0 ) {
+            std::cout << "Cannot open input " << path << ": " << strerror( errno ) << std::endl;
+            return false;
+        }
+        AddSource( fd, path, true );
+    }
+    if ( const auto & path = m_context->input_socket; !path.empty() ) {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if ( path.size() >= sizeof( address.sun_path ) ) {
+            std::cout << "Input socket path is too long: " << path << std::endl;
+            return false;
+        }
+        memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+        m_listen_fd = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+        // a socket file left by a previous run is replaced
+        unlink( path.c_str() );
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = m_listen_fd;
+        if (
+            m_listen_fd < 0
+            || bind( m_listen_fd, reinterpret_cast < sockaddr * >( &address ), sizeof( address ) ) != 0
+            || listen( m_listen_fd, SOMAXCONN ) != 0
+            || epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_listen_fd, &event ) != 0
+        ) {
+            std::cout << "Cannot listen for input on " << path << ": " << strerror( errno ) << std::endl;
+            return false;
+        }
+    }
+    // SIGINT and SIGTERM are blocked in all threads (see main()), they end the input gracefully
+    sigset_t signals;
+    sigemptyset( &signals );
+    sigaddset( &signals, SIGINT );
+    sigaddset( &signals, SIGTERM );
+    m_signal_fd = signalfd( -1, &signals, SFD_NONBLOCK | SFD_CLOEXEC );
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = m_signal_fd;
+    if ( m_signal_fd < 0 || epoll_ctl( m_epoll_fd, EPOLL_CTL_ADD, m_signal_fd, &event ) != 0 ) {
+        std::cout << "Cannot receive signals: " << strerror( errno ) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// accepts all pending connections to the listening socket as new sources
+void CLineReader::AcceptConnections() {
+    while ( true ) {
+        const int fd = accept4( m_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC );
+        if ( fd < 0 ) {
+            if ( errno == EINTR || errno == ECONNABORTED ) {
+                continue;
+            }
+            return;
+        }
+        AddSource( fd, m_context->input_socket + " #" + std::to_string( m_next_source_index ), true );
+    }
+}
+
+// submits the last events of a source which input has ended and drops it
+void CLineReader::EndSource( CSource & source ) {
+    m_context->DEBUG_OUTPUT && std::cout << "End of input source " << source.index << ": " << source.name << std::endl;
+    FrameEvents( source, time( nullptr ) / SECONDS_PER_LINE_BUCKET, GetSteadyMicroseconds(), true );
+    SubmitLineBucket( source, true );
+    if ( source.bOwned ) {
+        // closing the descriptor removes it from epoll
+        close( source.fd );
+    } else if ( source.bPolled ) {
+        epoll_ctl( m_epoll_fd, EPOLL_CTL_DEL, source.fd, nullptr );
+    }
+    source.fd = -1;
+}
+
+// seals buckets of sources that have not received complete events since an earlier second,
+// so an idle source does not hold back the output of intervals
+void CLineReader::SealIdleBuckets( const time_t ts ) {
+    for ( const auto & source : m_sources ) {
+        if ( source->line_bucket && source->line_bucket->GetTimestamp() < ts ) {
+            SubmitLineBucket( *source, true );
+            source->line_bucket.reset();
+        }
+    }
+}
+
+// reads the sources multiplexed with epoll until all of them end (unless sources may connect) or a signal is received
+void CLineReader::ReadSources( const std::stop_token & stoken ) {
+    std::array < epoll_event, 64 > events;
+    bool bSignaled = false;
+    while ( !stoken.stop_requested() && !bSignaled && ( m_listen_fd >= 0 || !m_sources.empty() ) ) {
+        // sources that cannot be polled are read in every round, so waiting is not allowed while there are any
+        const bool bUnpolled = std::ranges::any_of( m_sources, []( const auto & source ) { return !source->bPolled; } );
+        int count = epoll_wait( m_epoll_fd, events.data(), events.size(), bUnpolled ? 0 : INPUT_POLL_MS );
+        if ( count < 0 && errno != EINTR ) {
+            std::cout << "Cannot wait for input: " << strerror( errno ) << std::endl;
+            break;
+        }
+        for ( int i = 0; i < count; i++ ) {
+            const int fd = events[ i ].data.fd;
+            if ( fd == m_signal_fd ) {
+                signalfd_siginfo info;
+                if ( read( m_signal_fd, &info, sizeof( info ) ) == sizeof( info ) ) {
+                    m_context->DEBUG_OUTPUT && std::cout << "Input ended by signal " << info.ssi_signo << std::endl;
+                }
+                bSignaled = true;
+                m_context->bInputInterrupted = true;
+            } else if ( fd == m_listen_fd ) {
+                AcceptConnections();
+            } else if ( const auto it = std::ranges::find_if( m_sources, [ fd ]( const auto & source ) { return source->fd == fd; } ); it != m_sources.end() ) {
+                // one block per source and round, so a busy source does not starve the others
+                if ( !ReadBlock( **it ) ) {
+                    EndSource( **it );
+                }
+            }
+        }
+        for ( const auto & source : m_sources ) {
+            if ( !source->bPolled && source->fd >= 0 && !ReadBlock( *source ) ) {
+                EndSource( *source );
+            }
+        }
+        std::erase_if( m_sources, []( const auto & source ) { return source->fd < 0; } );
+        SealIdleBuckets( time( nullptr ) / SECONDS_PER_LINE_BUCKET );
+    }
+}
+
+// submits remaining data of all sources collected for processing
+void CLineReader::Finish() {
+    for ( const auto & source : m_sources ) {
+        if ( source->fd >= 0 ) {
+            FrameEvents( *source, time( nullptr ) / SECONDS_PER_LINE_BUCKET, GetSteadyMicroseconds(), true );
+        }
+        SubmitLineBucket( *source, true );
+    }
+    HandOverStats();
 }
 
 void CLineReader::Run( const std::stop_token & stoken, const PContext & context ) {
 
     CLineReader lr( context );
-    while ( std::cin.good() && !stoken.stop_requested() ) {
-        lr.ReadLine();
+    if ( !context->input_paths.empty() || !context->input_socket.empty() ) {
+        if ( lr.OpenSources() ) {
+            lr.ReadSources( stoken );
+        }
+        lr.Finish();
+        return;
+    }
+
+    auto & source = lr.AddSource( STDIN_FILENO, "STDIN", false );
+    if ( context->CHUNKED_INPUT && context->IO_URING && lr.InitRing() ) {
+        while ( !stoken.stop_requested() && lr.ReadRingBlock( source ) ) {
+        }
+    } else if ( context->CHUNKED_INPUT ) {
+        while ( !stoken.stop_requested() && lr.ReadBlock( source ) ) {
+        }
+    } else {
+        while ( !stoken.stop_requested() && lr.ReadLine( source ) ) {
+        }
     }
 
     // submit remaining data collected for processing
-    lr.FlushLineBuckets();
+    lr.SubmitLineBucket( source, true );
+    lr.HandOverStats();
 
 }
@@ -2,23 +2,102 @@
 
 #include "common.h"
 #include "utils.h"
+#include "IoUring.h"
+#include "MessageFormat.h"
 
 //
-// Implements reading of lines from STDIN into line buckets keeping immediate processing to a minimum.
-// The only processing done is to guarantee that lines of an event are not split to different buckets.
+// Implements reading of lines from STDIN or from several input sources into line buckets keeping immediate processing to a minimum.
+// Input bytes are placed into reusable slabs and referenced in place (no per-line copies).
+// STDIN is read by blocks with read() or io_uring (several reads in flight) or line by line with std::getline().
+// Input sources (files, FIFOs, connections to a listening Unix domain socket) are multiplexed with epoll, every source
+// has its own slab, framing state and line buckets, so events of different sources are never interleaved.
+// Input is submitted to a bucket up to the last complete event of the input format (an HTTP message ending with an empty line,
+// a JSON line, a binary record), so lines of an event are never split to different buckets.
+// The reader is blocked while the input in flight exceeds the memory limit or the parsing queue is full. A line bucket
+// started while the pipeline is overloaded is dropped or parsed in the fast mode depending on the overload policy.
 //
 class CLineReader {
 
     protected:
 
-        bool m_bPrevEmptyLine = false;
-        PLineBucket m_current_line_bucket;
+        // an input stream with its own framing state and line bucket
+        class CSource {
+            public:
+                // tag of the line buckets of the source
+                unsigned int index = 0;
+                std::string name;
+                int fd = -1;
+                // registered with epoll (regular files cannot be, they are read whenever data are requested)
+                bool bPolled = false;
+                // closed when its input ends
+                bool bOwned = true;
+
+                PLineBucket line_bucket;
+                PSlab slab;
+                // count of bytes stored in the current slab
+                size_t slab_used = 0;
+                // offset of the first byte not yet searched for an event end
+                size_t frame_pos = 0;
+                // offset of the first byte of an event not yet submitted to a bucket
+                size_t event_start = 0;
+                // the current bucket is dropped (overload policy)
+                bool bShedding = false;
+        };
+
         PContext m_context;
+        CThreadMetrics & m_metrics;
+
+        // frames input of the format selected into whole events (called once per block read)
+        typedef size_t ( * t_events_end_finder )( const char * data, const size_t event_start, size_t & frame_pos, const size_t size );
+        const t_events_end_finder m_find_events_end;
+
+        // STDIN or the sources specified in the context
+        std::vector < std::unique_ptr < CSource > > m_sources;
+        unsigned int m_next_source_index = 0;
+        // the last second the sampler was started for (once for all sources)
+        time_t m_sampler_ts = 0;
+
+        // multiplexed input: epoll, listening socket for sources to connect to, signals ending the input
+        int m_epoll_fd = -1;
+        int m_listen_fd = -1;
+        int m_signal_fd = -1;
+
+        // io_uring input: two chains of RING_READS_PER_CHAIN linked reads into registered buffers take turns,
+        // a chain is submitted once all reads of the other one are completed and copied to slabs
+        std::unique_ptr < CIoUring > m_ring;
+        std::unique_ptr < char[] > m_ring_buffers;
+        bool m_bRingBuffersRegistered = false;
+
+        // overload counters of the current interval, handed over as a stats shard
+        PAggregatedStats m_stats_shard;
+        time_t m_stats_shard_ts = 0;
+
+        COverloadCounters & GetOverloadCounters( const time_t ts );
+        void HandOverStats();
+        void SubmitLineBucket( CSource & source, const bool bSeal );
+        size_t GetOwnMemory() const;
+        size_t GetMemoryInFlight() const;
+        bool IsOverloaded() const;
+        void WaitForMemory( CSource & source );
+        char * ReserveInput( CSource & source, const size_t size );
+        void FrameEvents( CSource & source, const time_t ts, const uint32_t received_us, const bool bEndOfInput );
+        void CommitEvents( CSource & source, const time_t ts, const uint32_t received_us, const size_t events_end );
+        bool ReadBlock( CSource & source );
+        bool InitRing();
+        bool SubmitRingReads( const unsigned chain );
+        bool ReadRingBlock( CSource & source );
+        bool ReadLine( CSource & source );
 
-        void FlushLineBuckets() const;
-        void ReadLine();
+        CSource & AddSource( const int fd, std::string name, const bool bOwned );
+        bool OpenSources();
+        void AcceptConnections();
+        void EndSource( CSource & source );
+        void SealIdleBuckets( const time_t ts );
+        void ReadSources( const std::stop_token & stoken );
+        void Finish();
 
         explicit CLineReader( PContext context );
+        ~CLineReader();
 
     public:
 
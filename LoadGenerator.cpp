@@ -0,0 +1,256 @@
+#include "common.h"
+
+#include "LoadGenerator.h"
+#include "BinaryRecordParser.h"
+
+namespace {
+
+    uint64_t SplitMix64( uint64_t x ) {
+        x += 0x9e3779b97f4a7c15;
+        x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9;
+        x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111eb;
+        return x ^ ( x >> 31 );
+    }
+
+    // returns the standard reason phrase of an HTTP status code
+    std::string_view GetReasonPhrase( const std::string_view code ) {
+        constexpr std::pair < std::string_view, std::string_view > phrases[] = {
+            { "100", "Continue" }, { "101", "Switching Protocols" },
+            { "200", "OK" }, { "201", "Created" }, { "202", "Accepted" }, { "204", "No Content" }, { "206", "Partial Content" },
+            { "301", "Moved Permanently" }, { "302", "Found" }, { "303", "See Other" }, { "304", "Not Modified" },
+            { "307", "Temporary Redirect" }, { "308", "Permanent Redirect" },
+            { "400", "Bad Request" }, { "401", "Unauthorized" }, { "403", "Forbidden" }, { "404", "Not Found" },
+            { "405", "Method Not Allowed" }, { "408", "Request Timeout" }, { "409", "Conflict" }, { "410", "Gone" },
+            { "413", "Content Too Large" }, { "415", "Unsupported Media Type" }, { "422", "Unprocessable Content" },
+            { "429", "Too Many Requests" },
+            { "500", "Internal Server Error" }, { "501", "Not Implemented" }, { "502", "Bad Gateway" },
+            { "503", "Service Unavailable" }, { "504", "Gateway Timeout" }
+        };
+        for ( const auto & [ phrase_code, phrase ] : phrases ) {
+            if ( phrase_code == code ) {
+                return phrase;
+            }
+        }
+        // the reason phrase may be empty
+        return {};
+    }
+
+    void AppendHex( std::string & out, const uint64_t value, const unsigned int digits ) {
+        constexpr char hex[] = "0123456789abcdef";
+        for ( unsigned int i = digits; i-- > 0; ) {
+            out += hex[ ( value >> ( i * 4 ) ) & 0xf ];
+        }
+    }
+
+}
+
+CLoadGenerator::CLoadGenerator( CSettings settings )
+    : m_settings( std::move( settings ) )
+{
+    uint64_t seed = m_settings.seed;
+    for ( auto & word : m_state ) {
+        word = SplitMix64( seed++ );
+    }
+    m_path_cdf = MakeZipfCdf( m_settings.path_count, m_settings.path_skew );
+    m_code_cdf = MakeZipfCdf( m_settings.codes.size(), m_settings.code_skew );
+    for ( const auto & code : m_settings.codes ) {
+        m_status_lines.push_back( "HTTP/1.1 " + code + " " + std::string( GetReasonPhrase( code ) ) + "\n" );
+    }
+    for ( size_t i = 0; i < m_settings.path_count; i++ ) {
+        m_paths.push_back( "/svc" + std::to_string( i % 8 ) + "/resource" + std::to_string( i ) );
+    }
+    if ( m_settings.header_bloat > 0 && m_settings.message_format == MESSAGE_FORMAT_HTTP ) {
+        constexpr std::string_view header( "X-Padding: " );
+        m_bloat = header;
+        m_bloat.append( m_settings.header_bloat > header.size() + 1 ? m_settings.header_bloat - header.size() - 1 : 0, 'x' );
+        m_bloat += '\n';
+    } else if ( m_settings.header_bloat > 0 && m_settings.message_format == MESSAGE_FORMAT_JSON ) {
+        constexpr std::string_view member( "\"padding\":\"\"," );
+        m_bloat = member.substr( 0, member.size() - 2 );
+        m_bloat.append( m_settings.header_bloat > member.size() ? m_settings.header_bloat - member.size() : 0, 'x' );
+        m_bloat += "\",";
+    }
+}
+
+// cumulative probabilities of ranks 1..count with frequencies proportional to 1 / rank^skew
+std::vector < double > CLoadGenerator::MakeZipfCdf( const size_t count, const double skew ) {
+    std::vector < double > cdf( count );
+    double sum = 0;
+    for ( size_t i = 0; i < count; i++ ) {
+        sum += 1 / std::pow( static_cast < double >( i + 1 ), skew );
+        cdf[ i ] = sum;
+    }
+    for ( auto & value : cdf ) {
+        value /= sum;
+    }
+    return cdf;
+}
+
+// xoshiro256**
+uint64_t CLoadGenerator::NextRandom() {
+    const uint64_t result = std::rotl( m_state[ 1 ] * 5, 7 ) * 9;
+    const uint64_t t = m_state[ 1 ] << 17;
+    m_state[ 2 ] ^= m_state[ 0 ];
+    m_state[ 3 ] ^= m_state[ 1 ];
+    m_state[ 1 ] ^= m_state[ 2 ];
+    m_state[ 0 ] ^= m_state[ 3 ];
+    m_state[ 2 ] ^= t;
+    m_state[ 3 ] = std::rotl( m_state[ 3 ], 45 );
+    return result;
+}
+
+double CLoadGenerator::NextFraction() {
+    return static_cast < double >( NextRandom() >> 11 ) * 0x1.0p-53;
+}
+
+// returns a rank (0-based) distributed as the CDF specified says
+size_t CLoadGenerator::NextZipf( const std::vector < double > & cdf ) {
+    const auto it = std::ranges::upper_bound( cdf, NextFraction() );
+    return std::min < size_t >( it - cdf.begin(), cdf.size() - 1 );
+}
+
+// adds messages of the next trace, both are displaced forward by up to the reordering window from the trace position
+void CLoadGenerator::AddTrace() {
+    CPendingMessage request;
+    request.trace = m_trace;
+    request.path = static_cast < uint32_t >( NextZipf( m_path_cdf ) );
+    request.code = static_cast < uint32_t >( NextZipf( m_code_cdf ) );
+    const uint64_t window = m_settings.reorder_window + 1;
+    request.position = 2 * m_trace + NextRandom() % window;
+    CPendingMessage response = request;
+    response.bResponse = true;
+    response.position = 2 * m_trace + 1 + NextRandom() % window;
+    m_pending.push( request );
+    if ( NextFraction() * 100 >= m_settings.orphan_percent ) {
+        m_pending.push( response );
+    }
+    m_trace++;
+}
+
+// trace IDs are unique per trace and differ between seeds
+void CLoadGenerator::WriteTraceID( std::string & out, const uint64_t trace ) const {
+    const uint64_t high = SplitMix64( m_settings.seed * 0x100000001b3 ^ trace );
+    const uint64_t low = SplitMix64( high ^ trace );
+    switch ( m_settings.trace_format ) {
+        case TRACE_FORMAT_UUID:
+            AppendHex( out, high >> 32, 8 );
+            out += '-';
+            AppendHex( out, high >> 16, 4 );
+            out += '-';
+            AppendHex( out, high, 4 );
+            out += '-';
+            AppendHex( out, low >> 48, 4 );
+            out += '-';
+            AppendHex( out, low, 12 );
+            break;
+        case TRACE_FORMAT_HEX:
+            AppendHex( out, high, 16 );
+            AppendHex( out, low, 16 );
+            break;
+        case TRACE_FORMAT_TEXT:
+            out += "trace-";
+            out += std::to_string( high % 1000000007 );
+            out += '.';
+            out += std::to_string( trace );
+            break;
+    }
+}
+
+// {"trace_id":"...","path":"..."} or {"trace_id":"...","status":200} (codes that are not numbers are written as strings)
+void CLoadGenerator::WriteJsonMessage( std::string & out, const CPendingMessage & message ) const {
+    out += '{';
+    // the bloat is placed before the trace ID to make parsers skip it
+    out += m_bloat;
+    out += "\"trace_id\":\"";
+    WriteTraceID( out, message.trace );
+    if ( message.bResponse ) {
+        const auto & code = m_settings.codes[ message.code ];
+        const bool bNumber = std::ranges::all_of( code, []( const char c ) { return c >= '0' && c <= '9'; } );
+        out += bNumber ? "\",\"status\":" : "\",\"status\":\"";
+        out += code;
+        out += bNumber ? "}\n" : "\"}\n";
+    } else {
+        out += "\",\"path\":\"";
+        out += m_paths[ message.path ];
+        out += "\"}\n";
+    }
+}
+
+void CLoadGenerator::WriteBinaryMessage( std::string & out, const CPendingMessage & message ) const {
+    std::string trace_id;
+    WriteTraceID( trace_id, message.trace );
+    CBinaryRecordParser::Write(
+        out, message.bResponse ? CBinaryRecordParser::KIND_RESPONSE : CBinaryRecordParser::KIND_REQUEST, trace_id,
+        message.bResponse ? m_settings.codes[ message.code ] : m_paths[ message.path ]
+    );
+}
+
+void CLoadGenerator::WriteMessage( std::string & out, const CPendingMessage & message ) const {
+    if ( m_settings.message_format == MESSAGE_FORMAT_JSON ) {
+        WriteJsonMessage( out, message );
+        return;
+    }
+    if ( m_settings.message_format == MESSAGE_FORMAT_BINARY ) {
+        WriteBinaryMessage( out, message );
+        return;
+    }
+    if ( message.bResponse ) {
+        out += m_status_lines[ message.code ];
+        out += "Content-Type: text/plain\nContent-Length: 0\n";
+    } else {
+        out += "GET ";
+        out += m_paths[ message.path ];
+        out += " HTTP/1.1\nHost: example.com\nUser-Agent: generator\nAccept: */*\n";
+    }
+    // the bloat is placed before the trace ID to make parsers skip it
+    out += m_bloat;
+    out += "X-Trace-ID: ";
+    WriteTraceID( out, message.trace );
+    out += "\n\n";
+}
+
+void CLoadGenerator::Run( std::FILE * out ) {
+    constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+    // the rate is checked about every millisecond
+    const uint64_t rate_check_step = std::clamp < uint64_t >( m_settings.rate / 1000, 1, 64 );
+
+    std::string buffer;
+    buffer.reserve( OUTPUT_BUFFER_SIZE * 2 );
+    uint64_t message_count = 0;
+    const auto start = std::chrono::steady_clock::now();
+
+    while ( m_settings.trace_count == 0 || m_trace < m_settings.trace_count || !m_pending.empty() ) {
+        const bool bMoreTraces = m_settings.trace_count == 0 || m_trace < m_settings.trace_count;
+        if ( bMoreTraces ) {
+            AddTrace();
+        }
+        // messages of traces added later are placed at 2 * m_trace or after
+        while ( !m_pending.empty() && ( !bMoreTraces || m_pending.top().position < 2 * m_trace ) ) {
+            WriteMessage( buffer, m_pending.top() );
+            m_pending.pop();
+            message_count++;
+
+            if ( m_settings.rate > 0 && message_count % rate_check_step == 0 ) {
+                const auto due = start + std::chrono::microseconds( message_count * 1000000 / m_settings.rate );
+                if ( due > std::chrono::steady_clock::now() ) {
+                    // the messages written so far are due, the rest are delayed
+                    if ( std::fwrite( buffer.data(), 1, buffer.size(), out ) != buffer.size() || std::fflush( out ) != 0 ) {
+                        // the reader is gone
+                        return;
+                    }
+                    buffer.clear();
+                    std::this_thread::sleep_until( due );
+                }
+            }
+            if ( buffer.size() >= OUTPUT_BUFFER_SIZE ) {
+                if ( std::fwrite( buffer.data(), 1, buffer.size(), out ) != buffer.size() ) {
+                    // the reader is gone
+                    return;
+                }
+                buffer.clear();
+            }
+        }
+    }
+    std::fwrite( buffer.data(), 1, buffer.size(), out );
+    std::fflush( out );
+}
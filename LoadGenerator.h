@@ -0,0 +1,104 @@
+#pragma once
+
+#include "common.h"
+
+#include <cstdio>
+#include <queue>
+#include <tuple>
+
+//
+// Synthetic load of requests and responses in any input format: HTTP messages framed the way CMessageParser consumes them
+// (header lines, an empty line after every message), JSON lines or length-prefixed binary records. Paths and result codes follow Zipf distributions, messages of a trace are displaced randomly
+// within the reordering window (a response may come before its request), some requests never get a response.
+// The output depends on the seed and the settings only: random values come from an own generator and own distributions.
+//
+class CLoadGenerator {
+
+    public:
+
+        enum ETraceFormat {
+            // canonical lowercase UUID
+            TRACE_FORMAT_UUID,
+            // 32 lowercase hex digits
+            TRACE_FORMAT_HEX,
+            // arbitrary text
+            TRACE_FORMAT_TEXT,
+        };
+
+        enum EMessageFormat {
+            MESSAGE_FORMAT_HTTP,
+            MESSAGE_FORMAT_JSON,
+            MESSAGE_FORMAT_BINARY,
+        };
+
+        class CSettings {
+            public:
+                uint64_t seed = 1;
+                // count of traces to generate (0 for endless)
+                uint64_t trace_count = 0;
+                // messages per second (0 for unthrottled)
+                uint64_t rate = 0;
+                // count of distinct request paths and the Zipf exponent of their frequencies
+                size_t path_count = 100;
+                double path_skew = 1.0;
+                // result codes and the Zipf exponent of their frequencies (in the order of the list)
+                std::vector < std::string > codes { "200", "404", "500", "301", "302", "201", "204", "400", "401", "403", "503" };
+                double code_skew = 1.5;
+                // maximum displacement of a message from its trace position, in messages
+                size_t reorder_window = 16;
+                // percentage of requests without a response
+                double orphan_percent = 2;
+                // count of extra header bytes per message (an extra member of JSON objects, binary records have none)
+                size_t header_bloat = 0;
+                ETraceFormat trace_format = TRACE_FORMAT_UUID;
+                EMessageFormat message_format = MESSAGE_FORMAT_HTTP;
+        };
+
+    protected:
+
+        // a message waiting for its position in the output order
+        class CPendingMessage {
+            public:
+                uint64_t position = 0;
+                uint64_t trace = 0;
+                bool bResponse = false;
+                uint32_t path = 0;
+                uint32_t code = 0;
+
+                bool operator > ( const CPendingMessage & other ) const {
+                    return std::tie( position, trace, bResponse ) > std::tie( other.position, other.trace, other.bResponse );
+                }
+        };
+
+        CSettings m_settings;
+        // xoshiro256** state
+        std::array < uint64_t, 4 > m_state {};
+        // cumulative distribution functions of paths and codes
+        std::vector < double > m_path_cdf;
+        std::vector < double > m_code_cdf;
+        std::vector < std::string > m_paths;
+        // status lines of responses by code index
+        std::vector < std::string > m_status_lines;
+        std::string m_bloat;
+        std::priority_queue < CPendingMessage, std::vector < CPendingMessage >, std::greater <> > m_pending;
+        uint64_t m_trace = 0;
+
+        uint64_t NextRandom();
+        // returns a uniform random value in [0, 1)
+        double NextFraction();
+        size_t NextZipf( const std::vector < double > & cdf );
+        void AddTrace();
+        void WriteTraceID( std::string & out, const uint64_t trace ) const;
+        void WriteMessage( std::string & out, const CPendingMessage & message ) const;
+        void WriteJsonMessage( std::string & out, const CPendingMessage & message ) const;
+        void WriteBinaryMessage( std::string & out, const CPendingMessage & message ) const;
+
+        static std::vector < double > MakeZipfCdf( const size_t count, const double skew );
+
+    public:
+
+        explicit CLoadGenerator( CSettings settings );
+
+        // writes all messages to the stream throttling them to the rate set
+        void Run( std::FILE * out );
+};
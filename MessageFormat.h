@@ -0,0 +1,45 @@
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+#include "MessageParser.h"
+#include "JsonLinesParser.h"
+#include "BinaryRecordParser.h"
+
+//
+// A parser of one input format: parses a buffer of whole events into events with a trace ID and a request path
+// or a result code, and frames a stream of the format into whole events. Parsing stages are templated on the parser,
+// so the parsing loop of every format is dispatched statically and inlined.
+//
+template < typename T >
+concept MessageParser =
+    std::default_initializable < T >
+    &&
+    requires ( T parser, const std::string_view data, const bool bFastParse, const char * stream, size_t & frame_pos, const size_t offset ) {
+        typename T::t_events;
+        { parser.Parse( data, bFastParse ) } -> std::same_as < const typename T::t_events & >;
+        { T::FindEventsEnd( stream, offset, frame_pos, offset ) } -> std::same_as < size_t >;
+        { T::GetFormatName() } -> std::convertible_to < const char * >;
+    }
+    &&
+    requires ( const std::ranges::range_value_t < typename T::t_events > & event ) {
+        { event.trace_id } -> std::convertible_to < std::string_view >;
+        { event.value } -> std::convertible_to < std::string_view >;
+        { event.bIsResponse } -> std::convertible_to < bool >;
+    };
+
+static_assert( MessageParser < CMessageParser > );
+static_assert( MessageParser < CJsonLinesParser > );
+static_assert( MessageParser < CBinaryRecordParser > );
+
+// calls handler( std::type_identity < parser >() ) with the parser of the input format specified
+template < typename F > decltype( auto ) DispatchInputFormat( const CContext::EInputFormat format, F && handler ) {
+    switch ( format ) {
+        case CContext::INPUT_FORMAT_JSON:
+            return handler( std::type_identity < CJsonLinesParser >() );
+        case CContext::INPUT_FORMAT_BINARY:
+            return handler( std::type_identity < CBinaryRecordParser >() );
+        default:
+            return handler( std::type_identity < CMessageParser >() );
+    }
+}
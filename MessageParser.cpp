@@ -1,75 +1,207 @@
 #include "common.h"
 
+#include <cstring>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define MESSAGE_PARSER_X86 1
+#endif
+
 #include "MessageParser.h"
 
-void CMessageParser::Reset() {
-#ifdef _DEBUG
-    m_message.clear();
-#endif // _DEBUG
-    m_trace_id.clear();
-    m_request_path.clear();
-    m_result_code.clear();
-    m_bIsResponse = false;
-    m_bDone = false;
-}
+namespace {
 
-void CMessageParser::ProcessFirstLine( const std::string & line ) {
-    m_bIsResponse = ( line.rfind( "HTTP/", 0 ) == 0 );
-    auto second_token_start = line.find( ' ' );
-    if ( second_token_start != std::string::npos ) {
-        auto third_token_start = line.find( ' ', second_token_start + 1 );
-        if ( third_token_start == std::string::npos ) {
-            third_token_start = line.length();
+    constexpr std::string_view trace_id_prefix( "X-Trace-ID: " );
+
+    // Scalar mark finder, also used for buffer tails shorter than a vector
+    const char * FindMarkScalar( const char * p, const char * end ) {
+        for ( ; p + 1 < end; p++ ) {
+            if ( *p == '\n' && ( p[ 1 ] == '\n' || p[ 1 ] == 'X' ) ) {
+                return p;
+            }
         }
-        auto second_token = line.substr( second_token_start + 1, third_token_start - second_token_start - 1 );
-        if ( m_bIsResponse ) {
-            m_result_code = second_token;
-        } else {
-            m_request_path = second_token;
+        return end;
+    }
+
+#ifdef MESSAGE_PARSER_X86
+
+    // SSE2 mark finder: compares 16 bytes and the same 16 bytes shifted by one at once
+    const char * FindMarkSSE2( const char * p, const char * end ) {
+        const __m128i lf = _mm_set1_epi8( '\n' );
+        const __m128i x = _mm_set1_epi8( 'X' );
+        for ( ; p + 16 + 1 <= end; p += 16 ) {
+            const __m128i current = _mm_loadu_si128( reinterpret_cast < const __m128i * >( p ) );
+            const __m128i next = _mm_loadu_si128( reinterpret_cast < const __m128i * >( p + 1 ) );
+            const __m128i marks = _mm_and_si128(
+                _mm_cmpeq_epi8( current, lf ),
+                _mm_or_si128( _mm_cmpeq_epi8( next, lf ), _mm_cmpeq_epi8( next, x ) )
+            );
+            if ( const unsigned int mask = _mm_movemask_epi8( marks ); mask != 0 ) {
+                return p + __builtin_ctz( mask );
+            }
         }
+        return FindMarkScalar( p, end );
     }
+
+    // AVX2 mark finder: the same as SSE2 with 32 bytes per step
+    __attribute__(( target( "avx2" ) ))
+    const char * FindMarkAVX2( const char * p, const char * end ) {
+        const __m256i lf = _mm256_set1_epi8( '\n' );
+        const __m256i x = _mm256_set1_epi8( 'X' );
+        for ( ; p + 32 + 1 <= end; p += 32 ) {
+            const __m256i current = _mm256_loadu_si256( reinterpret_cast < const __m256i * >( p ) );
+            const __m256i next = _mm256_loadu_si256( reinterpret_cast < const __m256i * >( p + 1 ) );
+            const __m256i marks = _mm256_and_si256(
+                _mm256_cmpeq_epi8( current, lf ),
+                _mm256_or_si256( _mm256_cmpeq_epi8( next, lf ), _mm256_cmpeq_epi8( next, x ) )
+            );
+            if ( const unsigned int mask = _mm256_movemask_epi8( marks ); mask != 0 ) {
+                return p + __builtin_ctz( mask );
+            }
+        }
+        return FindMarkSSE2( p, end );
+    }
+
+#endif // MESSAGE_PARSER_X86
+
+    // returns a pointer to the first LF or the buffer end (memchr is vectorized by the C library)
+    const char * FindLineEnd( const char * p, const char * end ) {
+        const void * line_end = memchr( p, '\n', end - p );
+        return line_end ? static_cast < const char * >( line_end ) : end;
+    }
+
 }
 
-void CMessageParser::ProcessHeaderLine( const std::string & line ) {
-    static const std::string trace_id_prefix( "X-Trace-ID: " );
-    if ( line.rfind( trace_id_prefix, 0 ) == 0 ) {
-        m_trace_id = line.substr( trace_id_prefix.length() );
+const CMessageParser::t_mark_finder CMessageParser::m_find_mark = CMessageParser::SelectMarkFinder();
+
+// selects the best mark finder supported by the CPU at runtime
+CMessageParser::t_mark_finder CMessageParser::SelectMarkFinder() {
+#ifdef MESSAGE_PARSER_X86
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) ) {
+        return FindMarkAVX2;
+    }
+    if ( __builtin_cpu_supports( "sse2" ) ) {
+        return FindMarkSSE2;
     }
+#endif // MESSAGE_PARSER_X86
+    return FindMarkScalar;
 }
 
-void CMessageParser::ProcessLine( const std::string & line ) {
-    if ( line.empty() ) {
-        m_bDone = true;
-    } else {
-        if ( m_bDone ) {
-            Reset();
-            ProcessFirstLine( line );
-        } else {
-            ProcessHeaderLine( line );
-        }
-#ifdef _DEBUG
-        m_message += line;
-        m_message += '\n';
-#endif // _DEBUG
+const char * CMessageParser::GetImplementationName() {
+#ifdef MESSAGE_PARSER_X86
+    if ( m_find_mark == FindMarkAVX2 ) {
+        return "AVX2";
     }
+    if ( m_find_mark == FindMarkSSE2 ) {
+        return "SSE2";
+    }
+#endif // MESSAGE_PARSER_X86
+    return "scalar";
 }
 
-bool CMessageParser::IsDone() const {
-    return m_bDone;
+const char * CMessageParser::GetFormatName() {
+    return "http";
 }
 
-bool CMessageParser::IsResponse() const {
-    return m_bIsResponse;
+size_t CMessageParser::FindEventsEnd( const char * data, const size_t event_start, size_t & frame_pos, const size_t size ) {
+    // the first LF of the "\n\n" pair may be the last byte searched previously
+    const size_t search_start = std::max( event_start, frame_pos > 0 ? frame_pos - 1 : 0 );
+    frame_pos = size;
+    for ( size_t pos = size; pos >= search_start + 2; pos-- ) {
+        if ( data[ pos - 1 ] == '\n' && data[ pos - 2 ] == '\n' ) {
+            return pos;
+        }
+    }
+    return 0;
 }
 
-const std::string & CMessageParser::GetRequestPath() const {
-    return m_request_path;
+void CMessageParser::ProcessFirstLine( const std::string_view line, CEvent & event ) {
+    event.bIsResponse = line.starts_with( "HTTP/" );
+    auto second_token_start = line.find( ' ' );
+    if ( second_token_start != std::string_view::npos ) {
+        auto third_token_start = line.find( ' ', second_token_start + 1 );
+        if ( third_token_start == std::string_view::npos ) {
+            third_token_start = line.length();
+        }
+        event.value = line.substr( second_token_start + 1, third_token_start - second_token_start - 1 );
+    }
 }
 
-const std::string & CMessageParser::GetTraceID() const {
-    return m_trace_id;
+// locates the event end and the first trace ID header of the event without looking at other header lines,
+// returns a pointer past the event end
+const char * CMessageParser::ParseHeadersFast( const char * p, const char * end, CEvent & event ) {
+    const void * found = memmem( p, end - p, "\n\n", 2 );
+    const char * event_end = found ? static_cast < const char * >( found ) + 1 : end;
+    // the trace ID header starts after a LF, the status line end is included into the search
+    constexpr std::string_view header( "\nX-Trace-ID: " );
+    if ( const void * header_found = memmem( p, event_end - p, header.data(), header.size() ); header_found ) {
+        const char * value = static_cast < const char * >( header_found ) + header.size();
+        event.trace_id = std::string_view( value, FindLineEnd( value, event_end ) );
+    }
+    return found ? event_end + 1 : end;
 }
 
-const std::string & CMessageParser::GetResultCode() const {
-    return m_result_code;
+const CMessageParser::t_events & CMessageParser::Parse( const std::string_view data, const bool bFastParse ) {
+
+    m_events.clear();
+    const char * p = data.data();
+    const char * const end = p + data.size();
+
+    while ( p < end ) {
+
+        // skip empty lines between events
+        while ( p < end && *p == '\n' ) {
+            p++;
+        }
+        if ( p == end ) {
+            break;
+        }
+
+        CEvent & event = m_events.emplace_back();
+#ifdef _DEBUG
+        const char * event_start = p;
+#endif // _DEBUG
+
+        // the first line is a status line
+        const char * mark = FindLineEnd( p, end );
+        ProcessFirstLine( std::string_view( p, mark ), event );
+
+        if ( bFastParse ) {
+            p = ParseHeadersFast( mark, end, event );
+#ifdef _DEBUG
+            event.message = std::string_view( event_start, p );
+#endif // _DEBUG
+            continue;
+        }
+
+        // jump over header lines to the event end, stopping only at lines starting with 'X'
+        while ( true ) {
+            mark = m_find_mark( mark, end );
+            if ( end - mark <= 1 ) {
+                // the last event of the buffer without an empty line
+                p = end;
+                break;
+            }
+            if ( mark[ 1 ] == '\n' ) {
+                // empty line
+                p = mark + 2;
+                break;
+            }
+            const char * line = mark + 1;
+            if ( std::string_view( line, end ).starts_with( trace_id_prefix ) ) {
+                const char * value = line + trace_id_prefix.size();
+                mark = FindLineEnd( value, end );
+                event.trace_id = std::string_view( value, mark );
+            } else {
+                mark = line;
+            }
+        }
+
+#ifdef _DEBUG
+        event.message = std::string_view( event_start, p );
+#endif // _DEBUG
+    }
+
+    return m_events;
 }
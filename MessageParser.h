@@ -3,40 +3,55 @@
 #include "common.h"
 
 //
-// Implements basic task-specific parsing of HTTP events received as a continious stream of lines with a line feed as an event end marker.
+// Implements basic task-specific parsing of HTTP events received as a buffer of lines with an empty line as an event end marker.
+// A buffer is parsed in one pass: event ends and "X-Trace-ID:" header lines are located with vectorized scanning,
+// other header lines are skipped without being split. Parsed events refer to the buffer parsed.
+// The fast mode (used under overload) does not stop at header lines at all: the event end and the first "X-Trace-ID:"
+// header are searched for directly, so only the first of duplicate trace ID headers is used.
 //
 class CMessageParser {
-    protected:
+
+    public:
+
+        //
+        // A parsed event. All fields are views into the buffer parsed.
+        //
+        class CEvent {
+            public:
 #ifdef _DEBUG
-        std::string m_message;
+                std::string_view message;
 #endif // _DEBUG
-        std::string m_trace_id;
-        std::string m_request_path;
-        std::string m_result_code;
-        bool m_bIsResponse = false;
-        bool m_bDone = true;
+                std::string_view trace_id;
+                // request path for a request, result code for a response
+                std::string_view value;
+                bool bIsResponse = false;
+        };
+        typedef std::vector < CEvent > t_events;
 
-        void Reset();
-        void ProcessFirstLine( const std::string & line );
-        void ProcessHeaderLine( const std::string & line );
+    protected:
 
-    public:
+        // returns a pointer to the first LF followed by LF or 'X' or the buffer end
+        typedef const char * ( * t_mark_finder )( const char * p, const char * end );
+        static const t_mark_finder m_find_mark;
+        static t_mark_finder SelectMarkFinder();
 
-        // process a next line of event stream
-        void ProcessLine( const std::string & line );
+        // events parsed from the last buffer (storage is reused between calls)
+        t_events m_events;
 
-        // returns true if event is fully processed (LF was received)
-        bool IsDone() const;
+        static void ProcessFirstLine( const std::string_view line, CEvent & event );
+        static const char * ParseHeadersFast( const char * p, const char * end, CEvent & event );
+
+    public:
 
-        // returns true if a current event is a response (false if it is a request)
-        bool IsResponse() const;
+        // parses all events in the buffer, returned events are valid until the next call
+        const t_events & Parse( const std::string_view data, const bool bFastParse = false );
 
-        // returns a request path of a current event (if it is a request)
-        const std::string & GetRequestPath() const;
+        // returns the offset past the last complete event (an empty line) in data[ event_start, size ),
+        // frame_pos is the offset the previous search stopped at (updated)
+        static size_t FindEventsEnd( const char * data, const size_t event_start, size_t & frame_pos, const size_t size );
 
-        // returns an X-Trace-ID of a current event
-        const std::string & GetTraceID() const;
+        // returns a name of the scanning implementation selected for this CPU
+        static const char * GetImplementationName();
 
-        // returns a result code of a current event (if it is a response)
-        const std::string & GetResultCode() const;
+        static const char * GetFormatName();
 };
@@ -0,0 +1,41 @@
+#include "common.h"
+
+#include "Metrics.h"
+
+static_assert( sizeof( CThreadMetrics ) % 64 == 0 );
+
+CThreadMetrics::CThreadMetrics( const EStage stage_, const unsigned int index_ )
+    : stage( stage_ )
+    , index( index_ )
+{
+}
+
+const char * CThreadMetrics::GetStageName( const EStage stage ) {
+    switch ( stage ) {
+        case STAGE_READER:
+            return "reader";
+        case STAGE_PARSER:
+            return "parser";
+        case STAGE_AGGREGATOR:
+            return "aggregator";
+        case STAGE_OUTPUT:
+            return "output";
+        default:
+            return "unknown";
+    }
+}
+
+CBusyTimer::CBusyTimer( CMetricValue & busy_ns )
+    : m_busy_ns( busy_ns )
+    , m_start( std::chrono::steady_clock::now() )
+{
+}
+
+CBusyTimer::~CBusyTimer() {
+    m_busy_ns.Add( std::chrono::duration_cast < std::chrono::nanoseconds >( std::chrono::steady_clock::now() - m_start ).count() );
+}
+
+CThreadMetrics & CMetrics::Register( const CThreadMetrics::EStage stage ) {
+    std::lock_guard < std::mutex > lock( m_mutex );
+    return m_threads.emplace_back( stage, m_stage_counts[ stage ]++ );
+}
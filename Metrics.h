@@ -0,0 +1,117 @@
+#pragma once
+
+#include "common.h"
+
+//
+// A metric value written by one thread and read by any: a relaxed store of the incremented value
+// is enough with a single writer, so counting costs no locked instructions
+//
+class CMetricValue {
+
+    protected:
+
+        std::atomic < uint64_t > m_value = 0;
+
+    public:
+
+        void Add( const uint64_t delta ) {
+            m_value.store( m_value.load( std::memory_order_relaxed ) + delta, std::memory_order_relaxed );
+        }
+
+        void Set( const uint64_t value ) {
+            m_value.store( value, std::memory_order_relaxed );
+        }
+
+        uint64_t Get() const {
+            return m_value.load( std::memory_order_relaxed );
+        }
+};
+
+//
+// Metrics of one pipeline thread, padded to cache lines so threads never write to a shared line.
+// A stage uses the fields relevant to it, the rest stay zero and are not exported for the stage.
+//
+class alignas( 64 ) CThreadMetrics {
+
+    public:
+
+        enum EStage {
+            STAGE_READER,
+            STAGE_PARSER,
+            STAGE_AGGREGATOR,
+            STAGE_OUTPUT,
+            STAGE_COUNT
+        };
+
+        EStage stage = STAGE_READER;
+        // index of the thread among the threads of its stage
+        unsigned int index = 0;
+
+        // reader: input bytes read, segments submitted; parser: segments parsed
+        CMetricValue bytes;
+        CMetricValue segments;
+        // parser: events parsed; aggregator: events joined
+        CMetricValue requests;
+        CMetricValue responses;
+        // parser: events without a trace ID or a path/result code
+        CMetricValue parse_errors;
+        // aggregator: responses counted with their requests, responses counted as "undefined", requests expired without a response
+        CMetricValue matched_responses;
+        CMetricValue undefined_responses;
+        CMetricValue expired_requests;
+        // aggregator: matched responses received before their requests (their latencies are not recorded)
+        CMetricValue early_received_responses;
+        // aggregator gauges: join state size
+        CMetricValue pending_requests;
+        CMetricValue pending_request_bytes;
+        CMetricValue waiting_responses;
+        // output: intervals written
+        CMetricValue intervals;
+        // time spent processing (not waiting for input or for the next stage)
+        CMetricValue busy_ns;
+
+        CThreadMetrics( const EStage stage_, const unsigned int index_ );
+
+        static const char * GetStageName( const EStage stage );
+};
+
+//
+// Adds the time from construction to destruction to a busy time metric
+//
+class CBusyTimer {
+
+    protected:
+
+        CMetricValue & m_busy_ns;
+        const std::chrono::steady_clock::time_point m_start;
+
+    public:
+
+        explicit CBusyTimer( CMetricValue & busy_ns );
+        ~CBusyTimer();
+};
+
+//
+// Registry of per-thread metrics blocks (blocks keep their addresses until the registry is destroyed)
+//
+class CMetrics {
+
+    protected:
+
+        std::deque < CThreadMetrics > m_threads;
+        std::array < unsigned int, CThreadMetrics::STAGE_COUNT > m_stage_counts {};
+        mutable std::mutex m_mutex;
+
+    public:
+
+        // returns a new block for a thread of the stage specified
+        CThreadMetrics & Register( const CThreadMetrics::EStage stage );
+
+        // calls handler( metrics ) for every block registered
+        template < typename F > void ForEachThread( F handler ) const {
+            std::lock_guard < std::mutex > lock( m_mutex );
+            for ( const auto & metrics : m_threads ) {
+                handler( metrics );
+            }
+        }
+};
@@ -0,0 +1,204 @@
+#include "common.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "MetricsExporter.h"
+
+namespace {
+
+    // a metric kept per thread
+    class CThreadMetricDescription {
+        public:
+            CThreadMetrics::EStage stage;
+            const char * name;
+            const char * type;
+            const char * help;
+            CMetricValue CThreadMetrics::* field;
+    };
+
+    constexpr CThreadMetricDescription THREAD_METRICS[] = {
+        { CThreadMetrics::STAGE_READER, "reader_bytes_total", "counter", "Input bytes read", &CThreadMetrics::bytes },
+        { CThreadMetrics::STAGE_READER, "reader_segments_total", "counter", "Line bucket segments submitted for parsing", &CThreadMetrics::segments },
+        { CThreadMetrics::STAGE_PARSER, "parser_segments_total", "counter", "Line bucket segments parsed", &CThreadMetrics::segments },
+        { CThreadMetrics::STAGE_PARSER, "parser_requests_total", "counter", "Requests parsed", &CThreadMetrics::requests },
+        { CThreadMetrics::STAGE_PARSER, "parser_responses_total", "counter", "Responses parsed", &CThreadMetrics::responses },
+        { CThreadMetrics::STAGE_PARSER, "parser_errors_total", "counter", "Events without a trace ID, a request path or a result code", &CThreadMetrics::parse_errors },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_requests_total", "counter", "Requests joined", &CThreadMetrics::requests },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_responses_total", "counter", "Responses joined", &CThreadMetrics::responses },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_matched_responses_total", "counter", "Responses counted with their requests", &CThreadMetrics::matched_responses },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_undefined_responses_total", "counter", "Responses counted as undefined", &CThreadMetrics::undefined_responses },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_expired_requests_total", "counter", "Requests expired without a response", &CThreadMetrics::expired_requests },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_early_received_responses_total", "counter", "Matched responses received before their requests (latency not recorded)", &CThreadMetrics::early_received_responses },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_pending_requests", "gauge", "Requests waiting for their responses", &CThreadMetrics::pending_requests },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_pending_request_bytes", "gauge", "Memory used by requests waiting for their responses", &CThreadMetrics::pending_request_bytes },
+        { CThreadMetrics::STAGE_AGGREGATOR, "aggregator_waiting_responses", "gauge", "Responses waiting for their requests", &CThreadMetrics::waiting_responses },
+        { CThreadMetrics::STAGE_OUTPUT, "output_intervals_total", "counter", "Intervals output", &CThreadMetrics::intervals },
+    };
+
+    void AddHeader( std::string & s, const std::string_view name, const std::string_view type, const std::string_view help ) {
+        s += "# HELP processor_";
+        s += name;
+        s += ' ';
+        s += help;
+        s += "\n# TYPE processor_";
+        s += name;
+        s += ' ';
+        s += type;
+        s += '\n';
+    }
+
+    void AddSample( std::string & s, const std::string_view name, const std::string_view labels, const std::string_view value ) {
+        s += "processor_";
+        s += name;
+        s += labels;
+        s += ' ';
+        s += value;
+        s += '\n';
+    }
+
+    bool WriteAll( const int fd, const std::string_view data ) {
+        for ( size_t written = 0; written < data.size(); ) {
+            const ssize_t result = send( fd, data.data() + written, data.size() - written, MSG_NOSIGNAL );
+            if ( result < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return false;
+            }
+            written += result;
+        }
+        return true;
+    }
+
+}
+
+CMetricsExporter::CMetricsExporter( PContext context )
+    : m_context( std::move( context ) )
+{
+}
+
+std::string CMetricsExporter::Format() const {
+    std::string s;
+
+    // per-thread counters
+    for ( const auto & description : THREAD_METRICS ) {
+        AddHeader( s, description.name, description.type, description.help );
+        m_context->metrics.ForEachThread( [ & ]( const CThreadMetrics & metrics ) {
+            if ( metrics.stage == description.stage ) {
+                AddSample( s, description.name, "{thread=\"" + std::to_string( metrics.index ) + "\"}", std::to_string( ( metrics.*description.field ).Get() ) );
+            }
+        } );
+    }
+    for ( unsigned int stage = 0; stage < CThreadMetrics::STAGE_COUNT; stage++ ) {
+        const std::string name = std::string( CThreadMetrics::GetStageName( static_cast < CThreadMetrics::EStage >( stage ) ) ) + "_busy_seconds_total";
+        AddHeader( s, name, "counter", "Time spent processing, not waiting for input or for the next stage" );
+        m_context->metrics.ForEachThread( [ & ]( const CThreadMetrics & metrics ) {
+            if ( metrics.stage == stage ) {
+                AddSample( s, name, "{thread=\"" + std::to_string( metrics.index ) + "\"}", std::to_string( metrics.busy_ns.Get() / 1e9 ) );
+            }
+        } );
+    }
+
+    // queues between stages
+    AddHeader( s, "segment_channel_depth", "gauge", "Line bucket segments waiting for parsing" );
+    AddSample( s, "segment_channel_depth", "", std::to_string( m_context->segment_channel->GetSize() ) );
+    AddHeader( s, "event_channel_depth", "gauge", "Event batches waiting for aggregation" );
+    for ( size_t i = 0; i < m_context->partitions.size(); i++ ) {
+        AddSample( s, "event_channel_depth", "{partition=\"" + std::to_string( i ) + "\"}", std::to_string( m_context->partitions[ i ]->event_channel.GetSize() ) );
+    }
+    AddHeader( s, "line_buckets", "gauge", "Line buckets being filled, parsed or joined" );
+    AddSample( s, "line_buckets", "", std::to_string( m_context->line_buckets.GetCount() ) );
+    AddHeader( s, "interval_stats", "gauge", "Intervals being counted or waiting for output" );
+    AddSample( s, "interval_stats", "", std::to_string( m_context->stats.GetCount() ) );
+    AddHeader( s, "input_memory_bytes", "gauge", "Input slabs in flight" );
+    AddSample( s, "input_memory_bytes", "", std::to_string( m_context->slab_pool.GetUsedSize() ) );
+
+    // time since the end of the oldest interval not output yet
+    time_t lag = 0;
+    if ( time_t ts = 0; m_context->stats.GetOldestTimestamp( ts ) ) {
+        lag = std::max < time_t >( time( nullptr ) - m_context->stats.GetQuantizedTime( ts, +1 ), 0 );
+    }
+    AddHeader( s, "output_lag_seconds", "gauge", "Time since the end of the oldest interval not output yet" );
+    AddSample( s, "output_lag_seconds", "", std::to_string( lag ) );
+
+    return s;
+}
+
+// sends metrics to a client connected, with an HTTP response header if the client sends an HTTP request
+void CMetricsExporter::Serve( const int fd ) const {
+    char request[ 1024 ];
+    ssize_t request_size = 0;
+    // a plain client may send nothing at all
+    if ( pollfd pfd { fd, POLLIN, 0 }; poll( &pfd, 1, METRICS_REQUEST_TIMEOUT_MS ) > 0 ) {
+        request_size = recv( fd, request, sizeof( request ), MSG_DONTWAIT );
+    }
+    const std::string body = Format();
+    if ( request_size > 0 && std::string_view( request, request_size ).starts_with( "GET " ) ) {
+        WriteAll( fd, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string( body.size() ) + "\r\n\r\n" );
+    }
+    WriteAll( fd, body );
+}
+
+// replaces the metrics file (readers never see a partial file)
+void CMetricsExporter::Dump() const {
+    const std::string temp_filename = m_context->metrics_filename + ".tmp";
+    {
+        std::ofstream out( temp_filename, std::ios::out | std::ios::trunc );
+        out << Format();
+    }
+    rename( temp_filename.c_str(), m_context->metrics_filename.c_str() );
+}
+
+void CMetricsExporter::Run( const std::stop_token & stoken, const PContext & context ) {
+
+    CMetricsExporter exporter( context );
+
+    int listen_fd = -1;
+    if ( const auto & path = context->metrics_socket; !path.empty() ) {
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        if ( path.size() < sizeof( address.sun_path ) ) {
+            memcpy( address.sun_path, path.c_str(), path.size() + 1 );
+            listen_fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+            // a socket file left by a previous run is replaced
+            unlink( path.c_str() );
+            if ( listen_fd >= 0 && ( bind( listen_fd, reinterpret_cast < sockaddr * >( &address ), sizeof( address ) ) != 0 || listen( listen_fd, 16 ) != 0 ) ) {
+                close( listen_fd );
+                listen_fd = -1;
+            }
+        }
+        if ( listen_fd < 0 ) {
+            std::cout << "Cannot listen for metrics requests on " << path << std::endl;
+        }
+    }
+
+    auto dump_time = std::chrono::steady_clock::now() + std::chrono::seconds( METRICS_DUMP_SECONDS );
+    while ( !stoken.stop_requested() ) {
+        // wake up every 100 ms to check for the stop request
+        pollfd pfd { listen_fd, POLLIN, 0 };
+        if ( poll( &pfd, listen_fd >= 0 ? 1 : 0, 100 ) > 0 ) {
+            if ( const int fd = accept4( listen_fd, nullptr, nullptr, SOCK_CLOEXEC ); fd >= 0 ) {
+                exporter.Serve( fd );
+                close( fd );
+            }
+        }
+        if ( !context->metrics_filename.empty() && std::chrono::steady_clock::now() >= dump_time ) {
+            exporter.Dump();
+            dump_time += std::chrono::seconds( METRICS_DUMP_SECONDS );
+        }
+    }
+
+    // the final values
+    if ( !context->metrics_filename.empty() ) {
+        exporter.Dump();
+    }
+    if ( listen_fd >= 0 ) {
+        close( listen_fd );
+        unlink( context->metrics_socket.c_str() );
+    }
+}
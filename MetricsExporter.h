@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+#include "utils.h"
+
+//
+// Exports pipeline metrics in the Prometheus text format: serves them on a Unix domain socket (to a plain connection
+// or to an HTTP GET, e.g. curl --unix-socket) and dumps them to a file periodically. Per-thread counters are
+// read without stopping the threads, gauges of queues and collections are sampled at export time.
+//
+class CMetricsExporter {
+
+    protected:
+
+        PContext m_context;
+
+        void Serve( const int fd ) const;
+        void Dump() const;
+
+        explicit CMetricsExporter( PContext context );
+
+    public:
+
+        // returns all metrics in the Prometheus text format
+        std::string Format() const;
+
+        static void Run( const std::stop_token & stoken, const PContext & context );
+};
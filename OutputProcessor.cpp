@@ -1,59 +1,518 @@
 #include "common.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <filesystem>
+
 #include "OutputProcessor.h"
 
+namespace {
+
+    // returns the files of intervals retained by a previous run (<file>.<start ts>), oldest first
+    std::deque < std::string > FindRetainedFiles( const std::string & filename ) {
+        const std::filesystem::path path( filename );
+        const std::string prefix = path.filename().string() + ".";
+        std::vector < std::pair < time_t, std::string > > files;
+        std::error_code error;
+        const auto directory = path.has_parent_path() ? path.parent_path() : std::filesystem::path( "." );
+        for ( std::filesystem::directory_iterator it( directory, error ), end; !error && it != end; it.increment( error ) ) {
+            const std::string name = it->path().filename().string();
+            if ( !name.starts_with( prefix ) ) {
+                continue;
+            }
+            const std::string_view suffix = std::string_view( name ).substr( prefix.size() );
+            time_t ts = 0;
+            const auto [ ptr, ec ] = std::from_chars( suffix.data(), suffix.data() + suffix.size(), ts );
+            if ( !suffix.empty() && ec == std::errc() && ptr == suffix.data() + suffix.size() ) {
+                files.emplace_back( ts, ( path.parent_path() / name ).string() );
+            }
+        }
+        std::ranges::sort( files );
+        std::deque < std::string > filenames;
+        for ( auto & file : files ) {
+            filenames.push_back( std::move( file.second ) );
+        }
+        return filenames;
+    }
+
+}
+
 COutputProcessor::COutputProcessor( PContext context )
     : m_context( std::move( context ) )
+    , m_metrics( m_context->metrics.Register( CThreadMetrics::STAGE_OUTPUT ) )
 {
+    if ( !m_context->binary_filename.empty() ) {
+        m_binary_writer = std::make_unique < CBinaryStatsWriter >( m_context->binary_filename, BINARY_STATS_ROLL_SIZE );
+    }
+    if ( !m_context->partial_filename.empty() ) {
+        m_partial_writer = std::make_unique < CBinaryStatsWriter >(
+            m_context->partial_filename, BINARY_STATS_ROLL_SIZE, std::string_view( CPartialStats::FILE_MAGIC, sizeof( CPartialStats::FILE_MAGIC ) )
+        );
+    }
+    if ( m_context->IO_URING && !m_context->filename.empty() ) {
+        m_ring = std::make_unique < CIoUring >();
+        if ( !m_ring->Init( RING_MAX_WRITES ) ) {
+            m_context->DEBUG_OUTPUT && std::cout << "io_uring is not available, writing output with std::ofstream" << std::endl;
+            m_ring.reset();
+        }
+    }
+    for ( const auto & resolution : m_context->output_resolutions ) {
+        auto & rollup = m_rollups.emplace_back();
+        rollup.resolution = &resolution;
+        // intervals retained by a previous run are removed in turn too
+        if ( resolution.retention > 0 ) {
+            rollup.retained_filenames = FindRetainedFiles( resolution.filename );
+        }
+    }
+    // rollups in progress continue from the checkpoint, a rollup of a resolution no longer configured is lost
+    for ( auto & restored : m_context->restored_rollups ) {
+        const auto it = std::ranges::find_if( m_rollups, [ & ]( const CRollup & rollup ) {
+            return rollup.resolution->seconds == restored.seconds && !rollup.stats;
+        } );
+        if ( it == m_rollups.end() ) {
+            m_context->DEBUG_OUTPUT && std::cout << "Rollup of " << restored.seconds << " seconds from the checkpoint is dropped" << std::endl;
+            continue;
+        }
+        it->start_ts = restored.start_ts;
+        it->stats = std::move( restored.stats );
+    }
+    m_context->restored_rollups.clear();
+    m_bRollupsChanged = true;
+    SubmitRollups();
+}
+
+COutputProcessor::~COutputProcessor() {
+    if ( m_fd >= 0 ) {
+        WaitForWrites( 0 );
+        close( m_fd );
+    }
+}
+
+// opens the output file truncating it, waits for the previous contents written asynchronously first
+void COutputProcessor::OpenFile() {
+    if ( !m_ring ) {
+        m_file.open( m_context->filename, std::ios::out | std::ios::trunc );
+        return;
+    }
+    if ( m_fd >= 0 ) {
+        WaitForWrites( 0 );
+        close( m_fd );
+    }
+    m_fd = open( m_context->filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    m_file_offset = 0;
 }
 
-// creates a file with the stats and prints debug data to the console
-void COutputProcessor::DoOutput() {
+// submits a write of the buffer contents without waiting for it
+void COutputProcessor::WriteFile() {
+    WaitForWrites( RING_MAX_WRITES - 1 );
+    auto & write = m_pending_writes.emplace_back();
+    write.data.swap( m_buffer );
+    write.offset = m_file_offset;
+    m_file_offset += write.data.size();
+    m_ring->PrepareWrite( m_fd, write.data.data(), static_cast < unsigned >( write.data.size() ), write.offset, reinterpret_cast < uint64_t >( &write ) );
+    m_ring->Submit();
+    // completed writes are reaped without waiting
+    CIoUring::CCompletion completion;
+    while ( m_ring->PeekCompletion( completion ) ) {
+        HandleWriteCompletion( completion );
+    }
+}
 
+// resubmits the rest of a short write, releases buffers written in order
+void COutputProcessor::HandleWriteCompletion( const CIoUring::CCompletion & completion ) {
+    auto & write = *reinterpret_cast < CPendingWrite * >( completion.user_data );
+    if ( completion.result > 0 && write.written + completion.result < write.data.size() ) {
+        write.written += completion.result;
+        m_ring->PrepareWrite(
+            m_fd, write.data.data() + write.written, static_cast < unsigned >( write.data.size() - write.written ),
+            write.offset + write.written, completion.user_data
+        );
+        m_ring->Submit();
+    } else {
+        // written or failed (write errors are ignored as with std::ofstream)
+        write.bDone = true;
+    }
+    // deque elements are not moved by removing others from the front
+    while ( !m_pending_writes.empty() && m_pending_writes.front().bDone ) {
+        m_pending_writes.pop_front();
+    }
+}
+
+// waits until no more than the count of writes specified is in flight
+void COutputProcessor::WaitForWrites( const size_t max_in_flight ) {
+    CIoUring::CCompletion completion;
+    while ( m_ring->GetInFlightCount() > max_in_flight && m_ring->WaitCompletion( completion ) ) {
+        HandleWriteCompletion( completion );
+    }
+}
+
+// size of the output buffer to flush
+constexpr size_t OUTPUT_BUFFER_SIZE = 64 * 1024;
+
+void COutputProcessor::Write( const std::string_view text ) {
+    m_buffer += text;
+    if ( m_buffer.size() >= OUTPUT_BUFFER_SIZE ) {
+        Flush();
+    }
+}
+
+void COutputProcessor::Write( const long long unsigned int value ) {
+    char text[ 24 ];
+    Write( std::string_view( text, std::to_chars( text, text + sizeof( text ), value ).ptr ) );
+}
+
+// writes microseconds as milliseconds with 3 decimals
+void COutputProcessor::WriteMilliseconds( const uint32_t value_us ) {
+    char text[ 4 ] = { '.', static_cast < char >( '0' + value_us / 100 % 10 ), static_cast < char >( '0' + value_us / 10 % 10 ), static_cast < char >( '0' + value_us % 10 ) };
+    Write( value_us / 1000 );
+    Write( std::string_view( text, sizeof( text ) ) );
+}
+
+void COutputProcessor::Flush() {
+    // rollups are written to their files only (failures are reported on close)
+    if ( m_bRollupOutput ) {
+        m_rollup_file.write( m_buffer.data(), static_cast < std::streamsize >( m_buffer.size() ) );
+        m_buffer.clear();
+        return;
+    }
     if ( m_context->DUMP_TO_STDOUT ) {
-        std::cout << "[ " << to_stream( m_stats_ts ) << " .. " << to_stream( m_min_unprocessed_time ) << " )" << std::endl;
+        std::cout.write( m_buffer.data(), static_cast < std::streamsize >( m_buffer.size() ) );
+    }
+    if ( m_fd >= 0 && !m_buffer.empty() ) {
+        // the buffer is handed over to the write in flight
+        WriteFile();
+        m_buffer.reserve( OUTPUT_BUFFER_SIZE );
+    } else if ( m_file.is_open() ) {
+        m_file.write( m_buffer.data(), static_cast < std::streamsize >( m_buffer.size() ) );
+    }
+    m_buffer.clear();
+}
+
+// opens the file of a rollup interval truncating it (a file named by the interval start if intervals are retained)
+void COutputProcessor::OpenRollupFile( const CRollup & rollup ) {
+    m_rollup_filename = rollup.resolution->filename;
+    if ( rollup.resolution->retention > 0 ) {
+        m_rollup_filename += "." + std::to_string( rollup.start_ts );
+        // an interval rewritten after a restart gets a new file (renaming a link to the same file does nothing)
+        unlink( m_rollup_filename.c_str() );
+    }
+    m_rollup_file.open( m_rollup_filename, std::ios::out | std::ios::trunc );
+    m_bRollupOutput = true;
+}
+
+// closes the file of a rollup interval, links a retained interval as the newest one and removes intervals out of retention
+void COutputProcessor::CloseRollupFile( CRollup & rollup ) {
+    m_rollup_file.close();
+    // the stream fails if it was not opened or a write or the close failed
+    const bool bWritten = !m_rollup_file.fail();
+    m_rollup_file.clear();
+    m_bRollupOutput = false;
+    const auto & resolution = *rollup.resolution;
+    if ( !bWritten ) {
+        std::cout << "Cannot write rollup to " << m_rollup_filename << std::endl;
+        // an incomplete retained interval is removed, the resolution file still links the previous one
+        if ( resolution.retention > 0 ) {
+            unlink( m_rollup_filename.c_str() );
+            std::erase( rollup.retained_filenames, m_rollup_filename );
+        }
+        return;
+    }
+    if ( resolution.retention == 0 ) {
+        return;
+    }
+    // the resolution file is replaced with a new link atomically, so readers never see it missing or partially written
+    const std::string link_filename = resolution.filename + ".new";
+    unlink( link_filename.c_str() );
+    if ( link( m_rollup_filename.c_str(), link_filename.c_str() ) != 0 || rename( link_filename.c_str(), resolution.filename.c_str() ) != 0 ) {
+        std::cout << "Cannot link " << m_rollup_filename << " as " << resolution.filename << std::endl;
+    }
+    // an interval rewritten after a restart is retained once
+    std::erase( rollup.retained_filenames, m_rollup_filename );
+    rollup.retained_filenames.push_back( m_rollup_filename );
+    while ( rollup.retained_filenames.size() > resolution.retention ) {
+        unlink( rollup.retained_filenames.front().c_str() );
+        rollup.retained_filenames.pop_front();
+    }
+}
+
+// merges an interval output into the rollups of coarser resolutions, outputs the rollups it ends
+void COutputProcessor::RollUp( const CAggregatedStats & interval_stats, const time_t start_ts, const time_t end_ts ) {
+    // rollups whose last intervals had no stats end before the interval
+    OutputRollups( start_ts );
+    for ( auto & rollup : m_rollups ) {
+        if ( !rollup.stats ) {
+            rollup.start_ts = start_ts / rollup.resolution->seconds * rollup.resolution->seconds;
+            rollup.stats = std::make_shared < CAggregatedStats >();
+        }
+        rollup.stats->Merge( interval_stats );
+    }
+    m_bRollupsChanged = true;
+    OutputRollups( end_ts );
+}
+
+// outputs the rollups ending at or before the time specified
+void COutputProcessor::OutputRollups( const time_t ts ) {
+    for ( auto & rollup : m_rollups ) {
+        if ( rollup.stats && rollup.start_ts + rollup.resolution->seconds <= ts ) {
+            DoOutput( *rollup.stats, rollup.start_ts, rollup.start_ts + rollup.resolution->seconds, &rollup );
+            rollup.stats.reset();
+            m_bRollupsChanged = true;
+        }
+    }
+}
+
+// creates a file with the stats and prints debug data to the console (an interval of the aggregated stats),
+// or creates the file of a rollup interval
+void COutputProcessor::DoOutput( const CAggregatedStats & interval_stats, const time_t start_ts, const time_t end_ts, CRollup * rollup ) {
+
+    CBusyTimer busy_timer( m_metrics.busy_ns );
+
+    if ( !rollup ) {
+        m_metrics.intervals.Add( 1 );
+        if ( m_context->DUMP_TO_STDOUT ) {
+            std::cout << "[ " << to_stream( start_ts ) << " .. " << to_stream( end_ts ) << " )" << std::endl;
+        }
+    }
+
+    // rows referencing cells of the snapshot and dictionary strings, sorted by request and result code
+    // to stream them in order with the same result code columns order for every request
+    // (a reserved request ID is named as a path may be, so rows of a request are told by the ID)
+    struct CRow {
+        CDictionary::t_id request_id;
+        std::string_view request;
+        std::string_view result_code;
+        long long unsigned int count;
+        long long unsigned int variance;
+        const CLatencyHistogram * latencies;
+    };
+    std::vector < CRow > rows;
+    std::vector < bool > has_result_code;
+    interval_stats.ForEachCell( OTHER_REQUEST_ID, [ & ]( const CAggregatedStats::t_key key, const CAggregatedStats::CCell & cell ) {
+        const auto result_code_id = CAggregatedStats::GetResultCodeID( key );
+        rows.push_back( {
+            CAggregatedStats::GetRequestID( key ),
+            m_context->request_paths.GetString( CAggregatedStats::GetRequestID( key ) ),
+            m_context->result_codes.GetString( result_code_id ),
+            cell.count,
+            cell.variance,
+            cell.latencies.get()
+        } );
+        if ( result_code_id >= has_result_code.size() ) {
+            has_result_code.resize( result_code_id + 1 );
+        }
+        has_result_code[ result_code_id ] = true;
+    } );
+    std::ranges::sort( rows, std::less(), []( const CRow & row ) {
+        return std::make_tuple( row.request, row.request_id, row.result_code );
+    } );
+    std::vector < std::string_view > result_codes;
+    for ( CDictionary::t_id id = 0; id < has_result_code.size(); id++ ) {
+        if ( has_result_code[ id ] ) {
+            result_codes.push_back( m_context->result_codes.GetString( id ) );
+        }
     }
+    std::ranges::sort( result_codes );
 
-    std::string s;
+    // latency percentile columns (the same in the binary stats)
+    constexpr std::pair < std::string_view, double > latency_columns[] = { { " p50", 0.5 }, { " p90", 0.9 }, { " p99", 0.99 }, { " max", 1 } };
+    static_assert( std::size( latency_columns ) == CBinaryStats::LATENCY_COLUMN_COUNT );
 
-    std::lock_guard < std::mutex > lock( m_stats_item->GetMutex() );
-    auto result_map = m_stats_item->GetStats();
+    // calls handler( result_code, row or nullptr ) for every result code column of the request row group starting at begin,
+    // returns the end of the group
+    const auto for_each_column = [ & ]( std::vector < CRow >::const_iterator begin, const auto & handler ) {
+        const auto request_id = begin->request_id;
+        for ( const auto & result_code : result_codes ) {
+            const bool bHasRow = begin != rows.end() && begin->request_id == request_id && begin->result_code == result_code;
+            handler( result_code, bHasRow ? &*begin : nullptr );
+            // rows are unique per (request ID, result code) as dictionary strings are unique
+            begin += bHasRow;
+        }
+        return begin;
+    };
 
-    // collect and sort all result codes to use the column same order for the every request row
-    std::set < std::string > result_codes;
-    for ( const auto & stats : std::views::values( result_map ) ) {
-        const auto & request_result_codes = std::views::keys( stats );
-        result_codes.insert( request_result_codes.begin(), request_result_codes.end() );
+    if ( rollup ) {
+        OpenRollupFile( *rollup );
+    } else if ( !m_context->filename.empty() ) {
+        OpenFile();
     }
 
-    const char * csv_separator = ";";//"\t";
+    const std::string_view csv_separator = ";";//"\t";
 
     // request path column header
-    s += "request";
+    Write( "request" );
 
     // result code headers
     for ( const auto & result_code : result_codes ) {
-        s += csv_separator;
-        s += result_code;
+        Write( csv_separator );
+        Write( result_code );
+    }
+
+    // latency percentile headers
+    if ( m_context->LATENCY_COLUMNS ) {
+        for ( const auto & result_code : result_codes ) {
+            for ( const auto & [ suffix, fraction ] : latency_columns ) {
+                Write( csv_separator );
+                Write( result_code );
+                Write( suffix );
+            }
+        }
     }
 
     // data rows
-    for ( auto & [ request, stats ] : result_map ) {
-        s += "\n";
-        s += request;
+    for ( auto it = rows.cbegin(); it != rows.cend(); ) {
+        Write( "\n" );
+        Write( it->request );
+        const auto next = for_each_column( it, [ & ]( std::string_view, const CRow * row ) {
+            Write( csv_separator );
+            Write( row ? row->count : 0 );
+        } );
+        // latencies in milliseconds, empty if there are none
+        if ( m_context->LATENCY_COLUMNS ) {
+            for_each_column( it, [ & ]( std::string_view, const CRow * row ) {
+                for ( const auto & [ suffix, fraction ] : latency_columns ) {
+                    Write( csv_separator );
+                    if ( row && row->latencies ) {
+                        WriteMilliseconds( fraction < 1 ? row->latencies->GetPercentile( fraction ) : row->latencies->GetMax() );
+                    }
+                }
+            } );
+        }
+        it = next;
+    }
+
+    // counts are estimated from a sample, reporting the rate and 95% confidence interval half-widths (normal approximation)
+    if ( m_context->sampler.IsEnabled() ) {
+        const auto half_width = []( const long long unsigned int variance ) {
+            return static_cast < long long unsigned int >( std::llround( 1.96 * std::sqrt( static_cast < double >( variance ) ) ) );
+        };
+        const auto total_count = interval_stats.GetTotalCount();
+        Write( "\n# sample rate: " + std::to_string( total_count ? static_cast < double >( interval_stats.GetSampleCount() ) / total_count : 1.0 ) );
+        Write( "; 95% confidence interval of the total: " );
+        Write( total_count );
+        Write( " +- " );
+        Write( half_width( interval_stats.GetTotalVariance() ) );
+        Write( "\n# 95% confidence interval half-widths:" );
+        Write( "\n# request" );
         for ( const auto & result_code : result_codes ) {
-            s += csv_separator;
-            s += std::to_string( stats[ result_code ] );
+            Write( csv_separator );
+            Write( result_code );
         }
+        for ( auto it = rows.cbegin(); it != rows.cend(); ) {
+            Write( "\n# " );
+            Write( it->request );
+            it = for_each_column( it, [ & ]( std::string_view, const CRow * row ) {
+                Write( csv_separator );
+                Write( row ? half_width( row->variance ) : 0 );
+            } );
+        }
+    }
+
+    // counts of top paths are estimated by the sketch
+    if ( const auto sketch = interval_stats.GetSketch() ) {
+        Write( "\n# top paths: " );
+        Write( sketch->GetPathCount() );
+        Write( "; count overestimation bound: " );
+        Write( sketch->GetErrorBound() );
+        Write( " (probability " + std::to_string( 1 - std::exp( -static_cast < double >( CStatsSketch::DEPTH ) ) ) + ")" );
     }
 
-    if ( !m_context->filename.empty() ) {
-        std::ofstream out_file( m_context->filename );
-        out_file << s;
+    // overload protection makes the counts above inexact, reporting by how much
+    if ( const auto & counters = interval_stats.GetOverloadCounters(); !counters.IsEmpty() ) {
+        Write( "\n# shed events: " );
+        Write( counters.shed_events );
+        Write( "; fast parsed events: " );
+        Write( counters.fast_parsed_events );
+        Write( "; dropped requests: " );
+        Write( counters.dropped_requests );
+        Write( "; overflow responses: " );
+        Write( counters.overflow_responses );
+        Write( "; input stall ms: " );
+        Write( counters.input_stall_ms );
     }
 
+    Flush();
+
+    if ( rollup ) {
+        CloseRollupFile( *rollup );
+        return;
+    }
+
+    // the interval is appended to the binary stats file too, paths and codes are referred to by indexes of their sorted lists
+    if ( m_binary_writer ) {
+        auto & interval = m_binary_interval;
+        interval.start_ts = start_ts;
+        interval.end_ts = end_ts;
+        interval.flags =
+            ( m_context->sampler.IsEnabled() ? static_cast < uint32_t >( CBinaryStats::FLAG_SAMPLED ) : 0 )
+            | ( m_context->LATENCY_COLUMNS ? static_cast < uint32_t >( CBinaryStats::FLAG_LATENCIES ) : 0 );
+        interval.total_count = interval_stats.GetTotalCount();
+        interval.sample_count = interval_stats.GetSampleCount();
+        interval.total_variance = interval_stats.GetTotalVariance();
+        interval.paths.clear();
+        interval.codes = result_codes;
+        interval.rows.clear();
+        for ( size_t row_index = 0; row_index < rows.size(); row_index++ ) {
+            const auto & row = rows[ row_index ];
+            if ( row_index == 0 || rows[ row_index - 1 ].request_id != row.request_id ) {
+                interval.paths.push_back( row.request );
+            }
+            auto & binary_row = interval.rows.emplace_back();
+            binary_row.path = static_cast < uint32_t >( interval.paths.size() - 1 );
+            binary_row.code = static_cast < uint32_t >( std::ranges::lower_bound( result_codes, row.result_code ) - result_codes.begin() );
+            binary_row.count = row.count;
+            binary_row.variance = row.variance;
+            if ( m_context->LATENCY_COLUMNS && row.latencies ) {
+                for ( size_t i = 0; i < std::size( latency_columns ); i++ ) {
+                    const double fraction = latency_columns[ i ].second;
+                    binary_row.latencies[ i ] = fraction < 1 ? row.latencies->GetPercentile( fraction ) : row.latencies->GetMax();
+                }
+            }
+        }
+        if ( !m_binary_writer->Append( interval ) ) {
+            std::cout << "Cannot write binary stats to " << m_context->binary_filename << std::endl;
+        }
+    }
+
+    // the interval is appended to the partial stats file to be merged with intervals of other instances
+    if ( m_partial_writer ) {
+        auto & partial = m_partial_interval;
+        partial.Clear();
+        partial.start_ts = start_ts;
+        partial.end_ts = end_ts;
+        partial.flags =
+            ( m_context->sampler.IsEnabled() ? CPartialStats::FLAG_SAMPLED : 0 )
+            | ( m_context->LATENCY_COLUMNS ? CPartialStats::FLAG_LATENCIES : 0 )
+            | ( interval_stats.GetSketch() ? CPartialStats::FLAG_SKETCH : 0 );
+        partial.total_count = interval_stats.GetTotalCount();
+        partial.sample_count = interval_stats.GetSampleCount();
+        partial.total_variance = interval_stats.GetTotalVariance();
+        partial.sketch_error_bound = interval_stats.GetSketch() ? interval_stats.GetSketch()->GetErrorBound() : 0;
+        const auto & counters = interval_stats.GetOverloadCounters();
+        partial.shed_events = counters.shed_events;
+        partial.fast_parsed_events = counters.fast_parsed_events;
+        partial.dropped_requests = counters.dropped_requests;
+        partial.overflow_responses = counters.overflow_responses;
+        partial.input_stall_ms = counters.input_stall_ms;
+        for ( const auto & row : rows ) {
+            if ( row.request_id == OTHER_REQUEST_ID ) {
+                partial.AddOtherCell( row.result_code, row.count, row.variance, row.latencies );
+            } else {
+                partial.AddCell( row.request, row.result_code, row.count, row.variance, row.latencies );
+            }
+        }
+        CPartialStats::Encode( partial, m_partial_record );
+        if ( !m_partial_writer->AppendRecord( m_partial_record, end_ts ) ) {
+            std::cout << "Cannot write partial stats to " << m_context->partial_filename << std::endl;
+        }
+    }
+
+    // the file written with io_uring is closed once the writes are done
+    if ( m_file.is_open() ) {
+        m_file.close();
+    }
     if ( m_context->DUMP_TO_STDOUT ) {
-        std::cout << s << std::endl;
+        std::cout << std::endl;
     }
 
 }
@@ -65,7 +524,7 @@ bool COutputProcessor::OutputStats( const bool bForceOutput ) {
     bool bShouldWait = false;
 
     // left (inclusive) edge of an interval
-    time_t current_time = CAggregatedStatsCollection::GetQuantizedTime( time( nullptr ) );
+    time_t current_time = m_context->stats.GetQuantizedTime( time( nullptr ) );
 
     // iterate over every stats set starting from oldest
     while (
@@ -83,48 +542,71 @@ bool COutputProcessor::OutputStats( const bool bForceOutput ) {
     ) {
 
         // right (exclusive) edge of an interval
-        m_min_unprocessed_time = CAggregatedStatsCollection::GetQuantizedTime( m_stats_ts, +1 );
+        m_min_unprocessed_time = m_context->stats.GetQuantizedTime( m_stats_ts, +1 );
 
-        // check if there are no interval-related or older line buckets in a process of filling
-        if ( time_t ts = 0; m_context->filling_line_buckets.GetOldestTimestamp( ts ) && ts < m_min_unprocessed_time ) {
-            m_context->DEBUG_OUTPUT && std::cout << "Waiting for unfilled line bucket at " << ts - m_min_unprocessed_time << " seconds" << std::endl;
-            bShouldWait = true;
-        }
-
-        // check if there are no interval-related or older unprocessed filled line buckets
-        if ( time_t ts = 0; m_context->ready_line_buckets.GetOldestTimestamp( ts ) && ts < m_min_unprocessed_time ) {
-            m_context->DEBUG_OUTPUT && std::cout << "Waiting for unparsed line bucket at " << ts - m_min_unprocessed_time << " seconds" << std::endl;
-            bShouldWait = true;
-        }
-
-        // check if there are no interval-related or older unprocessed response buckets
-        if ( time_t ts = 0; m_context->response_map.GetOldestTimestamp( ts ) && ts < m_min_unprocessed_time ) {
-            m_context->DEBUG_OUTPUT && std::cout << "Waiting for unparsed response bucket at " << ts - m_min_unprocessed_time << " seconds" << std::endl;
+        // check if all events of the interval are received, parsed, joined and counted
+        if ( time_t ts = m_context->GetJoinedTimeLimit(); ts < m_min_unprocessed_time ) {
+            m_context->DEBUG_OUTPUT && std::cout << "Waiting for unjoined events at " << ts - m_min_unprocessed_time << " seconds" << std::endl;
             bShouldWait = true;
         }
 
         if ( !bShouldWait ) {
             // stats to output are fully ready
             bResult = true;
-            DoOutput();
+            // the shards are taken out of checkpoints from now on
+            m_context->output_watermark = m_min_unprocessed_time;
+            // all shards are handed over, taking them and merging into a read-only snapshot
+            const auto interval_stats = m_stats_item->Merge();
+            DoOutput( *interval_stats, m_stats_ts, m_min_unprocessed_time, nullptr );
+            RollUp( *interval_stats, m_stats_ts, m_min_unprocessed_time );
             m_context->stats.RemoveItem( m_stats_item );
         }
     }
 
+    // rollups are complete once all events before their end are counted (the shards of their intervals are handed over
+    // by then) and their intervals are output
+    time_t rollup_limit = m_context->GetJoinedTimeLimit();
+    if ( time_t ts = 0; m_context->stats.GetOldestTimestamp( ts ) ) {
+        rollup_limit = std::min( rollup_limit, ts );
+    }
+    OutputRollups( rollup_limit );
+    SubmitRollups();
+
     return bResult;
 }
 
+// submits a copy of the rollups in progress for checkpoints if they changed, together with the output watermark
+// (all intervals before it are rolled up)
+void COutputProcessor::SubmitRollups() {
+    if ( m_context->checkpoint_filename.empty() || m_rollups.empty() || !m_bRollupsChanged ) {
+        return;
+    }
+    m_bRollupsChanged = false;
+    auto part = std::make_unique < CCheckpoint::CPart >();
+    for ( const auto & rollup : m_rollups ) {
+        if ( rollup.stats ) {
+            part->AddRollup( rollup.resolution->seconds, rollup.start_ts, *rollup.stats, OTHER_REQUEST_ID );
+        }
+    }
+    m_context->checkpoint_parts.SubmitRollups( m_context->output_watermark, std::move( part ) );
+}
+
 void COutputProcessor::Run( const std::stop_token & stoken, const PContext & context ) {
-    bool bHadOutput = false;
+    // kept for the whole run to let asynchronous writes of a file complete while the next interval is collected
+    COutputProcessor op( context );
     while ( true ) {
         std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
-        COutputProcessor op( context );
-        bool bForceOutput = stoken.stop_requested() && !bHadOutput; // force output on exit is there was no output yet
-        if ( op.OutputStats( bForceOutput ) ) {
-            bHadOutput = true;
-        }
+        // force output of all remaining intervals on exit: all events are counted by then
+        // (unless incomplete intervals are checkpointed for the next run)
+        bool bForceOutput = stoken.stop_requested() && !context->IsKeepingStateOnExit();
+        op.OutputStats( bForceOutput );
         if ( stoken.stop_requested() ) {
             break;
         }
     }
+    // rollups in progress are checkpointed for the next run or output as they are
+    if ( !context->IsKeepingStateOnExit() ) {
+        op.OutputRollups( std::numeric_limits < time_t >::max() );
+    }
+    op.SubmitRollups();
 }
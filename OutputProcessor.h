@@ -2,6 +2,9 @@
 
 #include "common.h"
 #include "utils.h"
+#include "IoUring.h"
+#include "BinaryStats.h"
+#include "PartialStats.h"
 
 //
 // Performs periodic output of aggregated stats for the interval of time ensuring that all interval data are processed prior to output
@@ -12,13 +15,74 @@ class COutputProcessor {
 
         time_t m_stats_ts = 0;
         time_t m_min_unprocessed_time = 0;
-        PAggregatedStats m_stats_item;
+        PIntervalStats m_stats_item;
         PContext m_context;
+        CThreadMetrics & m_metrics;
 
-        void DoOutput();
+        // serialized output, flushed to the output file and the console whenever it fills up
+        std::string m_buffer;
+        std::ofstream m_file;
+
+        // io_uring output: flushed buffers are written asynchronously, the file is closed once they are written
+        class CPendingWrite {
+            public:
+                std::string data;
+                uint64_t offset = 0;
+                size_t written = 0;
+                bool bDone = false;
+        };
+        std::unique_ptr < CIoUring > m_ring;
+        int m_fd = -1;
+        uint64_t m_file_offset = 0;
+        std::deque < CPendingWrite > m_pending_writes;
+
+        // intervals appended to the binary stats file
+        std::unique_ptr < CBinaryStatsWriter > m_binary_writer;
+        CBinaryStats::CInterval m_binary_interval;
+
+        // intervals appended to the partial stats file
+        std::unique_ptr < CBinaryStatsWriter > m_partial_writer;
+        CPartialStats::CInterval m_partial_interval;
+        std::string m_partial_record;
+
+        // interval of a coarser resolution the intervals output are merged into until it ends
+        class CRollup {
+            public:
+                const COutputResolution * resolution = nullptr;
+                time_t start_ts = 0;
+                PAggregatedStats stats;
+                // files of the intervals retained, oldest first
+                std::deque < std::string > retained_filenames;
+        };
+        std::vector < CRollup > m_rollups;
+        // file of the rollup interval being written
+        std::ofstream m_rollup_file;
+        std::string m_rollup_filename;
+        // output is written to the rollup file (even if it failed to open)
+        bool m_bRollupOutput = false;
+        // rollups changed since they were last submitted for checkpoints
+        bool m_bRollupsChanged = false;
+
+        void OpenFile();
+        void WriteFile();
+        void HandleWriteCompletion( const CIoUring::CCompletion & completion );
+        void WaitForWrites( const size_t max_in_flight );
+        void Write( const std::string_view text );
+        void Write( const long long unsigned int value );
+        void WriteMilliseconds( const uint32_t value_us );
+        void Flush();
+
+        void OpenRollupFile( const CRollup & rollup );
+        void CloseRollupFile( CRollup & rollup );
+        void RollUp( const CAggregatedStats & interval_stats, const time_t start_ts, const time_t end_ts );
+        void OutputRollups( const time_t ts );
+        void SubmitRollups();
+
+        void DoOutput( const CAggregatedStats & interval_stats, const time_t start_ts, const time_t end_ts, CRollup * rollup );
         bool OutputStats( const bool bForceOutput );
 
         explicit COutputProcessor( PContext context );
+        ~COutputProcessor();
 
     public:
 
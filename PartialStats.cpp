@@ -0,0 +1,280 @@
+#include "common.h"
+
+#include <cstring>
+
+#include "PartialStats.h"
+
+// records are copied as they are
+static_assert( std::endian::native == std::endian::little );
+static_assert( sizeof( CPartialStats::CRecordHeader ) == 112 );
+static_assert( sizeof( CPartialStats::CCellRecord ) == 32 );
+static_assert( sizeof( CPartialStats::CLatencyRecord ) == 16 );
+
+namespace {
+
+    template < typename T > void Append( std::string & s, const T & value ) {
+        s.append( reinterpret_cast < const char * >( &value ), sizeof( value ) );
+    }
+
+    // reads a value at the position specified moving it, returns false if the data ends before the value does
+    template < typename T > bool Read( const std::string_view data, size_t & pos, T & value ) {
+        if ( sizeof( value ) > data.size() - pos ) {
+            return false;
+        }
+        memcpy( &value, data.data() + pos, sizeof( value ) );
+        pos += sizeof( value );
+        return true;
+    }
+
+    void AppendString( std::string & s, const std::string_view value ) {
+        Append( s, static_cast < uint32_t >( value.size() ) );
+        s += value;
+    }
+
+    bool ReadString( const std::string_view data, size_t & pos, std::string_view & value ) {
+        uint32_t size = 0;
+        if ( !Read( data, pos, size ) || size > data.size() - pos ) {
+            return false;
+        }
+        value = data.substr( pos, size );
+        pos += size;
+        return true;
+    }
+
+    void AddToCell( CPartialStats::CCell & cell, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies ) {
+        cell.count += count;
+        cell.variance += variance;
+        if ( latencies ) {
+            if ( cell.latencies ) {
+                cell.latencies->Merge( *latencies );
+            } else {
+                cell.latencies = std::make_unique < CLatencyHistogram >( *latencies );
+            }
+        }
+    }
+
+}
+
+void CPartialStats::CInterval::AddCell( const std::string_view path, const std::string_view code, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies ) {
+    AddToCell( cells[ { std::string( path ), std::string( code ) } ], count, variance, latencies );
+}
+
+void CPartialStats::CInterval::AddOtherCell( const std::string_view code, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies ) {
+    auto it = other_cells.find( code );
+    if ( it == other_cells.end() ) {
+        it = other_cells.emplace( std::string( code ), CCell() ).first;
+    }
+    AddToCell( it->second, count, variance, latencies );
+}
+
+void CPartialStats::CInterval::Merge( const CInterval & other ) {
+    end_ts = std::max( end_ts, other.end_ts );
+    flags |= other.flags;
+    total_count += other.total_count;
+    sample_count += other.sample_count;
+    total_variance += other.total_variance;
+    sketch_error_bound += other.sketch_error_bound;
+    shed_events += other.shed_events;
+    fast_parsed_events += other.fast_parsed_events;
+    dropped_requests += other.dropped_requests;
+    overflow_responses += other.overflow_responses;
+    input_stall_ms += other.input_stall_ms;
+    for ( const auto & [ key, cell ] : other.cells ) {
+        AddCell( key.first, key.second, cell.count, cell.variance, cell.latencies.get() );
+    }
+    for ( const auto & [ code, cell ] : other.other_cells ) {
+        AddOtherCell( code, cell.count, cell.variance, cell.latencies.get() );
+    }
+}
+
+void CPartialStats::CInterval::Clear() {
+    *this = CInterval();
+}
+
+void CPartialStats::Encode( const CInterval & interval, std::string & record ) {
+
+    // cells are sorted by path, so paths are unique in order, codes are collected and indexed
+    std::vector < std::string_view > paths;
+    std::vector < std::string_view > codes;
+    for ( const auto & [ key, cell ] : interval.cells ) {
+        if ( paths.empty() || paths.back() != key.first ) {
+            paths.push_back( key.first );
+        }
+        codes.push_back( key.second );
+    }
+    for ( const auto & [ code, cell ] : interval.other_cells ) {
+        codes.push_back( code );
+    }
+    std::ranges::sort( codes );
+    codes.erase( std::unique( codes.begin(), codes.end() ), codes.end() );
+
+    CRecordHeader header {};
+    memcpy( header.magic, RECORD_MAGIC, sizeof( header.magic ) );
+    header.version = VERSION;
+    header.flags = interval.flags;
+    header.path_count = static_cast < uint32_t >( paths.size() );
+    header.code_count = static_cast < uint32_t >( codes.size() );
+    header.cell_count = static_cast < uint32_t >( interval.cells.size() + interval.other_cells.size() );
+    header.start_ts = interval.start_ts;
+    header.end_ts = interval.end_ts;
+    header.total_count = interval.total_count;
+    header.sample_count = interval.sample_count;
+    header.total_variance = interval.total_variance;
+    header.sketch_error_bound = interval.sketch_error_bound;
+    header.shed_events = interval.shed_events;
+    header.fast_parsed_events = interval.fast_parsed_events;
+    header.dropped_requests = interval.dropped_requests;
+    header.overflow_responses = interval.overflow_responses;
+    header.input_stall_ms = interval.input_stall_ms;
+
+    record.clear();
+    Append( record, header );
+    for ( const auto & path : paths ) {
+        AppendString( record, path );
+    }
+    for ( const auto & code : codes ) {
+        AppendString( record, code );
+    }
+    const auto append_cell = [ & ]( const uint32_t path_index, const std::string_view code, const CCell & cell ) {
+        CCellRecord cell_record {
+            path_index,
+            static_cast < uint32_t >( std::ranges::lower_bound( codes, code ) - codes.begin() ),
+            cell.count,
+            cell.variance,
+            0,
+            cell.latencies ? cell.latencies->GetMax() : 0
+        };
+        const size_t cell_offset = record.size();
+        Append( record, cell_record );
+        if ( cell.latencies ) {
+            cell.latencies->ForEachBucket( [ & ]( const unsigned int bucket, const uint64_t count ) {
+                Append( record, CLatencyRecord { bucket, 0, count } );
+                cell_record.latency_count++;
+            } );
+            memcpy( record.data() + cell_offset, &cell_record, sizeof( cell_record ) );
+        }
+    };
+    uint32_t path_index = 0;
+    for ( const auto & [ key, cell ] : interval.cells ) {
+        while ( paths[ path_index ] != key.first ) {
+            path_index++;
+        }
+        append_cell( path_index, key.second, cell );
+    }
+    for ( const auto & [ code, cell ] : interval.other_cells ) {
+        append_cell( OTHER_PATH_INDEX, code, cell );
+    }
+
+    // the size is known once all cells are encoded
+    const auto record_size = static_cast < uint32_t >( record.size() );
+    memcpy( record.data() + offsetof( CRecordHeader, record_size ), &record_size, sizeof( record_size ) );
+}
+
+bool CPartialStats::Decode( const std::string_view record, CInterval & interval ) {
+
+    CRecordHeader header;
+    size_t pos = 0;
+    if (
+        !Read( record, pos, header )
+        ||
+        memcmp( header.magic, RECORD_MAGIC, sizeof( header.magic ) ) != 0
+        ||
+        header.version == 0
+        ||
+        header.version > VERSION
+        ||
+        header.record_size != record.size()
+        ||
+        // every string takes its length at least
+        uint64_t( header.path_count ) + header.code_count > record.size() / sizeof( uint32_t )
+    ) {
+        return false;
+    }
+
+    interval.Clear();
+    interval.start_ts = header.start_ts;
+    interval.end_ts = header.end_ts;
+    interval.flags = header.flags;
+    interval.total_count = header.total_count;
+    interval.sample_count = header.sample_count;
+    interval.total_variance = header.total_variance;
+    interval.sketch_error_bound = header.sketch_error_bound;
+    interval.shed_events = header.shed_events;
+    interval.fast_parsed_events = header.fast_parsed_events;
+    interval.dropped_requests = header.dropped_requests;
+    interval.overflow_responses = header.overflow_responses;
+    interval.input_stall_ms = header.input_stall_ms;
+
+    std::vector < std::string_view > paths( header.path_count );
+    std::vector < std::string_view > codes( header.code_count );
+    for ( auto & path : paths ) {
+        if ( !ReadString( record, pos, path ) ) {
+            return false;
+        }
+    }
+    for ( auto & code : codes ) {
+        if ( !ReadString( record, pos, code ) ) {
+            return false;
+        }
+    }
+    for ( uint32_t i = 0; i < header.cell_count; i++ ) {
+        CCellRecord cell;
+        if ( !Read( record, pos, cell ) || ( cell.path >= paths.size() && cell.path != OTHER_PATH_INDEX ) || cell.code >= codes.size() ) {
+            return false;
+        }
+        PLatencyHistogram latencies;
+        if ( cell.latency_count > 0 ) {
+            latencies = std::make_unique < CLatencyHistogram >();
+            for ( uint32_t j = 0; j < cell.latency_count; j++ ) {
+                CLatencyRecord latency;
+                if ( !Read( record, pos, latency ) ) {
+                    return false;
+                }
+                latencies->AddBucket( latency.bucket, latency.count, cell.latency_max );
+            }
+        }
+        if ( cell.path == OTHER_PATH_INDEX ) {
+            interval.AddOtherCell( codes[ cell.code ], cell.count, cell.variance, latencies.get() );
+        } else {
+            interval.AddCell( paths[ cell.path ], codes[ cell.code ], cell.count, cell.variance, latencies.get() );
+        }
+    }
+    return pos == record.size();
+}
+
+bool CPartialStatsReader::Open( const std::string & filename ) {
+    m_file.open( filename, std::ios::in | std::ios::binary | std::ios::ate );
+    m_file_size = m_file ? static_cast < size_t >( m_file.tellg() ) : 0;
+    m_file.seekg( 0 );
+    char magic[ sizeof( CPartialStats::FILE_MAGIC ) ];
+    return m_file.read( magic, sizeof( magic ) ) && memcmp( magic, CPartialStats::FILE_MAGIC, sizeof( magic ) ) == 0;
+}
+
+CPartialStatsReader::EResult CPartialStatsReader::Next( CPartialStats::CInterval & interval ) {
+    CPartialStats::CRecordHeader header;
+    while ( true ) {
+        if ( !m_file.read( reinterpret_cast < char * >( &header ), sizeof( header ) ) ) {
+            return m_file.gcount() == 0 ? RESULT_END : RESULT_DAMAGED;
+        }
+        if (
+            memcmp( header.magic, CPartialStats::RECORD_MAGIC, sizeof( header.magic ) ) != 0
+            ||
+            header.record_size < sizeof( header )
+            ||
+            // the size is checked before allocating
+            header.record_size - sizeof( header ) > m_file_size - static_cast < size_t >( m_file.tellg() )
+        ) {
+            return RESULT_DAMAGED;
+        }
+        m_record.resize( header.record_size );
+        memcpy( m_record.data(), &header, sizeof( header ) );
+        if ( !m_file.read( m_record.data() + sizeof( header ), header.record_size - sizeof( header ) ) ) {
+            return RESULT_DAMAGED;
+        }
+        if ( header.version > CPartialStats::VERSION ) {
+            // written by a newer version, skipped
+            continue;
+        }
+        return CPartialStats::Decode( m_record, interval ) ? RESULT_RECORD : RESULT_DAMAGED;
+    }
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "common.h"
+#include "LatencyHistogram.h"
+
+//
+// Mergeable partial aggregates of interval stats, one record per output interval of a processor instance, appended
+// to a rolling file (see CBinaryStatsWriter). Unlike the binary stats, records keep everything needed to combine
+// instances exactly: counts and variances by (request path, result code) strings and whole latency histograms.
+// Merging is adding, so it is associative and commutative and any set of records of one interval gives the same sum.
+// A file starts with FILE_MAGIC and continues with records laid out as follows:
+//
+//   record header (fixed size): magic, format version, flags, record size, counts of paths, codes and cells,
+//                               interval start and end (unix time), totals, sketch error bound, overload counters
+//   paths                       uint32 length and bytes of every request path
+//   codes                       uint32 length and bytes of every result code
+//   cells                       CCellRecord per cell, followed by CLatencyRecord per non-empty latency histogram bucket
+//
+// Integers are little-endian. Readers skip records of newer versions by their size. Counts of a sketch are
+// recorded as reported (top paths and the other paths): sketch counters are keyed by IDs local to a process, so they
+// cannot be combined across instances, their error bounds add up instead. Cells of the other paths refer to
+// OTHER_PATH_INDEX instead of a path string, so a path named "other" is kept apart.
+//
+class CPartialStats {
+
+    public:
+
+        static constexpr char FILE_MAGIC[ 8 ] = { 'P', 'P', 'A', 'R', 'T', 'I', 'A', 'L' };
+        static constexpr char RECORD_MAGIC[ 4 ] = { 'P', 'A', 'G', 'G' };
+        // version of records written
+        static constexpr uint16_t VERSION = 1;
+
+        // path index of cells counting the paths out of the sketch top
+        static constexpr uint32_t OTHER_PATH_INDEX = std::numeric_limits < uint32_t >::max();
+
+        enum EFlags : uint16_t {
+            // counts are estimated from a sample
+            FLAG_SAMPLED = 1,
+            // latencies are recorded
+            FLAG_LATENCIES = 2,
+            // counts are reported by a sketch of top paths
+            FLAG_SKETCH = 4,
+        };
+
+        class CRecordHeader {
+            public:
+                char magic[ 4 ];
+                uint16_t version;
+                uint16_t flags;
+                uint32_t record_size;
+                uint32_t path_count;
+                uint32_t code_count;
+                uint32_t cell_count;
+                int64_t start_ts;
+                int64_t end_ts;
+                uint64_t total_count;
+                uint64_t sample_count;
+                uint64_t total_variance;
+                // sum of the count overestimation bounds of the sketches merged
+                uint64_t sketch_error_bound;
+                uint64_t shed_events;
+                uint64_t fast_parsed_events;
+                uint64_t dropped_requests;
+                uint64_t overflow_responses;
+                uint64_t input_stall_ms;
+        };
+
+        class CCellRecord {
+            public:
+                // indexes of the path (or OTHER_PATH_INDEX) and the code in the record
+                uint32_t path;
+                uint32_t code;
+                uint64_t count;
+                uint64_t variance;
+                // count of latency bucket records following the cell (0 if the cell has no latencies)
+                uint32_t latency_count;
+                uint32_t latency_max;
+        };
+
+        class CLatencyRecord {
+            public:
+                uint32_t bucket;
+                uint32_t reserved;
+                uint64_t count;
+        };
+
+        class CCell {
+            public:
+                long long unsigned int count = 0;
+                long long unsigned int variance = 0;
+                PLatencyHistogram latencies;
+        };
+
+        // partial stats of one interval
+        class CInterval {
+            public:
+                int64_t start_ts = 0;
+                int64_t end_ts = 0;
+                uint16_t flags = 0;
+                long long unsigned int total_count = 0;
+                long long unsigned int sample_count = 0;
+                long long unsigned int total_variance = 0;
+                long long unsigned int sketch_error_bound = 0;
+                long long unsigned int shed_events = 0;
+                long long unsigned int fast_parsed_events = 0;
+                long long unsigned int dropped_requests = 0;
+                long long unsigned int overflow_responses = 0;
+                long long unsigned int input_stall_ms = 0;
+                // cells by request path and result code
+                std::map < std::pair < std::string, std::string >, CCell > cells;
+                // cells of the paths out of the sketch top by result code
+                std::map < std::string, CCell, std::less <> > other_cells;
+
+                // adds a cell, latencies are copied if any
+                void AddCell( const std::string_view path, const std::string_view code, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies );
+                // adds a cell of the paths out of the sketch top
+                void AddOtherCell( const std::string_view code, const long long unsigned int count, const long long unsigned int variance, const CLatencyHistogram * latencies );
+
+                // adds stats of another part of the same interval (the start is kept)
+                void Merge( const CInterval & other );
+
+                void Clear();
+        };
+
+        // encodes an interval as a record
+        static void Encode( const CInterval & interval, std::string & record );
+
+        // decodes a whole record of the current or an older version, returns false if it is damaged
+        static bool Decode( const std::string_view record, CInterval & interval );
+};
+
+//
+// Reads records of a partial stats file one by one, so files of any size are streamed with the memory of one interval
+//
+class CPartialStatsReader {
+
+    protected:
+
+        std::ifstream m_file;
+        size_t m_file_size = 0;
+        std::string m_record;
+
+    public:
+
+        enum EResult {
+            // a record is read
+            RESULT_RECORD,
+            // the file ends after the last record
+            RESULT_END,
+            // a damaged record or a record cut short by the end of the file (the rest of the file cannot be read)
+            RESULT_DAMAGED,
+        };
+
+        // opens the file, returns false if it cannot be read or is not a partial stats file
+        bool Open( const std::string & filename );
+
+        // reads the next record
+        EResult Next( CPartialStats::CInterval & interval );
+};
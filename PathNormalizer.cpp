@@ -0,0 +1,252 @@
+#include "common.h"
+
+#include <fstream>
+
+#include "PathNormalizer.h"
+
+namespace {
+
+    // calls handler( segment ) for every segment of a path (the part after every '/')
+    template < typename F > void ForEachSegment( const std::string_view path, F handler ) {
+        size_t start = path.starts_with( '/' ) ? 1 : 0;
+        while ( true ) {
+            const size_t end = path.find( '/', start );
+            if ( !handler( path.substr( start, end == std::string_view::npos ? std::string_view::npos : end - start ) ) ) {
+                break;
+            }
+            if ( end == std::string_view::npos ) {
+                break;
+            }
+            start = end + 1;
+        }
+    }
+
+    bool IsWildcard( const std::string_view segment ) {
+        return segment.size() >= 2 && segment.starts_with( '{' ) && segment.ends_with( '}' );
+    }
+
+    bool IsHexDigit( const char c ) {
+        return ( c >= '0' && c <= '9' ) || ( c >= 'a' && c <= 'f' ) || ( c >= 'A' && c <= 'F' );
+    }
+
+    //
+    // A template trie node (compilation only)
+    //
+    class CTrieNode {
+        public:
+            std::map < std::string, unsigned int, std::less <> > m_literals;
+            unsigned int m_any = std::numeric_limits < unsigned int >::max();
+            unsigned int m_template = std::numeric_limits < unsigned int >::max();
+    };
+
+}
+
+bool CPathNormalizer::Load( const std::string & filename ) {
+    std::ifstream file( filename );
+    if ( !file ) {
+        return false;
+    }
+    std::string line;
+    while ( std::getline( file, line ) ) {
+        while ( !line.empty() && isspace( static_cast < unsigned char >( line.back() ) ) ) {
+            line.pop_back();
+        }
+        if ( !line.empty() && !line.starts_with( '#' ) ) {
+            m_templates.push_back( line );
+        }
+    }
+    Compile();
+    return true;
+}
+
+void CPathNormalizer::SetCollapseSegments( const bool bCollapseSegments ) {
+    m_bCollapseSegments = bCollapseSegments;
+}
+
+bool CPathNormalizer::IsEnabled() const {
+    return !m_templates.empty() || m_bCollapseSegments;
+}
+
+// builds a trie of templates, then converts it to a DFA by the subset construction:
+// a DFA state is a set of trie nodes reached by the same segments through literal and wildcard edges
+void CPathNormalizer::Compile() {
+
+    constexpr unsigned int NONE = std::numeric_limits < unsigned int >::max();
+
+    std::vector < CTrieNode > trie( 1 );
+    std::vector < unsigned int > specificity;
+    for ( unsigned int t = 0; t < m_templates.size(); t++ ) {
+        unsigned int node = 0;
+        unsigned int literal_count = 0;
+        ForEachSegment( m_templates[ t ], [ & ]( const std::string_view segment ) {
+            unsigned int next = NONE;
+            if ( IsWildcard( segment ) ) {
+                next = trie[ node ].m_any;
+            } else if ( auto it = trie[ node ].m_literals.find( segment ); it != trie[ node ].m_literals.end() ) {
+                next = it->second;
+            }
+            if ( next == NONE ) {
+                next = trie.size();
+                if ( IsWildcard( segment ) ) {
+                    trie[ node ].m_any = next;
+                } else {
+                    trie[ node ].m_literals.emplace( segment, next );
+                }
+                trie.emplace_back();
+            }
+            literal_count += IsWildcard( segment ) ? 0 : 1;
+            node = next;
+            return true;
+        } );
+        specificity.push_back( literal_count );
+        if ( trie[ node ].m_template == NONE ) {
+            trie[ node ].m_template = t;
+        }
+    }
+
+    typedef std::vector < unsigned int > t_node_set;
+    std::map < t_node_set, unsigned int > state_ids;
+    std::vector < t_node_set > pending;
+    m_states.clear();
+
+    const auto get_state = [ & ]( t_node_set nodes ) {
+        std::ranges::sort( nodes );
+        nodes.erase( std::unique( nodes.begin(), nodes.end() ), nodes.end() );
+        if ( nodes.empty() ) {
+            return NO_STATE;
+        }
+        if ( auto it = state_ids.find( nodes ); it != state_ids.end() ) {
+            return it->second;
+        }
+        const unsigned int id = m_states.size();
+        m_states.emplace_back();
+        state_ids.emplace( nodes, id );
+        pending.push_back( nodes );
+        return id;
+    };
+
+    get_state( { 0 } );
+    for ( unsigned int id = 0; id < m_states.size(); id++ ) {
+        const t_node_set nodes = pending[ id ];
+
+        // the most specific template ending in the state
+        for ( const auto node : nodes ) {
+            const unsigned int t = trie[ node ].m_template;
+            unsigned int & state_template = m_states[ id ].m_template;
+            if (
+                t != NONE
+                &&
+                (
+                    state_template == NO_TEMPLATE
+                    ||
+                    specificity[ t ] > specificity[ state_template ]
+                    ||
+                    ( specificity[ t ] == specificity[ state_template ] && t < state_template )
+                )
+            ) {
+                state_template = t;
+            }
+        }
+
+        // a literal segment leads to its literal children and to wildcard children of all nodes
+        t_node_set any_nodes;
+        std::set < std::string_view > literals;
+        for ( const auto node : nodes ) {
+            if ( trie[ node ].m_any != NONE ) {
+                any_nodes.push_back( trie[ node ].m_any );
+            }
+            for ( const auto & [ literal, child ] : trie[ node ].m_literals ) {
+                literals.insert( literal );
+            }
+        }
+        for ( const auto & literal : literals ) {
+            t_node_set next = any_nodes;
+            for ( const auto node : nodes ) {
+                if ( auto it = trie[ node ].m_literals.find( literal ); it != trie[ node ].m_literals.end() ) {
+                    next.push_back( it->second );
+                }
+            }
+            const unsigned int next_id = get_state( next );
+            m_states[ id ].m_literals.emplace( literal, next_id );
+        }
+        const unsigned int any_id = get_state( any_nodes );
+        m_states[ id ].m_any = any_id;
+    }
+}
+
+// returns a replacement for a segment looking like an identifier or an empty view
+std::string_view CPathNormalizer::GetSegmentReplacement( const std::string_view segment ) {
+    if ( segment.empty() ) {
+        return {};
+    }
+    if ( std::ranges::all_of( segment, []( const char c ) { return c >= '0' && c <= '9'; } ) ) {
+        return "{id}";
+    }
+    if ( segment.size() == 36 ) {
+        bool bIsUUID = true;
+        for ( size_t i = 0; i < segment.size() && bIsUUID; i++ ) {
+            bIsUUID = ( i == 8 || i == 13 || i == 18 || i == 23 ) ? segment[ i ] == '-' : IsHexDigit( segment[ i ] );
+        }
+        if ( bIsUUID ) {
+            return "{uuid}";
+        }
+    }
+    if (
+        segment.size() >= 8
+        &&
+        std::ranges::all_of( segment, IsHexDigit )
+        &&
+        ( segment.size() >= 16 || std::ranges::any_of( segment, []( const char c ) { return c >= '0' && c <= '9'; } ) )
+    ) {
+        return "{hex}";
+    }
+    return {};
+}
+
+std::string_view CPathNormalizer::Normalize( std::string_view path, std::string & buffer ) const {
+
+    if ( const size_t query_start = path.find( '?' ); query_start != std::string_view::npos && IsEnabled() ) {
+        path = path.substr( 0, query_start );
+    }
+
+    if ( !m_states.empty() ) {
+        unsigned int state = 0;
+        ForEachSegment( path, [ & ]( const std::string_view segment ) {
+            const CState & current = m_states[ state ];
+            if ( auto it = current.m_literals.find( segment ); it != current.m_literals.end() ) {
+                state = it->second;
+            } else {
+                state = current.m_any;
+            }
+            return state != NO_STATE;
+        } );
+        if ( state != NO_STATE && m_states[ state ].m_template != NO_TEMPLATE ) {
+            return m_templates[ m_states[ state ].m_template ];
+        }
+    }
+
+    if ( m_bCollapseSegments ) {
+        // the path is rebuilt only if some segment is replaced
+        bool bChanged = false;
+        ForEachSegment( path, [ & ]( const std::string_view segment ) {
+            bChanged = !GetSegmentReplacement( segment ).empty();
+            return !bChanged;
+        } );
+        if ( bChanged ) {
+            buffer.clear();
+            bool bFirst = true;
+            ForEachSegment( path, [ & ]( const std::string_view segment ) {
+                const auto replacement = GetSegmentReplacement( segment );
+                if ( !bFirst || path.starts_with( '/' ) ) {
+                    buffer += '/';
+                }
+                bFirst = false;
+                buffer += replacement.empty() ? segment : replacement;
+                return true;
+            } );
+            return buffer;
+        }
+    }
+
+    return path;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "common.h"
+
+//
+// Normalizes request paths to cap their cardinality: paths matching a template (e.g. "/users/{id}/orders/{uuid}",
+// a "{...}" segment matches any segment) are replaced with the template, other paths may get numeric, UUID and
+// long hex segments collapsed to "{id}", "{uuid}" and "{hex}".
+// Templates are compiled into a DFA over path segments (a union of template tries with wildcard transitions merged
+// into literal ones), so a path is matched in one pass without backtracking. The most specific template
+// (the one with more literal segments, then the first one) wins. Query strings are dropped.
+//
+class CPathNormalizer {
+
+    protected:
+
+        // transparent hash to look up segments by views
+        class CSegmentHash {
+            public:
+                using is_transparent = void;
+                size_t operator () ( const std::string_view value ) const {
+                    return std::hash < std::string_view >()( value );
+                }
+        };
+
+        static constexpr unsigned int NO_STATE = std::numeric_limits < unsigned int >::max();
+        static constexpr unsigned int NO_TEMPLATE = std::numeric_limits < unsigned int >::max();
+
+        class CState {
+            public:
+                std::unordered_map < std::string, unsigned int, CSegmentHash, std::equal_to <> > m_literals;
+                // transition for segments other than literal ones
+                unsigned int m_any = NO_STATE;
+                // template matched if the path ends in this state
+                unsigned int m_template = NO_TEMPLATE;
+        };
+
+        std::vector < std::string > m_templates;
+        std::vector < CState > m_states;
+        bool m_bCollapseSegments = false;
+
+        void Compile();
+        static std::string_view GetSegmentReplacement( const std::string_view segment );
+
+    public:
+
+        // loads templates from a file (one per line, empty lines and lines starting with '#' are ignored),
+        // returns false if the file cannot be read
+        bool Load( const std::string & filename );
+
+        // enables collapsing of numeric, UUID and long hex segments in paths not matching templates
+        void SetCollapseSegments( const bool bCollapseSegments );
+
+        // returns true if paths are changed at all
+        bool IsEnabled() const;
+
+        // returns a normalized path, the buffer is used (and its storage reused) if the path is to be rebuilt
+        std::string_view Normalize( std::string_view path, std::string & buffer ) const;
+};
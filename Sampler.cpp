@@ -0,0 +1,70 @@
+#include "common.h"
+
+#include "Sampler.h"
+
+CSampler::CSampler()
+    : m_request_shifts( std::make_unique < std::atomic < uint8_t >[] >( HISTORY_SIZE ) )
+    , m_response_shifts( std::make_unique < std::atomic < uint8_t >[] >( HISTORY_SIZE ) )
+{
+}
+
+void CSampler::Configure( const unsigned int shift, const bool bAdaptive, const time_t request_lifetime, const time_t response_grace ) {
+    m_bEnabled = shift > 0 || bAdaptive;
+    m_bAdaptive = bAdaptive;
+    m_shift = std::min( shift, MAX_SHIFT );
+    m_request_lifetime = request_lifetime;
+    m_response_grace = response_grace;
+}
+
+bool CSampler::IsEnabled() const {
+    return m_bEnabled;
+}
+
+void CSampler::StartSecond( const time_t ts, const time_t lag ) {
+    if ( !m_bEnabled ) {
+        return;
+    }
+
+    if ( m_bAdaptive ) {
+        if ( lag >= HIGH_LAG_SECONDS ) {
+            m_shift = std::min( m_shift + 1, MAX_SHIFT );
+            m_calm_seconds = 0;
+        } else if ( lag > 0 ) {
+            m_calm_seconds = 0;
+        } else if ( ++m_calm_seconds >= CALM_SECONDS_TO_RAISE && m_shift > 0 ) {
+            m_shift--;
+            m_calm_seconds = 0;
+        }
+    }
+
+    m_history.emplace_back( ts, m_shift );
+    while ( m_history.front().first < ts - std::max( m_request_lifetime, m_response_grace ) ) {
+        m_history.pop_front();
+    }
+
+    unsigned int request_shift = m_shift;
+    unsigned int response_shift = m_shift;
+    for ( const auto & [ history_ts, shift ] : m_history ) {
+        if ( history_ts >= ts - m_response_grace ) {
+            request_shift = std::min( request_shift, shift );
+        }
+        if ( history_ts >= ts - m_request_lifetime ) {
+            response_shift = std::max( response_shift, shift );
+        }
+    }
+    m_request_shifts[ static_cast < size_t >( ts ) % HISTORY_SIZE ].store( request_shift, std::memory_order_relaxed );
+    m_response_shifts[ static_cast < size_t >( ts ) % HISTORY_SIZE ].store( response_shift, std::memory_order_relaxed );
+}
+
+unsigned int CSampler::GetRequestShift( const time_t ts ) const {
+    return m_bEnabled ? m_request_shifts[ static_cast < size_t >( ts ) % HISTORY_SIZE ].load( std::memory_order_relaxed ) : 0;
+}
+
+unsigned int CSampler::GetResponseShift( const time_t ts ) const {
+    return m_bEnabled ? m_response_shifts[ static_cast < size_t >( ts ) % HISTORY_SIZE ].load( std::memory_order_relaxed ) : 0;
+}
+
+bool CSampler::IsSampled( const CTraceKey & id, const unsigned int shift ) {
+    // the hash is remixed so the sample does not correlate with hash table slots and partitions
+    return shift == 0 || ( id.GetHash() * 0x9e3779b97f4a7c15ULL ) >> ( 64 - shift ) == 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common.h"
+#include "TraceKey.h"
+
+//
+// Deterministic sampling of trace IDs. A trace is kept if the top bits of its remixed hash are zero, so the sample rate
+// is a power of two (1 / 2^shift) and the sample at a higher rate always contains the sample at a lower one.
+// The shift may be set for every second of input: requests of the second use the minimum shift of the response grace
+// period before them, responses use the maximum shift of the request lifetime before them. So a kept response always has
+// its request kept whatever the rate changes are, and every response is counted with the weight 2^shift.
+// Shifts are set by the reader at the start of a line bucket before its events are passed on, other threads only read them.
+//
+class CSampler {
+
+    public:
+
+        // the lowest sample rate is 1 / 2^MAX_SHIFT
+        static constexpr unsigned int MAX_SHIFT = 16;
+        // lag (seconds between the oldest line bucket in flight and the new one) to halve the sample rate at
+        static constexpr time_t HIGH_LAG_SECONDS = 2;
+        // count of seconds without lag to double the sample rate after
+        static constexpr unsigned int CALM_SECONDS_TO_RAISE = 10;
+
+    protected:
+
+        // count of seconds shifts are kept for (must exceed any time events wait to be joined)
+        static constexpr size_t HISTORY_SIZE = 1 << 16;
+
+        std::unique_ptr < std::atomic < uint8_t >[] > m_request_shifts;
+        std::unique_ptr < std::atomic < uint8_t >[] > m_response_shifts;
+
+        // the reader's state
+        bool m_bEnabled = false;
+        bool m_bAdaptive = false;
+        unsigned int m_shift = 0;
+        unsigned int m_calm_seconds = 0;
+        time_t m_request_lifetime = 0;
+        time_t m_response_grace = 0;
+        // base shifts of recent seconds
+        std::deque < std::pair < time_t, unsigned int > > m_history;
+
+    public:
+
+        CSampler();
+
+        // sets sampling up (before the pipeline is started)
+        void Configure( const unsigned int shift, const bool bAdaptive, const time_t request_lifetime, const time_t response_grace );
+
+        // returns true if sampling is configured
+        bool IsEnabled() const;
+
+        // sets shifts for the second specified adapting the base shift to the lag as needed (called by the reader only)
+        void StartSecond( const time_t ts, const time_t lag );
+
+        // return shifts set for the second specified
+        unsigned int GetRequestShift( const time_t ts ) const;
+        unsigned int GetResponseShift( const time_t ts ) const;
+
+        // returns true if the trace is kept in the sample with the shift specified
+        static bool IsSampled( const CTraceKey & id, const unsigned int shift );
+};
@@ -0,0 +1,62 @@
+#include "common.h"
+
+#include "Slab.h"
+
+CSlab::CSlab( const size_t capacity )
+    : m_data( std::make_unique_for_overwrite < char[] >( capacity ) )
+    , m_capacity( capacity )
+{
+#ifdef DEBUG_MEMORY_CONSUMPTION
+    std::cout << m_capacity << " CSlab()" << std::endl;
+#endif // DEBUG_MEMORY_CONSUMPTION
+}
+
+char * CSlab::GetData() const {
+    return m_data.get();
+}
+
+size_t CSlab::GetCapacity() const {
+    return m_capacity;
+}
+
+CSlabPool::CSlabPool( const size_t max_free_slabs )
+    : m_max_free_slabs( max_free_slabs )
+{
+}
+
+// returns a slab to the free list or deletes it if the free list is full
+void CSlabPool::Release( CSlab * slab ) {
+    std::unique_ptr < CSlab > slab_holder( slab );
+    std::lock_guard < std::mutex > lock( m_mutex );
+    m_used_size -= slab->GetCapacity();
+    if ( m_free_slabs.size() < m_max_free_slabs ) {
+        m_free_slabs.push_back( std::move( slab_holder ) );
+    }
+    m_released.notify_all();
+}
+
+PSlab CSlabPool::Acquire( const size_t capacity ) {
+    std::unique_ptr < CSlab > slab;
+    {
+        std::lock_guard < std::mutex > lock( m_mutex );
+        if ( !m_free_slabs.empty() && m_free_slabs.back()->GetCapacity() >= capacity ) {
+            slab = std::move( m_free_slabs.back() );
+            m_free_slabs.pop_back();
+        }
+    }
+    if ( !slab ) {
+        slab = std::make_unique < CSlab >( capacity );
+    }
+    m_used_size += slab->GetCapacity();
+    // the pool must outlive all slabs handed out (it is owned by the context)
+    return { slab.release(), [ this ]( CSlab * p ) { Release( p ); } };
+}
+
+size_t CSlabPool::GetUsedSize() const {
+    return m_used_size;
+}
+
+bool CSlabPool::WaitForUsedSizeBelow( const size_t limit, const int timeout_ms ) {
+    std::unique_lock < std::mutex > lock( m_mutex );
+    return m_released.wait_for( lock, std::chrono::milliseconds( timeout_ms ), [ & ] { return m_used_size < limit; } );
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.h"
+
+//
+// A fixed-size block of raw input bytes. Lines are framed in place and referenced by views,
+// so the slab must stay alive while any line bucket refers to it.
+//
+class CSlab {
+
+    private:
+
+        std::unique_ptr < char[] > m_data;
+        size_t m_capacity = 0;
+
+    public:
+
+        CSlab() = delete;
+        explicit CSlab( const size_t capacity );
+
+        // returns a pointer to the slab memory
+        char * GetData() const;
+
+        // returns the slab size in bytes
+        size_t GetCapacity() const;
+};
+typedef std::shared_ptr < CSlab > PSlab;
+
+//
+// Pool of reusable slabs. Slabs are handed out as shared pointers which return the slab to the pool
+// when the last reference (normally the last line bucket using it) is dropped.
+// The total size of slabs handed out is tracked to bound the memory held by input in flight.
+//
+class CSlabPool {
+
+    private:
+
+        std::vector < std::unique_ptr < CSlab > > m_free_slabs;
+        std::mutex m_mutex;
+        size_t m_max_free_slabs = 0;
+        // total capacity of slabs handed out and not released yet
+        std::atomic < size_t > m_used_size = 0;
+        std::condition_variable m_released;
+
+        void Release( CSlab * slab );
+
+    public:
+
+        explicit CSlabPool( const size_t max_free_slabs );
+
+        // returns a slab of at least the specified size, reusing a free one if possible
+        PSlab Acquire( const size_t capacity );
+
+        // returns the total capacity of slabs in use
+        size_t GetUsedSize() const;
+
+        // waits until the total capacity of slabs in use is below the limit or the timeout is elapsed,
+        // returns true if the usage is below the limit
+        bool WaitForUsedSizeBelow( const size_t limit, const int timeout_ms );
+};
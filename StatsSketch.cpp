@@ -0,0 +1,166 @@
+#include "common.h"
+
+#include "StatsSketch.h"
+
+namespace {
+
+    // 64-bit finalizer (MurmurHash3 fmix64)
+    uint64_t Mix( uint64_t h ) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // memory taken by a top path candidate with its position index entry
+    constexpr size_t PATH_ENTRY_SIZE = 64;
+
+}
+
+CStatsSketch::CStatsSketch( const size_t memory_size ) {
+    // a quarter of the memory for top paths, the rest for the counters
+    m_max_paths = std::max < size_t >( memory_size / 4 / PATH_ENTRY_SIZE, 1 );
+    m_width = std::bit_floor( std::max < size_t >( memory_size * 3 / 4 / DEPTH / sizeof( long long unsigned int ), 1 ) );
+    m_counters.resize( DEPTH * m_width );
+    m_paths.reserve( m_max_paths );
+    m_path_positions.reserve( m_max_paths );
+}
+
+// rows use hashes derived from one 64-bit hash (Kirsch-Mitzenmacher double hashing)
+size_t CStatsSketch::GetCounterIndex( const unsigned int row, const uint64_t hash ) const {
+    const uint64_t h1 = hash;
+    const uint64_t h2 = ( hash >> 32 ) | 1;
+    return row * m_width + ( ( h1 + row * h2 ) & ( m_width - 1 ) );
+}
+
+long long unsigned int CStatsSketch::Estimate( const CDictionary::t_id path, const CDictionary::t_id code ) const {
+    const uint64_t hash = Mix( ( static_cast < uint64_t >( path ) << 32 ) | code );
+    long long unsigned int result = std::numeric_limits < long long unsigned int >::max();
+    for ( unsigned int row = 0; row < DEPTH; row++ ) {
+        result = std::min( result, m_counters[ GetCounterIndex( row, hash ) ] );
+    }
+    return result;
+}
+
+void CStatsSketch::SiftDown( size_t n ) {
+    while ( true ) {
+        size_t smallest = n;
+        for ( size_t child = 2 * n + 1; child <= 2 * n + 2 && child < m_paths.size(); child++ ) {
+            if ( m_paths[ child ].m_count < m_paths[ smallest ].m_count ) {
+                smallest = child;
+            }
+        }
+        if ( smallest == n ) {
+            break;
+        }
+        std::swap( m_paths[ n ], m_paths[ smallest ] );
+        m_path_positions[ m_paths[ n ].m_path ] = n;
+        m_path_positions[ m_paths[ smallest ].m_path ] = smallest;
+        n = smallest;
+    }
+}
+
+void CStatsSketch::SiftUp( size_t n ) {
+    while ( n > 0 && m_paths[ n ].m_count < m_paths[ ( n - 1 ) / 2 ].m_count ) {
+        const size_t parent = ( n - 1 ) / 2;
+        std::swap( m_paths[ n ], m_paths[ parent ] );
+        m_path_positions[ m_paths[ n ].m_path ] = n;
+        m_path_positions[ m_paths[ parent ].m_path ] = parent;
+        n = parent;
+    }
+}
+
+// Space-Saving update: a new path replaces the path with the minimum count inheriting the count as its error
+void CStatsSketch::AddPath( const CDictionary::t_id path, const long long unsigned int weight ) {
+    if ( auto it = m_path_positions.find( path ); it != m_path_positions.end() ) {
+        m_paths[ it->second ].m_count += weight;
+        SiftDown( it->second );
+    } else if ( m_paths.size() < m_max_paths ) {
+        m_paths.push_back( { path, weight, 0 } );
+        m_path_positions[ path ] = m_paths.size() - 1;
+        SiftUp( m_paths.size() - 1 );
+    } else {
+        auto & entry = m_paths.front();
+        m_path_positions.erase( entry.m_path );
+        entry.m_path = path;
+        entry.m_error = entry.m_count;
+        entry.m_count += weight;
+        m_path_positions[ path ] = 0;
+        SiftDown( 0 );
+    }
+}
+
+// returns the maximum count of a path out of the summary
+long long unsigned int CStatsSketch::GetMinCount() const {
+    return m_paths.size() < m_max_paths || m_paths.empty() ? 0 : m_paths.front().m_count;
+}
+
+bool CStatsSketch::IsReported( const CPathEntry & entry ) const {
+    return entry.m_count - entry.m_error > GetMinCount();
+}
+
+void CStatsSketch::Count( const CDictionary::t_id path, const CDictionary::t_id code, const long long unsigned int weight, const long long unsigned int variance ) {
+    const uint64_t hash = Mix( ( static_cast < uint64_t >( path ) << 32 ) | code );
+    for ( unsigned int row = 0; row < DEPTH; row++ ) {
+        m_counters[ GetCounterIndex( row, hash ) ] += weight;
+    }
+    AddPath( path, weight );
+    auto & total = m_code_totals[ code ];
+    total.count += weight;
+    total.variance += variance;
+    m_total += weight;
+}
+
+void CStatsSketch::Merge( const CStatsSketch & other ) {
+    for ( size_t i = 0; i < m_counters.size(); i++ ) {
+        m_counters[ i ] += other.m_counters[ i ];
+    }
+    for ( const auto & [ code, total ] : other.m_code_totals ) {
+        auto & own_total = m_code_totals[ code ];
+        own_total.count += total.count;
+        own_total.variance += total.variance;
+    }
+    m_total += other.m_total;
+
+    // a path missing from a full summary may have up to its minimum count there
+    const auto own_min = GetMinCount();
+    const auto other_min = other.GetMinCount();
+    std::unordered_map < CDictionary::t_id, CPathEntry > merged;
+    for ( const auto & entry : m_paths ) {
+        merged[ entry.m_path ] = { entry.m_path, entry.m_count + other_min, entry.m_error + other_min };
+    }
+    for ( const auto & entry : other.m_paths ) {
+        if ( auto it = merged.find( entry.m_path ); it != merged.end() ) {
+            it->second.m_count += entry.m_count - other_min;
+            it->second.m_error += entry.m_error - other_min;
+        } else {
+            merged[ entry.m_path ] = { entry.m_path, entry.m_count + own_min, entry.m_error + own_min };
+        }
+    }
+
+    // keeping the largest counts
+    m_paths.clear();
+    for ( const auto & [ path, entry ] : merged ) {
+        m_paths.push_back( entry );
+    }
+    if ( m_paths.size() > m_max_paths ) {
+        std::ranges::nth_element( m_paths, m_paths.begin() + m_max_paths, std::greater(), &CPathEntry::m_count );
+        m_paths.resize( m_max_paths );
+    }
+    std::ranges::make_heap( m_paths, std::greater(), &CPathEntry::m_count );
+    m_path_positions.clear();
+    for ( size_t i = 0; i < m_paths.size(); i++ ) {
+        m_path_positions[ m_paths[ i ].m_path ] = i;
+    }
+}
+
+long long unsigned int CStatsSketch::GetErrorBound() const {
+    // Count-Min bound: e / width * total
+    return static_cast < long long unsigned int >( std::ceil( std::exp( 1.0 ) * m_total / m_width ) );
+}
+
+size_t CStatsSketch::GetPathCount() const {
+    return std::ranges::count_if( m_paths, [ this ]( const CPathEntry & entry ) { return IsReported( entry ); } );
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "common.h"
+#include "Dictionary.h"
+
+//
+// Fixed-memory approximate stats of one interval: a Count-Min sketch of (request path, result code) counts and
+// a Space-Saving summary of the top request paths. Paths guaranteed to be in the top (their count less the error exceeds
+// the count any path out of the summary may have) are reported separately. Their counts are estimated as the minimum of the sketch counters
+// (an overestimate by at most GetErrorBound() with the probability of 1 - e^-DEPTH), the rest is folded into the "other" row.
+// Sketches of the same size are mergeable, so aggregation threads can keep their own ones.
+//
+class CStatsSketch {
+
+    public:
+
+        // count of Count-Min sketch rows
+        static constexpr unsigned int DEPTH = 4;
+
+        // an estimated count and its variance
+        class CEstimate {
+            public:
+                long long unsigned int count = 0;
+                long long unsigned int variance = 0;
+        };
+
+    protected:
+
+        // a top path candidate, the count is an overestimate by at most the error
+        class CPathEntry {
+            public:
+                CDictionary::t_id m_path = 0;
+                long long unsigned int m_count = 0;
+                long long unsigned int m_error = 0;
+        };
+
+        size_t m_width = 0;
+        size_t m_max_paths = 0;
+        // DEPTH rows of m_width counters
+        std::vector < long long unsigned int > m_counters;
+        // min-heap of top path candidates by count and positions of the paths in the heap
+        std::vector < CPathEntry > m_paths;
+        std::unordered_map < CDictionary::t_id, size_t > m_path_positions;
+        // exact totals per result code (there are few of them)
+        std::unordered_map < CDictionary::t_id, CEstimate > m_code_totals;
+        long long unsigned int m_total = 0;
+
+        size_t GetCounterIndex( const unsigned int row, const uint64_t hash ) const;
+        long long unsigned int Estimate( const CDictionary::t_id path, const CDictionary::t_id code ) const;
+        void SiftDown( size_t n );
+        void SiftUp( size_t n );
+        void AddPath( const CDictionary::t_id path, const long long unsigned int weight );
+        long long unsigned int GetMinCount() const;
+        bool IsReported( const CPathEntry & entry ) const;
+
+    public:
+
+        // creates a sketch taking about the memory size specified
+        explicit CStatsSketch( const size_t memory_size );
+
+        // counts a response with the weight and the variance of the weight specified
+        void Count( const CDictionary::t_id path, const CDictionary::t_id code, const long long unsigned int weight, const long long unsigned int variance );
+
+        // adds counts of another sketch of the same size
+        void Merge( const CStatsSketch & other );
+
+        // calls handler( path, code, estimate ) for top paths and for the path specified as "other" (the rest of counts)
+        template < typename F > void ForEachCell( const CDictionary::t_id other_path, F handler ) const {
+            // variance per unit of count is the same for all cells of a sample
+            long long unsigned int total_variance = 0;
+            for ( const auto & [ code, total ] : m_code_totals ) {
+                total_variance += total.variance;
+            }
+            const double variance_per_count = m_total ? static_cast < double >( total_variance ) / m_total : 0;
+            for ( const auto & [ code, total ] : m_code_totals ) {
+                long long unsigned int top_count = 0;
+                for ( const auto & entry : m_paths ) {
+                    if ( !IsReported( entry ) ) {
+                        continue;
+                    }
+                    const auto count = std::min( Estimate( entry.m_path, code ), entry.m_count );
+                    if ( count > 0 ) {
+                        handler( entry.m_path, code, CEstimate { count, static_cast < long long unsigned int >( count * variance_per_count ) } );
+                        top_count += count;
+                    }
+                }
+                if ( top_count < total.count ) {
+                    const auto count = total.count - top_count;
+                    handler( other_path, code, CEstimate { count, static_cast < long long unsigned int >( count * variance_per_count ) } );
+                }
+            }
+        }
+
+        // returns the maximum overestimation of a count (with the probability of 1 - e^-DEPTH)
+        long long unsigned int GetErrorBound() const;
+
+        // returns the count of top paths reported
+        size_t GetPathCount() const;
+};
@@ -121,12 +121,26 @@ template < typename T > class CTimeKeyedCollection {
             }
         }
 
+        // calls handler( ts, item ) for every item in the order of timestamps (items cannot be added or removed meanwhile)
+        template < typename F > void ForEachItem( F handler ) const {
+            std::shared_lock < std::shared_mutex > lock( m_mutex );
+            for ( const auto & [ ts, item ] : m_container ) {
+                handler( ts, item );
+            }
+        }
+
         // returns true if the collection is empty
         bool IsEmpty() const {
             std::shared_lock < std::shared_mutex > lock( m_mutex );
             return m_container.empty();
         }
 
+        // returns the count of items
+        size_t GetCount() const {
+            std::shared_lock < std::shared_mutex > lock( m_mutex );
+            return m_container.size();
+        }
+
         // removes all items with timestamps older than the time specified from the collection
         void DiscardOlderThan( const time_t min_ts ) {
             std::unique_lock < std::shared_mutex > lock( m_mutex );
@@ -146,10 +160,10 @@ template < typename T > class CTimeKeyedCollection {
             return m_new_data_available.wait_for( lock, std::chrono::milliseconds( timeout_ms ) );
         }
 
-        // notify waiting thread that new data is available
+        // notify waiting threads that new data is available
         void NotifyDataAvailable() {
             std::lock_guard < std::mutex > lock( m_new_data_mutex );
-            m_new_data_available.notify_one();
+            m_new_data_available.notify_all();
         }
 
         // explicitly add an item to the collection
@@ -0,0 +1,113 @@
+#include "common.h"
+
+#include "TimerWheel.h"
+
+CTimerWheel::CTimer::CTimer( const CTraceKey & id, const time_t time_key, const time_t deadline )
+    : m_high( id.m_high )
+    , m_low( id.m_low )
+    , m_time_key( time_key )
+    , m_lifetime( static_cast < uint32_t >( std::max < time_t >( deadline - time_key, 0 ) ) )
+    , m_format( id.m_format )
+{
+}
+
+CTraceKey CTimerWheel::CTimer::GetID() const {
+    CTraceKey id;
+    id.m_high = m_high;
+    id.m_low = m_low;
+    id.m_format = m_format;
+    return id;
+}
+
+time_t CTimerWheel::CTimer::GetTimeKey() const {
+    return m_time_key;
+}
+
+time_t CTimerWheel::CTimer::GetDeadline() const {
+    return m_time_key + m_lifetime;
+}
+
+// puts a timer to the slot of the lowest level covering its deadline (relative to the current time)
+void CTimerWheel::Place( const CTimer & timer ) {
+    // overdue timers expire at the current second
+    const time_t deadline = std::max( timer.GetDeadline(), m_current );
+    for ( unsigned int level = 0; level < LEVEL_COUNT; level++ ) {
+        const unsigned int shift = level * SLOT_BITS;
+        if ( ( deadline >> shift ) - ( m_current >> shift ) < SLOT_COUNT ) {
+            m_levels[ level ][ ( deadline >> shift ) & ( SLOT_COUNT - 1 ) ].push_back( timer );
+            return;
+        }
+    }
+    m_overflow.push_back( timer );
+}
+
+// moves timers of a higher level slot (or of the overflow list) to lower levels
+void CTimerWheel::Cascade( t_slot & slot ) {
+    t_slot timers;
+    timers.swap( slot );
+    for ( const auto & timer : timers ) {
+        Place( timer );
+    }
+}
+
+void CTimerWheel::Add( const CTimer & timer ) {
+    if ( m_count == 0 ) {
+        // the empty wheel is restarted from the deadline or from the time it was advanced to
+        m_current = m_advanced < 0 ? timer.GetDeadline() : std::min( timer.GetDeadline(), m_advanced + 1 );
+        m_cascaded = m_current;
+    }
+    Place( timer );
+    m_count++;
+}
+
+size_t CTimerWheel::Advance( const time_t now, const size_t max_count, const t_timer_handler & on_expired ) {
+
+    size_t expired_count = 0;
+    m_advanced = std::max( m_advanced, now );
+
+    while ( m_current <= now && m_count > 0 && expired_count < max_count ) {
+
+        if ( m_cascaded != m_current ) {
+            // entering a new second: move timers of higher level slots starting at this second down (the highest level first)
+            if ( ( m_current & ( ( time_t( 1 ) << ( LEVEL_COUNT * SLOT_BITS ) ) - 1 ) ) == 0 ) {
+                Cascade( m_overflow );
+            }
+            for ( unsigned int level = LEVEL_COUNT - 1; level > 0; level-- ) {
+                const unsigned int shift = level * SLOT_BITS;
+                if ( ( m_current & ( ( time_t( 1 ) << shift ) - 1 ) ) == 0 ) {
+                    Cascade( m_levels[ level ][ ( m_current >> shift ) & ( SLOT_COUNT - 1 ) ] );
+                }
+            }
+            m_cascaded = m_current;
+        }
+
+        auto & slot = m_levels[ 0 ][ m_current & ( SLOT_COUNT - 1 ) ];
+        while ( !slot.empty() && expired_count < max_count ) {
+            const CTimer timer = slot.back();
+            slot.pop_back();
+            m_count--;
+            expired_count++;
+            on_expired( timer );
+        }
+
+        if ( slot.empty() ) {
+            m_current++;
+        }
+    }
+
+    return expired_count;
+}
+
+size_t CTimerWheel::GetCount() const {
+    return m_count;
+}
+
+size_t CTimerWheel::GetMemoryUsage() const {
+    size_t result = m_overflow.capacity() * sizeof( CTimer );
+    for ( const auto & level : m_levels ) {
+        for ( const auto & slot : level ) {
+            result += slot.capacity() * sizeof( CTimer );
+        }
+    }
+    return result;
+}
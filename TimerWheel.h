@@ -0,0 +1,69 @@
+#pragma once
+
+#include "common.h"
+#include "TraceKey.h"
+
+//
+// Hierarchical timer wheel of event expiration timers with a one second resolution.
+// Three levels of 64 slots cover 64 seconds, 64 minutes and ~72 hours ahead, later timers wait in an overflow list.
+// Expired timers are handed out in batches of a limited size, so expiration work can be spread over time.
+// Not thread-safe.
+//
+class CTimerWheel {
+
+    public:
+
+        // a 32-byte timer: trace key of the event, time key of the event (to recognize stale timers) and the deadline
+        class CTimer {
+            protected:
+                uint64_t m_high = 0;
+                uint64_t m_low = 0;
+                time_t m_time_key = 0;
+                uint32_t m_lifetime = 0;
+                uint8_t m_format = 0;
+            public:
+                CTimer() = default;
+                CTimer( const CTraceKey & id, const time_t time_key, const time_t deadline );
+                CTraceKey GetID() const;
+                time_t GetTimeKey() const;
+                time_t GetDeadline() const;
+        };
+
+        typedef std::function < void ( const CTimer & timer ) > t_timer_handler;
+
+    protected:
+
+        static constexpr unsigned int SLOT_BITS = 6;
+        static constexpr time_t SLOT_COUNT = 1 << SLOT_BITS;
+        static constexpr unsigned int LEVEL_COUNT = 3;
+
+        typedef std::vector < CTimer > t_slot;
+
+        std::array < std::array < t_slot, SLOT_COUNT >, LEVEL_COUNT > m_levels;
+        t_slot m_overflow;
+        size_t m_count = 0;
+        // the next second to expire timers of
+        time_t m_current = 0;
+        // the second for which higher levels are cascaded already
+        time_t m_cascaded = -1;
+        // the last time the wheel was advanced to
+        time_t m_advanced = -1;
+
+        void Place( const CTimer & timer );
+        void Cascade( t_slot & slot );
+
+    public:
+
+        // adds a timer expiring at its deadline (a second)
+        void Add( const CTimer & timer );
+
+        // expires timers with deadlines up to the time specified (inclusive), but no more than max_count timers,
+        // returns a count of timers expired
+        size_t Advance( const time_t now, const size_t max_count, const t_timer_handler & on_expired );
+
+        // returns a count of timers set
+        size_t GetCount() const;
+
+        // returns memory allocated by the wheel in bytes
+        size_t GetMemoryUsage() const;
+};
@@ -0,0 +1,89 @@
+#include "common.h"
+
+#include <cstring>
+
+#include "TraceKey.h"
+
+namespace {
+
+    constexpr size_t MAX_HEX_DIGITS = 32;
+    constexpr size_t UUID_LENGTH = 36;
+
+    // returns a value of a lowercase hex digit or -1
+    int GetHexDigitValue( const char c ) {
+        if ( c >= '0' && c <= '9' ) {
+            return c - '0';
+        }
+        if ( c >= 'a' && c <= 'f' ) {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+    // 64-bit finalizer (MurmurHash3 fmix64)
+    uint64_t Mix( uint64_t h ) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // simple 64-bit string hash processing 8 bytes at a time
+    uint64_t HashString( const std::string_view value, const uint64_t seed ) {
+        uint64_t h = seed ^ ( value.size() * 0x9e3779b97f4a7c15ULL );
+        size_t i = 0;
+        for ( ; i + 8 <= value.size(); i += 8 ) {
+            uint64_t word;
+            memcpy( &word, value.data() + i, sizeof( word ) );
+            h = Mix( h ^ word ) + 0x9e3779b97f4a7c15ULL;
+        }
+        uint64_t tail = 0;
+        if ( i < value.size() ) {
+            memcpy( &tail, value.data() + i, value.size() - i );
+        }
+        return Mix( h ^ tail );
+    }
+
+    // packs hex digits of the value skipping positions marked in the skip mask, returns false on a non-hex character
+    bool PackHex( const std::string_view value, const uint64_t skip_mask, uint64_t & high, uint64_t & low ) {
+        high = 0;
+        low = 0;
+        for ( size_t i = 0; i < value.size(); i++ ) {
+            if ( skip_mask & ( 1ULL << i ) ) {
+                continue;
+            }
+            const int digit = GetHexDigitValue( value[ i ] );
+            if ( digit < 0 ) {
+                return false;
+            }
+            high = ( high << 4 ) | ( low >> 60 );
+            low = ( low << 4 ) | digit;
+        }
+        return true;
+    }
+
+}
+
+CTraceKey::CTraceKey( const std::string_view id ) {
+    // dash positions of the canonical UUID layout 8-4-4-4-12
+    constexpr uint64_t uuid_dashes = ( 1ULL << 8 ) | ( 1ULL << 13 ) | ( 1ULL << 18 ) | ( 1ULL << 23 );
+    if (
+        id.size() == UUID_LENGTH
+        && id[ 8 ] == '-' && id[ 13 ] == '-' && id[ 18 ] == '-' && id[ 23 ] == '-'
+        && PackHex( id, uuid_dashes, m_high, m_low )
+    ) {
+        m_format = FORMAT_UUID;
+    } else if ( !id.empty() && id.size() <= MAX_HEX_DIGITS && PackHex( id, 0, m_high, m_low ) ) {
+        m_format = FORMAT_HEX + id.size();
+    } else {
+        m_high = HashString( id, 0x243f6a8885a308d3ULL );
+        m_low = HashString( id, 0x13198a2e03707344ULL );
+        m_format = FORMAT_HASHED;
+    }
+}
+
+uint64_t CTraceKey::GetHash() const {
+    return Mix( m_high ^ Mix( m_low ^ m_format ) );
+}
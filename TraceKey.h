@@ -0,0 +1,36 @@
+#pragma once
+
+#include "common.h"
+
+//
+// Fixed-width binary form of an X-Trace-ID value.
+// Lowercase hex IDs (plain or in canonical UUID layout) are packed losslessly into 128 bits,
+// other formats are replaced with a 128-bit hash of the value (collisions are negligible).
+//
+class CTraceKey {
+
+    public:
+
+        // how the value was converted, 0 is reserved for an empty hash table slot
+        enum : uint8_t {
+            FORMAT_NONE = 0,
+            FORMAT_UUID = 1,
+            FORMAT_HASHED = 2,
+            // FORMAT_HEX + count of hex digits (1..32)
+            FORMAT_HEX = 0x80,
+        };
+
+        uint64_t m_high = 0;
+        uint64_t m_low = 0;
+        uint8_t m_format = FORMAT_NONE;
+
+        CTraceKey() = default;
+
+        // converts an X-Trace-ID value to a key
+        explicit CTraceKey( const std::string_view id );
+
+        // returns a hash of the key suitable for hash tables
+        uint64_t GetHash() const;
+
+        bool operator == ( const CTraceKey & other ) const = default;
+};
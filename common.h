@@ -9,7 +9,19 @@
 #include <mutex>
 #include <shared_mutex>
 #include <condition_variable>
+#include <atomic>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <utility>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <array>
+#include <bit>
+#include <functional>
+#include <limits>
+#include <algorithm>
+#include <cmath>
+#include <charconv>
+#include <concepts>
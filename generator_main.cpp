@@ -0,0 +1,93 @@
+#include "common.h"
+
+#include "LoadGenerator.h"
+
+//
+// Writes synthetic HTTP messages, JSON lines or binary records to STDOUT:
+// $ ./generator -n 1000000 -r 100000 | ./processor
+//
+
+namespace {
+
+    // splits a comma separated list
+    std::vector < std::string > Split( const std::string_view list ) {
+        std::vector < std::string > result;
+        for ( const auto part : std::views::split( list, ',' ) ) {
+            if ( !part.empty() ) {
+                result.emplace_back( part.begin(), part.end() );
+            }
+        }
+        return result;
+    }
+
+}
+
+int main( const int argc, const char **argv ) {
+
+    CLoadGenerator::CSettings settings;
+
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string arg( argv[ i ] );
+        if ( arg == "-s" && i + 1 < argc ) {
+            settings.seed = strtoull( argv[ ++i ], nullptr, 10 );
+        } else if ( arg == "-n" && i + 1 < argc ) {
+            settings.trace_count = strtoull( argv[ ++i ], nullptr, 10 );
+        } else if ( arg == "-r" && i + 1 < argc ) {
+            settings.rate = strtoull( argv[ ++i ], nullptr, 10 );
+        } else if ( arg == "-p" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            settings.path_count = atoi( argv[ ++i ] );
+        } else if ( arg == "-z" && i + 1 < argc && atof( argv[ i + 1 ] ) >= 0 ) {
+            settings.path_skew = atof( argv[ ++i ] );
+        } else if ( arg == "-c" && i + 1 < argc && !Split( argv[ i + 1 ] ).empty() ) {
+            settings.codes = Split( argv[ ++i ] );
+        } else if ( arg == "-Z" && i + 1 < argc && atof( argv[ i + 1 ] ) >= 0 ) {
+            settings.code_skew = atof( argv[ ++i ] );
+        } else if ( arg == "-w" && i + 1 < argc && atoi( argv[ i + 1 ] ) >= 0 ) {
+            settings.reorder_window = atoi( argv[ ++i ] );
+        } else if ( arg == "-o" && i + 1 < argc && atof( argv[ i + 1 ] ) >= 0 && atof( argv[ i + 1 ] ) <= 100 ) {
+            settings.orphan_percent = atof( argv[ ++i ] );
+        } else if ( arg == "-b" && i + 1 < argc && atoi( argv[ i + 1 ] ) >= 0 ) {
+            settings.header_bloat = atoi( argv[ ++i ] );
+        } else if ( arg == "-t" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "uuid" ) {
+            settings.trace_format = CLoadGenerator::TRACE_FORMAT_UUID;
+            i++;
+        } else if ( arg == "-t" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "hex" ) {
+            settings.trace_format = CLoadGenerator::TRACE_FORMAT_HEX;
+            i++;
+        } else if ( arg == "-t" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "text" ) {
+            settings.trace_format = CLoadGenerator::TRACE_FORMAT_TEXT;
+            i++;
+        } else if ( arg == "-f" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "http" ) {
+            settings.message_format = CLoadGenerator::MESSAGE_FORMAT_HTTP;
+            i++;
+        } else if ( arg == "-f" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "json" ) {
+            settings.message_format = CLoadGenerator::MESSAGE_FORMAT_JSON;
+            i++;
+        } else if ( arg == "-f" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "binary" ) {
+            settings.message_format = CLoadGenerator::MESSAGE_FORMAT_BINARY;
+            i++;
+        } else {
+            std::cout << "Usage: " << argv[ 0 ] << " [-s <seed>] [-n <trace count>] [-r <messages/s>] [-p <path count>] [-z <skew>]"
+                " [-c <codes>] [-Z <skew>] [-w <messages>] [-o <percent>] [-b <bytes>] [-t uuid|hex|text] [-f http|json|binary]" << std::endl;
+            std::cout << "  -s <seed>         seed of the random sequence, the output is the same for the same seed and settings (default 1)" << std::endl;
+            std::cout << "  -n <trace count>  count of request and response pairs to write (default 0, endless)" << std::endl;
+            std::cout << "  -r <messages/s>   message rate (default 0, unthrottled)" << std::endl;
+            std::cout << "  -p <path count>   count of distinct request paths (default 100)" << std::endl;
+            std::cout << "  -z <skew>         Zipf exponent of path frequencies (default 1.0)" << std::endl;
+            std::cout << "  -c <codes>        comma separated result codes from the most to the least frequent" << std::endl;
+            std::cout << "                    (default 200,404,500,301,302,201,204,400,401,403,503)" << std::endl;
+            std::cout << "  -Z <skew>         Zipf exponent of result code frequencies (default 1.5)" << std::endl;
+            std::cout << "  -w <messages>     reordering window: maximum displacement of a message from its trace position (default 16)" << std::endl;
+            std::cout << "  -o <percent>      percentage of requests without a response (default 2)" << std::endl;
+            std::cout << "  -b <bytes>        extra header bytes per message (default 0)" << std::endl;
+            std::cout << "  -t uuid|hex|text  trace ID format (default uuid)" << std::endl;
+            std::cout << "  -f http|json|binary  message format, the processor reads it with the same -f option (default http)" << std::endl;
+            return -1;
+        }
+    }
+
+    CLoadGenerator generator( std::move( settings ) );
+    generator.Run( stdout );
+
+    return 0;
+}
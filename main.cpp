@@ -1,20 +1,32 @@
 #include "common.h"
 
+#include <signal.h>
+
 #include "utils.h"
 
 #include "LineReader.h"
 #include "LineProcessor.h"
+#include "MessageFormat.h"
 #include "Aggregator.h"
 #include "OutputProcessor.h"
+#include "MetricsExporter.h"
+#include "Checkpointer.h"
 
-//
-// Cleans up old request buckets from the request_map
-//
-void Cleanup( const std::stop_token & stoken, const PContext & context ) {
-    while ( !stoken.stop_requested() ) {
-        std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
-        context->request_map.DiscardOlderThan( time( nullptr ) - REQUEST_LIFETIME_IN_SECONDS );
+// parses an output resolution as <seconds>:<file>[:<count of intervals retained>], returns false if it is malformed
+static bool ParseOutputResolution( const std::string_view spec, COutputResolution & resolution ) {
+    const auto colon = spec.find( ':' );
+    if ( colon == std::string_view::npos || std::from_chars( spec.data(), spec.data() + colon, resolution.seconds ).ptr != spec.data() + colon ) {
+        return false;
+    }
+    auto filename = spec.substr( colon + 1 );
+    if ( const auto last_colon = filename.rfind( ':' ); last_colon != std::string_view::npos ) {
+        const auto count = filename.substr( last_colon + 1 );
+        if ( std::from_chars( count.data(), count.data() + count.size(), resolution.retention ).ptr == count.data() + count.size() && !count.empty() ) {
+            filename = filename.substr( 0, last_colon );
+        }
     }
+    resolution.filename = filename;
+    return resolution.seconds > 0 && !resolution.filename.empty();
 }
 
 int main( const int argc, const char **argv ) {
@@ -22,41 +34,222 @@ int main( const int argc, const char **argv ) {
     // common variables which should be accessible from all threads
     PContext context( std::make_shared<CContext>() );
 
-    if ( argc > 1 ) {
-        if ( argc == 3 && argv[ 1 ] == std::string( "-o" ) ) {
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string arg( argv[ i ] );
+        if ( arg == "-o" && i + 1 < argc ) {
             //context->DUMP_TO_STDOUT = false;
-            context->filename = argv[ 2 ];
+            context->filename = argv[ ++i ];
+        } else if ( COutputResolution resolution; arg == "-r" && i + 1 < argc && ParseOutputResolution( argv[ i + 1 ], resolution ) ) {
+            context->output_resolutions.push_back( std::move( resolution ) );
+            i++;
+        } else if ( arg == "-B" && i + 1 < argc ) {
+            context->binary_filename = argv[ ++i ];
+        } else if ( arg == "-P" && i + 1 < argc ) {
+            context->partial_filename = argv[ ++i ];
+        } else if ( arg == "-M" && i + 1 < argc ) {
+            context->metrics_socket = argv[ ++i ];
+        } else if ( arg == "-F" && i + 1 < argc ) {
+            context->metrics_filename = argv[ ++i ];
+        } else if ( arg == "-C" && i + 1 < argc ) {
+            context->checkpoint_filename = argv[ ++i ];
+        } else if ( arg == "-i" && i + 1 < argc ) {
+            context->input_paths.emplace_back( argv[ ++i ] );
+        } else if ( arg == "-U" && i + 1 < argc ) {
+            context->input_socket = argv[ ++i ];
+        } else if ( arg == "-f" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == CMessageParser::GetFormatName() ) {
+            context->INPUT_FORMAT = CContext::INPUT_FORMAT_HTTP;
+            i++;
+        } else if ( arg == "-f" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == CJsonLinesParser::GetFormatName() ) {
+            context->INPUT_FORMAT = CContext::INPUT_FORMAT_JSON;
+            i++;
+        } else if ( arg == "-f" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == CBinaryRecordParser::GetFormatName() ) {
+            context->INPUT_FORMAT = CContext::INPUT_FORMAT_BINARY;
+            i++;
+        } else if ( arg == "-g" ) {
+            context->CHUNKED_INPUT = false;
+        } else if ( arg == "-u" ) {
+            context->IO_URING = true;
+        } else if ( arg == "-p" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->PARSER_COUNT = atoi( argv[ ++i ] );
+        } else if ( arg == "-a" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->AGGREGATOR_COUNT = atoi( argv[ ++i ] );
+        } else if ( arg == "-t" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->SECONDS_PER_OUTPUT = atoi( argv[ ++i ] );
+        } else if ( arg == "-w" && i + 1 < argc && atoi( argv[ i + 1 ] ) >= 0 ) {
+            context->RESPONSE_GRACE_SECONDS = atoi( argv[ ++i ] );
+        } else if ( arg == "-l" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->REQUEST_LIFETIME_SECONDS = atoi( argv[ ++i ] );
+        } else if ( arg == "-m" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->INPUT_MEMORY_LIMIT = size_t( atoi( argv[ ++i ] ) ) << 20;
+        } else if ( arg == "-q" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->CHANNEL_DEPTH = atoi( argv[ ++i ] );
+        } else if ( arg == "-j" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->JOIN_STATE_LIMIT = atoi( argv[ ++i ] );
+        } else if ( arg == "-s" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "auto" ) {
+            context->ADAPTIVE_SAMPLING = true;
+            i++;
+        } else if ( arg == "-s" && i + 1 < argc && atof( argv[ i + 1 ] ) > 0 && atof( argv[ i + 1 ] ) <= 1 ) {
+            // the rate is rounded down to a power of two
+            context->SAMPLE_SHIFT = std::min < int >( std::ceil( -std::log2( atof( argv[ ++i ] ) ) ), CSampler::MAX_SHIFT );
+        } else if ( arg == "-k" && i + 1 < argc && atoi( argv[ i + 1 ] ) > 0 ) {
+            context->SKETCH_SIZE = size_t( atoi( argv[ ++i ] ) ) << 10;
+        } else if ( arg == "-n" && i + 1 < argc ) {
+            if ( !context->path_normalizer.Load( argv[ ++i ] ) ) {
+                std::cout << "Cannot read request path templates from " << argv[ i ] << std::endl;
+                return -1;
+            }
+        } else if ( arg == "-L" ) {
+            context->LATENCY_COLUMNS = true;
+        } else if ( arg == "-N" ) {
+            context->path_normalizer.SetCollapseSegments( true );
+        } else if ( arg == "-b" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "block" ) {
+            context->OVERLOAD_POLICY = CContext::OVERLOAD_BLOCK;
+            i++;
+        } else if ( arg == "-b" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "shed" ) {
+            context->OVERLOAD_POLICY = CContext::OVERLOAD_SHED;
+            i++;
+        } else if ( arg == "-b" && i + 1 < argc && std::string_view( argv[ i + 1 ] ) == "fast" ) {
+            context->OVERLOAD_POLICY = CContext::OVERLOAD_FAST_PARSE;
+            i++;
         } else {
-            std::cout << "Usage: " << argv[ 0 ] << " [-o <output file>]" << std::endl;
+            std::cout << "Usage: " << argv[ 0 ] << " [-o <output file>] [-r <seconds>:<file>[:<count>]]... [-B <binary file>] [-P <partial file>] [-M <socket>] [-F <metrics file>] [-C <checkpoint file>] [-i <input>]... [-U <socket>] [-f http|json|binary] [-g] [-u] [-p <parser count>] [-a <aggregator count>] [-t <seconds>] [-w <seconds>] [-l <seconds>]"
+                " [-m <MiB>] [-q <depth>] [-j <count>] [-b block|shed|fast] [-s <rate>|auto] [-k <KiB>] [-n <template file>] [-N] [-L]" << std::endl;
+            std::cout << "  -o <output file>  file to write aggregated stats to" << std::endl;
+            std::cout << "  -r <seconds>:<file>[:<count>]  write intervals of this width (a multiple of the -t one) rolled up from" << std::endl;
+            std::cout << "                    the aggregated intervals to this file, keep the last <count> intervals in files suffixed" << std::endl;
+            std::cout << "                    with their start time (files of earlier runs count too); may be repeated for several resolutions" << std::endl;
+            std::cout << "  -B <binary file>  file to append every interval to in the columnar binary format (rolled over at 256 MiB," << std::endl;
+            std::cout << "                    converted to CSV with processor-read)" << std::endl;
+            std::cout << "  -P <partial file> file to append every interval to as partial stats mergeable with other instances' ones" << std::endl;
+            std::cout << "                    (rolled over at 256 MiB, combined with processor-merge)" << std::endl;
+            std::cout << "  -M <socket>       serve metrics in the Prometheus text format on this Unix domain socket" << std::endl;
+            std::cout << "  -F <metrics file> write metrics in the Prometheus text format to this file every 10 seconds" << std::endl;
+            std::cout << "  -C <checkpoint file> checkpoint requests waiting for responses, intervals not output yet and rollups in progress to" << std::endl;
+            std::cout << "                    this file every 10 seconds and on exit, continue from it on startup (SIGINT or SIGTERM keep the" << std::endl;
+            std::cout << "                    state for the next run instead of counting and outputting it; events still being read or parsed" << std::endl;
+            std::cout << "                    are not in periodic checkpoints and are lost if the process crashes); STDIN is read as with -i -," << std::endl;
+            std::cout << "                    so by blocks with read() (-g cannot be used, -u applies to the output file only)" << std::endl;
+            std::cout << "  -i <input>        read a file or a FIFO (\"-\" for STDIN) instead of STDIN, may be repeated to read several inputs" << std::endl;
+            std::cout << "                    in parallel (inputs are multiplexed with epoll, SIGINT or SIGTERM end reading)" << std::endl;
+            std::cout << "  -U <socket>       accept input connections on this Unix domain socket (until SIGINT or SIGTERM)" << std::endl;
+            std::cout << "  -f http|json|binary  input format: HTTP/1.x messages separated by empty lines, JSON lines" << std::endl;
+            std::cout << "                    ({\"trace_id\":...,\"path\":... or \"status\":...}) or length-prefixed binary records (default http)" << std::endl;
+            std::cout << "  -g                read input line by line with std::getline() instead of by blocks" << std::endl;
+            std::cout << "  -u                read input and write the output file with io_uring (falls back to read() and blocking" << std::endl;
+            std::cout << "                    writes if io_uring is not available)" << std::endl;
+            std::cout << "  -p <parser count> count of parallel parsing threads (default 1)" << std::endl;
+            std::cout << "  -a <aggregator count> count of parallel aggregation threads (default 1)" << std::endl;
+            std::cout << "  -t <seconds>      width of the aggregated interval (default 60)" << std::endl;
+            std::cout << "  -w <seconds>      time for a response to wait for its request (default 5)" << std::endl;
+            std::cout << "  -l <seconds>      time for a request to wait for its response (default 20)" << std::endl;
+            std::cout << "  -m <MiB>          maximum size of input in flight (default 1024)" << std::endl;
+            std::cout << "  -q <depth>        capacity of channels between pipeline stages (default 256)" << std::endl;
+            std::cout << "  -j <count>        maximum count of pending requests and of early responses per aggregator (default 4194304)" << std::endl;
+            std::cout << "  -b block|shed|fast  overload policy: block the input, drop whole seconds of input or parse headers" << std::endl;
+            std::cout << "                    partially (default block)" << std::endl;
+            std::cout << "  -s <rate>|auto    count a sample of traces (the rate is rounded down to a power of two)" << std::endl;
+            std::cout << "                    or sample adaptively lowering the rate while processing lags" << std::endl;
+            std::cout << "  -k <KiB>          count top request paths approximately in a sketch of this size per interval" << std::endl;
+            std::cout << "  -n <template file> replace request paths matching templates like /users/{id}/orders/{uuid}" << std::endl;
+            std::cout << "  -N                collapse numeric, UUID and long hex path segments to {id}, {uuid}, {hex}" << std::endl;
+            std::cout << "  -L                add request to response latency percentile columns (milliseconds) for every result code" << std::endl;
+            std::cout << "                    (events are stamped with the time their input block is read, to 1 ms, so events read at" << std::endl;
+            std::cout << "                    once have zero latency and file input shows mostly zeros; responses received before their" << std::endl;
+            std::cout << "                    requests are counted without a latency)" << std::endl;
+            return -1;
+        }
+    }
+
+    if ( !context->checkpoint_filename.empty() && context->input_paths.empty() && context->input_socket.empty() ) {
+        // STDIN is read as a source, so a signal ends the input keeping the state (sources are read by blocks with read())
+        if ( !context->CHUNKED_INPUT ) {
+            std::cout << "STDIN is read as with -i - when checkpointing, -g cannot be used with -C" << std::endl;
             return -1;
         }
+        context->input_paths.emplace_back( "-" );
+    }
+
+    for ( const auto & resolution : context->output_resolutions ) {
+        if ( resolution.seconds % context->SECONDS_PER_OUTPUT != 0 ) {
+            std::cout << "Width of " << resolution.filename << " intervals is not a multiple of " << context->SECONDS_PER_OUTPUT << " seconds" << std::endl;
+            return -1;
+        }
+    }
+
+    context->CreatePipeline();
+
+    if ( !context->checkpoint_filename.empty() && !CCheckpointer::Restore( context ) ) {
+        return -1;
     }
 
+    context->DEBUG_OUTPUT && std::cout << "Message scanning implementation: " << CMessageParser::GetImplementationName() << std::endl;
+
     //
     // Data pipeline:
     //
-    // LineReader -> (CLineBuckets ready_line_buckets) ->
-    //  -> LineProcessor -> (CEventBuckets request_map, response_map) ->
-    //  -> Aggregator -> (CAggregatedStatsCollection) ->
-    //  -> OutputProcessor -> (file)
+    // LineReader (STDIN or sources multiplexed with epoll, line buckets per source) -> (CChannel segment_channel) ->
+    //  -> LineProcessor < input format parser > x PARSER_COUNT -> (CChannel event_channel per partition) ->
+    //  -> Aggregator x AGGREGATOR_COUNT (CEventIndex pending_requests, early_responses, private stats shards) ->
+    //  -> (CAggregatedStatsCollection, shards merged on output) ->
+    //  -> OutputProcessor -> (file, rollups of coarser resolutions merged incrementally -> file per resolution)
+    //
+    // Checkpointer: partition state copied by aggregators on request + stats collection -> (checkpoint file)
     //
 
+    if ( !context->input_paths.empty() || !context->input_socket.empty() ) {
+        // the reader receives SIGINT and SIGTERM with signalfd, so they are blocked in all threads started from here
+        sigset_t signals;
+        sigemptyset( &signals );
+        sigaddset( &signals, SIGINT );
+        sigaddset( &signals, SIGTERM );
+        pthread_sigmask( SIG_BLOCK, &signals, nullptr );
+    }
+
     auto read_thread = std::jthread( CLineReader::Run, context );
-    auto cleanup_thread = std::jthread( Cleanup, context );
-    auto parse_thread = std::jthread( CLineProcessor::Run, context );
-    auto aggregate_thread = std::jthread( CAggregator::Run, context );
+    std::vector < std::jthread > parse_threads;
+    DispatchInputFormat( context->INPUT_FORMAT, [ & ]( auto parser ) {
+        for ( unsigned int i = 0; i < context->PARSER_COUNT; i++ ) {
+            parse_threads.emplace_back( CLineProcessor < typename decltype( parser )::type >::Run, context );
+        }
+    } );
+    std::vector < std::jthread > aggregate_threads;
+    for ( unsigned int i = 0; i < context->AGGREGATOR_COUNT; i++ ) {
+        aggregate_threads.emplace_back( CAggregator::Run, context, i );
+    }
     auto output_thread = std::jthread( COutputProcessor::Run, context );
+    std::jthread checkpoint_thread;
+    if ( !context->checkpoint_filename.empty() ) {
+        checkpoint_thread = std::jthread( CCheckpointer::Run, context );
+    }
+    std::jthread metrics_thread;
+    if ( !context->metrics_socket.empty() || !context->metrics_filename.empty() ) {
+        metrics_thread = std::jthread( CMetricsExporter::Run, context );
+    }
 
     read_thread.join();  // this will block until the STDIN pipe or file is closed
 
-    cleanup_thread.request_stop();
-    cleanup_thread.join();
-    parse_thread.request_stop();
-    parse_thread.join();
-    aggregate_thread.request_stop();
-    aggregate_thread.join();
+    // stages terminate when their input channels are closed and drained
+    context->segment_channel->Close();
+    for ( auto & parse_thread : parse_threads ) {
+        parse_thread.join();
+    }
+    for ( auto & partition : context->partitions ) {
+        partition->event_channel.Close();
+    }
+    for ( auto & aggregate_thread : aggregate_threads ) {
+        aggregate_thread.join();
+    }
     output_thread.request_stop();
     output_thread.join();
+    // the final checkpoint is taken once the state is not changing anymore
+    if ( checkpoint_thread.joinable() ) {
+        checkpoint_thread.request_stop();
+        checkpoint_thread.join();
+    }
+    if ( metrics_thread.joinable() ) {
+        metrics_thread.request_stop();
+        metrics_thread.join();
+    }
 
     return 0;
 }
@@ -0,0 +1,187 @@
+#include "common.h"
+
+#include "BinaryStats.h"
+#include "PartialStats.h"
+
+//
+// Merges partial stats files (written with the -P option by processor instances reading different parts of traffic)
+// into the CSV output format of one processor, interval by interval in time order. Files are streamed record
+// by record, so memory holds one interval per file. Records of one interval are summed whichever files they come
+// from, so rolled files of an instance are passed as separate inputs.
+//
+
+namespace {
+
+    // the name of the row of request paths out of the top of a sketch (kept apart from a request path of the same name)
+    constexpr std::string_view OTHER_REQUEST_PATH = "other";
+
+    class CInput {
+        public:
+            std::string filename;
+            CPartialStatsReader reader;
+            CPartialStats::CInterval interval;
+            bool bHasInterval = false;
+    };
+
+    // writes a merged interval in the CSV output format of the processor
+    void WriteInterval( std::ostream & out, const CPartialStats::CInterval & partial ) {
+
+        // cells and other paths' cells sorted by path and code, so rows are sorted by path and code indexes too
+        struct CEntry {
+            std::string_view path;
+            bool bOther;
+            std::string_view code;
+            const CPartialStats::CCell * cell;
+        };
+        std::vector < CEntry > entries;
+        entries.reserve( partial.cells.size() + partial.other_cells.size() );
+        for ( const auto & [ key, cell ] : partial.cells ) {
+            entries.push_back( { key.first, false, key.second, &cell } );
+        }
+        for ( const auto & [ code, cell ] : partial.other_cells ) {
+            entries.push_back( { OTHER_REQUEST_PATH, true, code, &cell } );
+        }
+        // the other paths go before a path of the same name as in the processor output (reserved IDs are the lowest)
+        std::ranges::sort( entries, {}, []( const CEntry & entry ) {
+            return std::make_tuple( entry.path, !entry.bOther, entry.code );
+        } );
+
+        CBinaryStats::CInterval interval;
+        interval.start_ts = partial.start_ts;
+        interval.end_ts = partial.end_ts;
+        interval.flags =
+            ( partial.flags & CPartialStats::FLAG_SAMPLED ? static_cast < uint32_t >( CBinaryStats::FLAG_SAMPLED ) : 0 )
+            | ( partial.flags & CPartialStats::FLAG_LATENCIES ? static_cast < uint32_t >( CBinaryStats::FLAG_LATENCIES ) : 0 );
+        interval.total_count = partial.total_count;
+        interval.sample_count = partial.sample_count;
+        interval.total_variance = partial.total_variance;
+        for ( const auto & entry : entries ) {
+            interval.codes.push_back( entry.code );
+        }
+        std::ranges::sort( interval.codes );
+        interval.codes.erase( std::unique( interval.codes.begin(), interval.codes.end() ), interval.codes.end() );
+        size_t top_path_count = 0;
+        for ( size_t i = 0; i < entries.size(); i++ ) {
+            const auto & entry = entries[ i ];
+            if ( i == 0 || entries[ i - 1 ].path != entry.path || entries[ i - 1 ].bOther != entry.bOther ) {
+                interval.paths.push_back( entry.path );
+                top_path_count += !entry.bOther;
+            }
+            const auto & cell = *entry.cell;
+            auto & row = interval.rows.emplace_back();
+            row.path = static_cast < uint32_t >( interval.paths.size() - 1 );
+            row.code = static_cast < uint32_t >( std::ranges::lower_bound( interval.codes, entry.code ) - interval.codes.begin() );
+            row.count = cell.count;
+            row.variance = cell.variance;
+            if ( cell.latencies ) {
+                for ( unsigned int column = 0; column < CBinaryStats::LATENCY_COLUMN_COUNT; column++ ) {
+                    const double fraction = CBinaryStats::LATENCY_FRACTIONS[ column ];
+                    row.latencies[ column ] = fraction < 1 ? cell.latencies->GetPercentile( fraction ) : cell.latencies->GetMax();
+                }
+            }
+        }
+
+        CBinaryStats::WriteCsv( out, interval );
+
+        if ( partial.flags & CPartialStats::FLAG_SKETCH ) {
+            out << "\n# top paths: " << top_path_count << "; count overestimation bound: " << partial.sketch_error_bound;
+        }
+        if ( partial.shed_events || partial.fast_parsed_events || partial.dropped_requests || partial.overflow_responses || partial.input_stall_ms ) {
+            out << "\n# shed events: " << partial.shed_events;
+            out << "; fast parsed events: " << partial.fast_parsed_events;
+            out << "; dropped requests: " << partial.dropped_requests;
+            out << "; overflow responses: " << partial.overflow_responses;
+            out << "; input stall ms: " << partial.input_stall_ms;
+        }
+        out << std::endl;
+    }
+
+    // reads the next interval of an input, returns false if the input cannot be read further
+    bool ReadNext( CInput & input ) {
+        const auto result = input.reader.Next( input.interval );
+        input.bHasInterval = result == CPartialStatsReader::RESULT_RECORD;
+        if ( result == CPartialStatsReader::RESULT_DAMAGED ) {
+            std::cout << "Damaged or incomplete record in " << input.filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+}
+
+int main( const int argc, const char **argv ) {
+
+    std::vector < std::unique_ptr < CInput > > inputs;
+    std::string partial_filename;
+    bool bUsage = false;
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string arg( argv[ i ] );
+        if ( arg == "-P" && i + 1 < argc ) {
+            partial_filename = argv[ ++i ];
+        } else if ( !arg.empty() && arg[ 0 ] != '-' ) {
+            inputs.push_back( std::make_unique < CInput >() );
+            inputs.back()->filename = arg;
+        } else {
+            bUsage = true;
+        }
+    }
+    if ( inputs.empty() || bUsage ) {
+        std::cout << "Usage: " << argv[ 0 ] << " <partial stats file>... [-P <partial file>]" << std::endl;
+        std::cout << "  <partial stats file> file written with the -P option of the processor, intervals of every file" << std::endl;
+        std::cout << "                    are expected in time order (as written); a damaged or incomplete record (e.g. of a file" << std::endl;
+        std::cout << "                    being written) stops the merge with an error" << std::endl;
+        std::cout << "  -P <partial file> append merged intervals to this partial stats file too (to merge them further)" << std::endl;
+        return -1;
+    }
+
+    for ( auto & input : inputs ) {
+        if ( !input->reader.Open( input->filename ) ) {
+            std::cout << "Cannot read partial stats from " << input->filename << std::endl;
+            return -1;
+        }
+        if ( !ReadNext( *input ) ) {
+            return -1;
+        }
+    }
+
+    std::unique_ptr < CBinaryStatsWriter > partial_writer;
+    if ( !partial_filename.empty() ) {
+        partial_writer = std::make_unique < CBinaryStatsWriter >(
+            partial_filename, std::numeric_limits < size_t >::max(), std::string_view( CPartialStats::FILE_MAGIC, sizeof( CPartialStats::FILE_MAGIC ) )
+        );
+    }
+
+    CPartialStats::CInterval merged;
+    std::string record;
+    while ( true ) {
+        // the oldest interval of all inputs is merged from all of them
+        const auto oldest = std::ranges::min_element( inputs, std::less(), []( const auto & input ) {
+            return input->bHasInterval ? input->interval.start_ts : std::numeric_limits < int64_t >::max();
+        } );
+        if ( !( *oldest )->bHasInterval ) {
+            break;
+        }
+        merged.Clear();
+        merged.start_ts = ( *oldest )->interval.start_ts;
+        merged.end_ts = merged.start_ts;
+        for ( auto & input : inputs ) {
+            while ( input->bHasInterval && input->interval.start_ts == merged.start_ts ) {
+                merged.Merge( input->interval );
+                if ( !ReadNext( *input ) ) {
+                    return -1;
+                }
+            }
+        }
+
+        WriteInterval( std::cout, merged );
+        if ( partial_writer ) {
+            CPartialStats::Encode( merged, record );
+            if ( !partial_writer->AppendRecord( record, merged.end_ts ) ) {
+                std::cout << "Cannot write partial stats to " << partial_filename << std::endl;
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
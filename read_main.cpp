@@ -0,0 +1,44 @@
+#include "common.h"
+
+#include "BinaryStats.h"
+
+//
+// Converts intervals of a binary stats file (written with the -B option) back to the CSV output format
+//
+
+int main( const int argc, const char **argv ) {
+
+    std::string filename;
+    int64_t interval_ts = -1;
+    for ( int i = 1; i < argc; i++ ) {
+        const std::string arg( argv[ i ] );
+        if ( arg == "-t" && i + 1 < argc ) {
+            interval_ts = atoll( argv[ ++i ] );
+        } else if ( filename.empty() && !arg.empty() && arg[ 0 ] != '-' ) {
+            filename = arg;
+        } else {
+            filename.clear();
+            break;
+        }
+    }
+    if ( filename.empty() ) {
+        std::cout << "Usage: " << argv[ 0 ] << " <binary stats file> [-t <unix time>]" << std::endl;
+        std::cout << "  -t <unix time>    output only the interval starting at this time" << std::endl;
+        return -1;
+    }
+
+    CBinaryStatsFile file;
+    if ( !file.Open( filename ) ) {
+        std::cout << "Cannot read binary stats from " << filename << std::endl;
+        return -1;
+    }
+
+    file.ForEachInterval( [ & ]( const CBinaryStats::CInterval & interval ) {
+        if ( interval_ts < 0 || interval.start_ts == interval_ts ) {
+            CBinaryStats::WriteCsv( std::cout, interval );
+            std::cout << std::endl;
+        }
+    } );
+
+    return 0;
+}
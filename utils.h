@@ -2,18 +2,67 @@
 
 #include "common.h"
 #include "LineBucket.h"
-#include "EventBucket.h"
+#include "EventBatch.h"
+#include "Channel.h"
+#include "AggregationPartition.h"
+#include "Sampler.h"
+#include "PathNormalizer.h"
 #include "AggregatedStats.h"
+#include "Metrics.h"
+#include "Checkpoint.h"
 
 // values other than 1 are not tested
 constexpr time_t SECONDS_PER_LINE_BUCKET = 1;
 constexpr time_t SECONDS_PER_EVENT_BUCKET = 1;
 
-// width of the aggregated time interval
-constexpr time_t SECONDS_PER_OUTPUT = 60;
+// size of an input slab (lines are framed in place inside slabs)
+constexpr size_t LINE_SLAB_SIZE = 1 << 20;
 
-// maximum time to wait for the response to arrive before dropping request data
-constexpr time_t REQUEST_LIFETIME_IN_SECONDS = 20;
+// minimum free space in a slab to read the next input block into (a new slab is started otherwise)
+constexpr size_t LINE_SLAB_MIN_READ = 64 << 10;
+
+// io_uring input: size of a registered read buffer and count of reads in flight linked in one chain (two chains take turns)
+constexpr size_t RING_READ_SIZE = 256 << 10;
+constexpr unsigned RING_READS_PER_CHAIN = 4;
+
+// io_uring output: maximum count of writes in flight
+constexpr unsigned RING_MAX_WRITES = 16;
+
+// size of the binary stats and partial stats files to roll them over at
+constexpr size_t BINARY_STATS_ROLL_SIZE = size_t( 256 ) << 20;
+
+// period of metrics file dumps
+constexpr time_t METRICS_DUMP_SECONDS = 10;
+
+// time to wait for an HTTP request from a metrics socket client before sending plain metrics
+constexpr int METRICS_REQUEST_TIMEOUT_MS = 100;
+
+// period of checkpoints of the in-flight state and time to wait for aggregators to copy their parts of a checkpoint
+constexpr time_t CHECKPOINT_SECONDS = 10;
+constexpr int CHECKPOINT_COLLECT_TIMEOUT_MS = 2000;
+// event index shards an aggregator copies for a checkpoint per loop (besides one per event batch, all if it is idle)
+constexpr size_t CHECKPOINT_SHARDS_PER_LOOP = 4;
+
+// count of released slabs kept for reuse
+constexpr size_t MAX_FREE_SLABS = 64;
+
+// count of expiration timers processed per expiration step (plus the count of events joined in the step)
+constexpr size_t EXPIRATION_BATCH_SIZE = 1024;
+
+// time to wait for memory in one step while the reader is blocked
+constexpr int INPUT_STALL_STEP_MS = 100;
+
+// time to wait for input from polled sources before idle sources' buckets are checked for sealing
+constexpr int INPUT_POLL_MS = 100;
+
+// request path ID used for responses without a matching request
+constexpr CDictionary::t_id UNDEFINED_REQUEST_ID = 0;
+
+// request path ID used for the sum of request paths out of the top in the sketch mode
+constexpr CDictionary::t_id OTHER_REQUEST_ID = 1;
+
+// count of distinct request paths remembered in the sketch mode (the rest are counted as "other")
+constexpr size_t MAX_SKETCH_REQUEST_PATHS = 1 << 20;
 
 //#define DEBUG_MEMORY_CONSUMPTION 1
 
@@ -21,6 +70,27 @@ inline auto to_stream( const time_t tp ) {
     return std::put_time( std::localtime( &tp ), "%F %T %Z" );
 }
 
+// returns steady clock time in microseconds wrapping every 71 minutes (for measuring shorter durations)
+inline uint32_t GetSteadyMicroseconds() {
+    return static_cast < uint32_t >(
+        std::chrono::duration_cast < std::chrono::microseconds >( std::chrono::steady_clock::now().time_since_epoch() ).count()
+    );
+}
+
+//
+// Output resolution rolled up from intervals of the aggregated stats: every interval of the resolution is written to its
+// own file, the newest one replacing the previous (the last intervals are kept in files suffixed with their start time
+// if retained)
+//
+class COutputResolution {
+    public:
+        // width of an interval, a multiple of the aggregated interval width
+        time_t seconds = 0;
+        std::string filename;
+        // count of the last intervals kept in separate files
+        unsigned int retention = 0;
+};
+
 //
 // Data accessed from different threads.
 // Thread-safety is provided separately for every field.
@@ -31,12 +101,128 @@ class CContext {
 
         bool DEBUG_OUTPUT = false;
         bool DUMP_TO_STDOUT = true;
+        // read input by large blocks instead of std::getline() calls
+        bool CHUNKED_INPUT = true;
+        // read input blocks and write output files with io_uring if the kernel allows (read() and blocking writes otherwise)
+        bool IO_URING = false;
+        // count of parallel parsing threads
+        unsigned int PARSER_COUNT = 1;
+        // count of parallel aggregation threads (trace ID space partitions)
+        unsigned int AGGREGATOR_COUNT = 1;
+        // time for a response to wait for its request before being counted as "undefined"
+        time_t RESPONSE_GRACE_SECONDS = 5;
+        // maximum time to wait for the response to arrive before dropping request data
+        time_t REQUEST_LIFETIME_SECONDS = 20;
+        // maximum total size of input slabs in flight (in addition to the slab being filled)
+        size_t INPUT_MEMORY_LIMIT = size_t( 1024 ) << 20;
+        // capacity of every channel between pipeline stages
+        size_t CHANNEL_DEPTH = 256;
+        // maximum count of pending requests and of early responses per aggregation partition
+        size_t JOIN_STATE_LIMIT = 1 << 22;
+        // sample rate is 1 / 2^SAMPLE_SHIFT (the initial rate if adaptive)
+        unsigned int SAMPLE_SHIFT = 0;
+        // lower the sample rate while the pipeline lags, raise it back when it catches up
+        bool ADAPTIVE_SAMPLING = false;
+        // output request to response latency percentiles
+        bool LATENCY_COLUMNS = false;
+        // size of the stats sketch per interval (exact counts if 0)
+        size_t SKETCH_SIZE = 0;
+        // width of the aggregated time interval (the finest output resolution)
+        time_t SECONDS_PER_OUTPUT = 60;
+        // what to do when input arrives faster than it is processed (the reader is blocked at the memory limit under any policy)
+        enum {
+            // block the reader, the writer is blocked by the full input pipe
+            OVERLOAD_BLOCK,
+            // drop whole line buckets started while overloaded
+            OVERLOAD_SHED,
+            // parse line buckets started while overloaded in the fast mode
+            OVERLOAD_FAST_PARSE,
+        } OVERLOAD_POLICY = OVERLOAD_BLOCK;
+        // format of input events (see MessageFormat.h)
+        enum EInputFormat {
+            // HTTP/1.x messages, events are separated by an empty line
+            INPUT_FORMAT_HTTP,
+            // one JSON object per line
+            INPUT_FORMAT_JSON,
+            // length-prefixed binary records
+            INPUT_FORMAT_BINARY,
+        } INPUT_FORMAT = INPUT_FORMAT_HTTP;
         std::string filename;
+        // coarser output resolutions rolled up from the intervals output
+        std::vector < COutputResolution > output_resolutions;
+        // input files and FIFOs ("-" is STDIN) and a Unix domain socket to accept input connections on, multiplexed
+        // with epoll instead of reading STDIN alone
+        std::vector < std::string > input_paths;
+        std::string input_socket;
+        // rolling binary stats file every interval is appended to
+        std::string binary_filename;
+        // rolling file every interval is appended to as mergeable partial stats (combined with processor-merge)
+        std::string partial_filename;
+        // Unix domain socket to serve metrics on and file to dump metrics to periodically
+        std::string metrics_socket;
+        std::string metrics_filename;
+        // file to checkpoint the in-flight state to and to restore it from on startup
+        std::string checkpoint_filename;
+
+        // per-thread metrics of pipeline stages
+        CMetrics metrics;
 
-        CEventBuckets request_map;
-        CEventBuckets response_map;
-        CLineBuckets filling_line_buckets;
-        CLineBuckets ready_line_buckets;
+        // declared before the line buckets to outlive the slabs they reference
+        CSlabPool slab_pool { MAX_FREE_SLABS };
+
+        // dimension values interned at parse time, events and stats refer to them by ID
+        CDictionary request_paths { "undefined", "other" };
+        CDictionary result_codes;
+
+        // request path templates (loaded before the pipeline is started)
+        CPathNormalizer path_normalizer;
+
+        // sample rates of input seconds
+        CSampler sampler;
+
+        // line buckets from the start of filling until their events are joined
+        CLineBuckets line_buckets;
+        // line bucket segments to parse (created once settings are known)
+        std::unique_ptr < CChannel < CSegmentRef > > segment_channel;
+        // aggregation partitions (created once settings are known)
+        std::vector < PAggregationPartition > partitions;
+        // interval stats handed over by aggregation threads
         CAggregatedStatsCollection stats;
+        // parts of the checkpoint being taken
+        CCheckpointParts checkpoint_parts;
+        // start of the first interval not taken for output yet (set by the output thread before an interval is merged)
+        std::atomic < time_t > output_watermark = 0;
+        // rollups in progress restored from the checkpoint, taken by the output processor
+        std::vector < CCheckpoint::CRestoredRollup > restored_rollups;
+        // the input was ended by SIGINT or SIGTERM rather than by its end
+        std::atomic < bool > bInputInterrupted = false;
+
+        // creates channels and AGGREGATOR_COUNT aggregation partitions
+        void CreatePipeline() {
+            sampler.Configure( SAMPLE_SHIFT, ADAPTIVE_SAMPLING, REQUEST_LIFETIME_SECONDS, RESPONSE_GRACE_SECONDS );
+            stats.SetIntervalSeconds( SECONDS_PER_OUTPUT );
+            if ( SKETCH_SIZE > 0 ) {
+                request_paths.SetCapacity( MAX_SKETCH_REQUEST_PATHS, OTHER_REQUEST_ID );
+            }
+            segment_channel = std::make_unique < CChannel < CSegmentRef > >( CHANNEL_DEPTH );
+            for ( unsigned int i = 0; i < AGGREGATOR_COUNT; i++ ) {
+                partitions.push_back( std::make_unique < CAggregationPartition >( CHANNEL_DEPTH ) );
+            }
+        }
+
+        // returns true if events still waiting and intervals not complete yet are checkpointed on exit for the next run
+        // instead of being expired and output
+        bool IsKeepingStateOnExit() const {
+            return !checkpoint_filename.empty() && bInputInterrupted;
+        }
+
+        // returns the time before which all events are joined and counted in all partitions
+        time_t GetJoinedTimeLimit() const {
+            time_t result = std::numeric_limits < time_t >::max();
+            for ( const auto & partition : partitions ) {
+                result = std::min < time_t >( result, partition->joined_time_limit );
+            }
+            return result;
+        }
 };
 typedef std::shared_ptr < CContext > PContext;